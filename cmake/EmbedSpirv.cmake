@@ -0,0 +1,24 @@
+# Converts a SPIR-V binary into a header holding it as a constexpr uint32_t array.
+# Invoked in script mode by add_example_shaders() with SPIRV_FILE, HEADER_FILE, SYMBOL and SOURCE_NAME set.
+
+file(READ ${SPIRV_FILE} spirv_hex HEX)
+
+# SPIR-V is a stream of little endian 32-bit words.
+string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1, " spirv_words "${spirv_hex}")
+string(REGEX REPLACE "((0x[0-9a-f]+, ){8})" "\\1\n\t" spirv_words "${spirv_words}")
+
+file(WRITE ${HEADER_FILE}.tmp
+"#pragma once
+
+// Generated from ${SOURCE_NAME} at build time, do not edit.
+
+#include <cstdint>
+
+static constexpr uint32_t ${SYMBOL}[] = {
+	${spirv_words}
+};
+")
+
+# Only touch the header when the SPIR-V actually changed, so unrelated shader edits don't rebuild everything.
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${HEADER_FILE}.tmp ${HEADER_FILE})
+file(REMOVE ${HEADER_FILE}.tmp)
@@ -0,0 +1,179 @@
+// Writes the block layouts of a compiled shader as a header of constexpr offsets, which
+// common/std_layout.hpp checks host structs against.
+// Built and run by add_example_shaders() in CMakeLists.txt:
+//
+//	spirv_layout <shader.spv> <header.hpp> <namespace> <source name>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../examples/common/spirv_reflect.hpp"
+
+static const char* GetBlockKindName(SpirvBlockKind kind)
+{
+	switch (kind)
+	{
+	case SpirvBlockKind::Uniform: return "uniform";
+	case SpirvBlockKind::Storage: return "buffer";
+	case SpirvBlockKind::PushConstant: return "push_constant";
+	}
+	return "";
+}
+
+// Same size, offsets and array strides.
+static bool SameLayout(const SpirvStruct& a, const SpirvStruct& b)
+{
+	if (a.size != b.size || a.members.size() != b.members.size())
+		return false;
+	for (size_t m = 0; m < a.members.size(); m++)
+	{
+		if (a.members[m].offset != b.members[m].offset || a.members[m].array_stride != b.members[m].array_stride)
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 5)
+	{
+		std::fprintf(stderr, "Usage: spirv_layout <shader.spv> <header.hpp> <namespace> <source name>\n");
+		return 1;
+	}
+
+	std::ifstream input(argv[1], std::ios::binary);
+	std::vector<char> bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+	std::vector<uint32_t> code(bytes.size() / sizeof(uint32_t));
+	std::memcpy(code.data(), bytes.data(), code.size() * sizeof(uint32_t));
+
+	SpirvReflection reflection;
+	if (!input || bytes.size() % sizeof(uint32_t) != 0 || !ReflectSpirv(code.data(), code.size(), reflection))
+	{
+		std::fprintf(stderr, "spirv_layout: %s is not a valid SPIR-V module\n", argv[1]);
+		return 1;
+	}
+
+	// Comment and layout rule of the block each struct is reached from. A block's nested structs follow
+	// its own struct, so they take the block's rule.
+	std::vector<std::string> block_comments(reflection.structs.size());
+	std::vector<const char*> struct_rules(reflection.structs.size(), "std430");
+	for (const SpirvBlock& block : reflection.blocks)
+	{
+		std::ostringstream comment;
+		if (block.kind == SpirvBlockKind::PushConstant)
+			comment << "\t// push_constant\n";
+		else
+			comment << "\t// " << GetBlockKindName(block.kind) << ", set = " << block.set << ", binding = " << block.binding << "\n";
+		block_comments[block.struct_index] = comment.str();
+	}
+	const char* rule = "std430";
+	for (size_t i = 0; i < reflection.structs.size(); i++)
+	{
+		for (const SpirvBlock& block : reflection.blocks)
+		{
+			if (block.struct_index == i)
+				rule = block.kind == SpirvBlockKind::Uniform ? "std140" : "std430";
+		}
+		struct_rules[i] = rule;
+	}
+
+	// The compiler declares a struct once per layout it is used with. Group the copies by name and
+	// keep one per distinct layout.
+	std::vector<std::string> names;
+	std::vector<std::vector<size_t>> layouts;
+	for (size_t i = 0; i < reflection.structs.size(); i++)
+	{
+		const SpirvStruct& type = reflection.structs[i];
+		if (type.name.empty() || type.members.empty())
+			continue;
+
+		size_t group = std::find(names.begin(), names.end(), type.name) - names.begin();
+		if (group == names.size())
+		{
+			names.push_back(type.name);
+			layouts.emplace_back();
+		}
+
+		bool seen = false;
+		for (size_t other : layouts[group])
+			seen = seen || SameLayout(reflection.structs[other], type);
+		if (!seen)
+			layouts[group].push_back(i);
+	}
+
+	std::ostringstream header;
+	header << "#pragma once\n\n";
+	header << "// Generated from " << argv[4] << " at build time, do not edit.\n";
+	header << "// Offsets and sizes in bytes, members in declaration order. See common/std_layout.hpp.\n";
+	header << "// A struct used with both std140 and std430 is written once per layout, as <name>_std140\n";
+	header << "// and <name>_std430.\n\n";
+	header << "#include <cstdint>\n\n";
+	header << "namespace ShaderLayouts\n{\nnamespace " << argv[3] << "\n{\n";
+
+	bool first = true;
+	for (size_t group = 0; group < names.size(); group++)
+	{
+		for (size_t index : layouts[group])
+		{
+			const SpirvStruct& type = reflection.structs[index];
+			std::string name = type.name;
+			if (layouts[group].size() > 1)
+			{
+				for (size_t other : layouts[group])
+				{
+					if (other != index && std::strcmp(struct_rules[other], struct_rules[index]) == 0)
+					{
+						std::fprintf(stderr, "spirv_layout: %s declares struct %s with two different %s layouts\n", argv[4], name.c_str(), struct_rules[index]);
+						return 1;
+					}
+				}
+				name += "_";
+				name += struct_rules[index];
+			}
+
+			if (!first)
+				header << "\n";
+			first = false;
+
+			header << block_comments[index];
+			header << "\tstruct " << name << "\n\t{\n";
+			header << "\t\tstatic constexpr uint32_t size = " << type.size << ";\n";
+			header << "\t\tstatic constexpr uint32_t member_count = " << type.members.size() << ";\n";
+			header << "\t\tstatic constexpr uint32_t offsets[] = {\n";
+			for (const SpirvMember& member : type.members)
+			{
+				header << "\t\t\t" << member.offset << ", // " << member.name;
+				if (member.array_stride)
+					header << ", stride " << member.array_stride;
+				header << "\n";
+			}
+			header << "\t\t};\n\t};\n";
+		}
+	}
+
+	header << "}\n}\n";
+
+	// Only touch the header when the layout actually changed, like cmake/EmbedSpirv.cmake.
+	std::ifstream existing(argv[2], std::ios::binary);
+	std::string previous((std::istreambuf_iterator<char>(existing)), std::istreambuf_iterator<char>());
+	if (existing && previous == header.str())
+		return 0;
+	existing.close();
+
+	std::ofstream output(argv[2], std::ios::binary);
+	output << header.str();
+	if (!output)
+	{
+		std::fprintf(stderr, "spirv_layout: failed to write %s\n", argv[2]);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+// Replacement global operator new and delete, and on glibc malloc and friends, feeding
+// allocation_tracker.hpp. They replace the allocator of the whole process, so include this from
+// exactly one translation unit of an example. Does nothing without QM_EXAMPLES_TRACK_ALLOCATIONS.
+//
+// operator new blocks carry a header with their size and tag (see TrackedNew() in
+// allocation_tracker.hpp), so they are charged back to the tag that allocated them when freed, as
+// are the blocks of libraries routed through TaggedMalloc() (stb_image). Other malloc blocks have
+// no room for one: their size comes from malloc_usable_size(), they count towards the allocations
+// of the tag that made them, and their frees and live bytes only towards the total. Elsewhere than
+// glibc only operator new and TaggedMalloc() are seen, other C allocations (and those of drivers)
+// go uncounted.
+
+#include "allocation_tracker.hpp"
+
+#ifdef QM_EXAMPLES_TRACK_ALLOCATIONS
+
+#include <cerrno>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#include <unistd.h>
+
+extern "C"
+{
+	void* __libc_calloc(size_t count, size_t size);
+	void* __libc_realloc(void* pointer, size_t size);
+	void* __libc_memalign(size_t alignment, size_t size);
+}
+#endif
+
+static void* TrackedNewOrThrow(size_t size, size_t alignment)
+{
+	for (;;)
+	{
+		if (void* pointer = TrackedNew(size, alignment))
+			return pointer;
+
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void* operator new(size_t size) { return TrackedNewOrThrow(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new[](size_t size) { return TrackedNewOrThrow(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new(size_t size, std::align_val_t alignment) { return TrackedNewOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return TrackedNewOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return TrackedNew(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return TrackedNew(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return TrackedNew(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return TrackedNew(size, static_cast<size_t>(alignment)); }
+
+void operator delete(void* pointer) noexcept { TrackedDelete(pointer); }
+void operator delete[](void* pointer) noexcept { TrackedDelete(pointer); }
+void operator delete(void* pointer, size_t) noexcept { TrackedDelete(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { TrackedDelete(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { TrackedDelete(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { TrackedDelete(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { TrackedDelete(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { TrackedDelete(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { TrackedDelete(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { TrackedDelete(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { TrackedDelete(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { TrackedDelete(pointer); }
+
+#if defined(__GLIBC__)
+
+// glibc supports replacing its allocator from the executable: these take over every C allocation
+// in the process, libc's own included, and forward to glibc's implementation.
+
+static inline void* RecordMalloc(void* pointer)
+{
+	if (pointer)
+		RecordAllocation(current_allocation_tag, malloc_usable_size(pointer), false);
+	return pointer;
+}
+
+static inline void RecordMallocFree(void* pointer)
+{
+	if (pointer)
+		RecordUntaggedFree(malloc_usable_size(pointer));
+}
+
+extern "C"
+{
+	void* malloc(size_t size) noexcept
+	{
+		return RecordMalloc(__libc_malloc(size));
+	}
+
+	void* calloc(size_t count, size_t size) noexcept
+	{
+		return RecordMalloc(__libc_calloc(count, size));
+	}
+
+	void* realloc(void* pointer, size_t size) noexcept
+	{
+		if (!pointer)
+			return malloc(size);
+
+		// A failed realloc leaves the block as it was.
+		size_t old_size = malloc_usable_size(pointer);
+		void* resized = __libc_realloc(pointer, size);
+		if (resized || size == 0)
+		{
+			RecordUntaggedFree(old_size);
+			RecordMalloc(resized);
+		}
+		return resized;
+	}
+
+	void free(void* pointer) noexcept
+	{
+		RecordMallocFree(pointer);
+		__libc_free(pointer);
+	}
+
+	void* memalign(size_t alignment, size_t size) noexcept
+	{
+		return RecordMalloc(__libc_memalign(alignment, size));
+	}
+
+	void* aligned_alloc(size_t alignment, size_t size) noexcept
+	{
+		return RecordMalloc(__libc_memalign(alignment, size));
+	}
+
+	int posix_memalign(void** pointer, size_t alignment, size_t size) noexcept
+	{
+		if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0)
+			return EINVAL;
+
+		void* block = RecordMalloc(__libc_memalign(alignment, size));
+		if (!block)
+			return ENOMEM;
+
+		*pointer = block;
+		return 0;
+	}
+
+	void* valloc(size_t size) noexcept
+	{
+		return memalign(static_cast<size_t>(sysconf(_SC_PAGESIZE)), size);
+	}
+
+	void* pvalloc(size_t size) noexcept
+	{
+		size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		return memalign(page, (size + page - 1) & ~(page - 1));
+	}
+}
+
+#endif
+
+#endif
@@ -0,0 +1,369 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// Heap allocation accounting by subsystem. The counting itself is done by the global hooks in
+// allocation_hooks.hpp, which are only compiled with QM_EXAMPLES_TRACK_ALLOCATIONS (the CMake
+// option of the same name). Without it the counters stay at zero and scopes cost a thread local
+// store, so call sites need no #ifdef.
+
+enum class AllocationTag : uint32_t
+{
+	Other,
+	Loader,
+	Texture,
+	Frame,
+	WSI,
+	Count
+};
+
+static inline const char* GetAllocationTagName(AllocationTag tag)
+{
+	switch (tag)
+	{
+	case AllocationTag::Loader:
+		return "loader";
+	case AllocationTag::Texture:
+		return "texture";
+	case AllocationTag::Frame:
+		return "frame";
+	case AllocationTag::WSI:
+		return "wsi";
+	default:
+		return "other";
+	}
+}
+
+static constexpr bool IsAllocationTrackingEnabled()
+{
+#ifdef QM_EXAMPLES_TRACK_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+struct AllocationCounters
+{
+	std::atomic<uint64_t> allocations{ 0 };
+	std::atomic<uint64_t> frees{ 0 };
+	std::atomic<uint64_t> bytes{ 0 };
+	std::atomic<int64_t> live_bytes{ 0 };
+	std::atomic<int64_t> peak_bytes{ 0 };
+
+	void Allocate(size_t size)
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		bytes.fetch_add(size, std::memory_order_relaxed);
+		int64_t live = live_bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed) + static_cast<int64_t>(size);
+
+		int64_t peak = peak_bytes.load(std::memory_order_relaxed);
+		while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	void Free(size_t size)
+	{
+		frees.fetch_add(1, std::memory_order_relaxed);
+		live_bytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+	}
+};
+
+// Constant initialized, so the hooks can count allocations made before main().
+inline AllocationCounters allocation_tag_counters[static_cast<uint32_t>(AllocationTag::Count)];
+inline AllocationCounters allocation_total_counters;
+
+// Tag new allocations on this thread are charged to.
+inline thread_local AllocationTag current_allocation_tag = AllocationTag::Other;
+
+// Charges allocations made on this thread to a tag until it goes out of scope. Scopes nest,
+// other threads keep their own tag.
+struct AllocationScope
+{
+	explicit AllocationScope(AllocationTag tag)
+		: previous(current_allocation_tag)
+	{
+		current_allocation_tag = tag;
+	}
+
+	~AllocationScope()
+	{
+		current_allocation_tag = previous;
+	}
+
+	AllocationScope(const AllocationScope&) = delete;
+	AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+
+	AllocationTag previous;
+};
+
+// Called by the hooks. A block's tag and size must be the same when it is freed. Blocks whose tag
+// is not known when freed (the malloc hooks) count towards their tag's allocations and bytes, and
+// are freed with RecordUntaggedFree(), which only updates the total.
+static inline void RecordAllocation(AllocationTag tag, size_t size, bool tag_live_bytes)
+{
+	AllocationCounters& counters = allocation_tag_counters[static_cast<uint32_t>(tag)];
+	if (tag_live_bytes)
+	{
+		counters.Allocate(size);
+	}
+	else
+	{
+		counters.allocations.fetch_add(1, std::memory_order_relaxed);
+		counters.bytes.fetch_add(size, std::memory_order_relaxed);
+	}
+
+	allocation_total_counters.Allocate(size);
+}
+
+static inline void RecordFree(AllocationTag tag, size_t size)
+{
+	allocation_tag_counters[static_cast<uint32_t>(tag)].Free(size);
+	allocation_total_counters.Free(size);
+}
+
+static inline void RecordUntaggedFree(size_t size)
+{
+	allocation_total_counters.Free(size);
+}
+
+#ifdef QM_EXAMPLES_TRACK_ALLOCATIONS
+
+#if defined(__GLIBC__)
+
+extern "C"
+{
+	void* __libc_malloc(size_t size);
+	void __libc_free(void* pointer);
+}
+
+// Tracked blocks come straight from glibc, so the malloc hooks do not count them twice.
+static inline void* RawAllocate(size_t size)
+{
+	return __libc_malloc(size);
+}
+
+static inline void RawFree(void* pointer)
+{
+	__libc_free(pointer);
+}
+
+#else
+
+static inline void* RawAllocate(size_t size)
+{
+	return std::malloc(size);
+}
+
+static inline void RawFree(void* pointer)
+{
+	std::free(pointer);
+}
+
+#endif
+
+struct alignas(16) TrackedBlockHeader
+{
+	uint64_t size;
+	uint32_t tag;
+	// Bytes from the start of the raw block to the header, non-zero for over-aligned blocks.
+	uint32_t offset;
+};
+
+static_assert(sizeof(TrackedBlockHeader) == 16, "header must keep malloc's alignment");
+
+// Blocks with a header carrying their size and tag, behind operator new and TaggedMalloc().
+static inline void* TrackedNew(size_t size, size_t alignment) noexcept
+{
+	// Blocks up to the default alignment keep malloc's, the header being a multiple of it.
+	size_t padding = alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__ ? alignment : 0;
+	if (size > SIZE_MAX - sizeof(TrackedBlockHeader) - padding)
+		return nullptr;
+
+	uint8_t* block = static_cast<uint8_t*>(RawAllocate(size + sizeof(TrackedBlockHeader) + padding));
+	if (!block)
+		return nullptr;
+
+	uint8_t* data = block + sizeof(TrackedBlockHeader);
+	if (padding)
+		data = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(data) + alignment - 1) & ~uintptr_t(alignment - 1));
+
+	TrackedBlockHeader* header = reinterpret_cast<TrackedBlockHeader*>(data) - 1;
+	header->size = size;
+	header->tag = static_cast<uint32_t>(current_allocation_tag);
+	header->offset = static_cast<uint32_t>(reinterpret_cast<uint8_t*>(header) - block);
+
+	RecordAllocation(current_allocation_tag, size, true);
+	return data;
+}
+
+static inline void TrackedDelete(void* pointer) noexcept
+{
+	if (!pointer)
+		return;
+
+	TrackedBlockHeader* header = static_cast<TrackedBlockHeader*>(pointer) - 1;
+	RecordFree(static_cast<AllocationTag>(header->tag), header->size);
+	RawFree(reinterpret_cast<uint8_t*>(header) - header->offset);
+}
+
+// A C allocator whose blocks are charged back to their tag when freed, for libraries that let
+// their allocator be replaced. stb_image uses it (see file_loader.hpp).
+static inline void* TaggedMalloc(size_t size)
+{
+	return TrackedNew(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+static inline void TaggedFree(void* pointer)
+{
+	TrackedDelete(pointer);
+}
+
+// The resized block is charged to the current tag.
+static inline void* TaggedRealloc(void* pointer, size_t size)
+{
+	if (!pointer)
+		return TaggedMalloc(size);
+
+	void* resized = TaggedMalloc(size);
+	if (!resized)
+		return nullptr;
+
+	size_t old_size = (static_cast<TrackedBlockHeader*>(pointer) - 1)->size;
+	std::memcpy(resized, pointer, old_size < size ? old_size : size);
+	TaggedFree(pointer);
+	return resized;
+}
+
+#else
+
+static inline void* TaggedMalloc(size_t size)
+{
+	return std::malloc(size);
+}
+
+static inline void TaggedFree(void* pointer)
+{
+	std::free(pointer);
+}
+
+static inline void* TaggedRealloc(void* pointer, size_t size)
+{
+	return std::realloc(pointer, size);
+}
+
+#endif
+
+static inline uint64_t GetTotalAllocationCount()
+{
+	return allocation_total_counters.allocations.load(std::memory_order_relaxed);
+}
+
+// Per tag totals, live and peak bytes of everything allocated so far.
+static inline void LogAllocationStats()
+{
+	if (!IsAllocationTrackingEnabled())
+		return;
+
+	QM_LOG_INFO("Heap allocations by subsystem (frees, live and peak bytes cover operator new and stb_image only):\n");
+	for (uint32_t i = 0; i < static_cast<uint32_t>(AllocationTag::Count); i++)
+	{
+		const AllocationCounters& counters = allocation_tag_counters[i];
+		QM_LOG_INFO("  %-8s %llu allocations, %llu frees, %.2f MB allocated, %.2f MB live, %.2f MB peak\n", GetAllocationTagName(static_cast<AllocationTag>(i)),
+			static_cast<unsigned long long>(counters.allocations.load()), static_cast<unsigned long long>(counters.frees.load()),
+			double(counters.bytes.load()) / (1024.0 * 1024.0), double(counters.live_bytes.load()) / (1024.0 * 1024.0), double(counters.peak_bytes.load()) / (1024.0 * 1024.0));
+	}
+
+	const AllocationCounters& total = allocation_total_counters;
+	QM_LOG_INFO("  total    %llu allocations, %.2f MB live, %.2f MB peak\n", static_cast<unsigned long long>(total.allocations.load()),
+		double(total.live_bytes.load()) / (1024.0 * 1024.0), double(total.peak_bytes.load()) / (1024.0 * 1024.0));
+}
+
+// Counts the heap allocations made from any thread in each frame: between BeginFrame() and the
+// first EndFrame(), then from one EndFrame() to the next. Frames after the first warmup_frames are
+// the steady state, which should not allocate at all.
+struct FrameAllocationCounter
+{
+	explicit FrameAllocationCounter(uint32_t warmup_frames_ = 60)
+		: warmup_frames(warmup_frames_)
+	{
+	}
+
+	void BeginFrame()
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(AllocationTag::Count); i++)
+			frame_start[i] = allocation_tag_counters[i].allocations.load(std::memory_order_relaxed);
+	}
+
+	void EndFrame()
+	{
+		uint64_t frame_allocations = 0;
+		uint64_t tag_allocations[static_cast<uint32_t>(AllocationTag::Count)];
+		for (uint32_t i = 0; i < static_cast<uint32_t>(AllocationTag::Count); i++)
+		{
+			tag_allocations[i] = allocation_tag_counters[i].allocations.load(std::memory_order_relaxed) - frame_start[i];
+			frame_start[i] += tag_allocations[i];
+			frame_allocations += tag_allocations[i];
+		}
+
+		last_frame_allocations = frame_allocations;
+
+		if (frames++ < warmup_frames)
+			return;
+
+		steady_frames++;
+		if (frame_allocations == 0)
+			return;
+
+		allocating_frames++;
+		steady_allocations += frame_allocations;
+		if (frame_allocations > max_frame_allocations)
+			max_frame_allocations = frame_allocations;
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(AllocationTag::Count); i++)
+			steady_tag_allocations[i] += tag_allocations[i];
+	}
+
+	void LogStats() const
+	{
+		if (!IsAllocationTrackingEnabled() || steady_frames == 0)
+			return;
+
+		if (allocating_frames == 0)
+		{
+			QM_LOG_INFO("Steady state is allocation free: no heap allocations in %llu frames after %u warmup frames\n",
+				static_cast<unsigned long long>(steady_frames), warmup_frames);
+			return;
+		}
+
+		QM_LOG_INFO("Steady state allocated in %llu of %llu frames after %u warmup frames: %.2f allocations per frame, at most %llu\n",
+			static_cast<unsigned long long>(allocating_frames), static_cast<unsigned long long>(steady_frames), warmup_frames,
+			double(steady_allocations) / double(steady_frames), static_cast<unsigned long long>(max_frame_allocations));
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(AllocationTag::Count); i++)
+		{
+			if (steady_tag_allocations[i] != 0)
+				QM_LOG_INFO("  %-8s %llu allocations\n", GetAllocationTagName(static_cast<AllocationTag>(i)), static_cast<unsigned long long>(steady_tag_allocations[i]));
+		}
+	}
+
+	uint32_t warmup_frames;
+	uint64_t frames = 0;
+	uint64_t steady_frames = 0;
+	uint64_t allocating_frames = 0;
+	uint64_t steady_allocations = 0;
+	uint64_t max_frame_allocations = 0;
+	uint64_t last_frame_allocations = 0;
+
+private:
+
+	uint64_t frame_start[static_cast<uint32_t>(AllocationTag::Count)] = {};
+	uint64_t steady_tag_allocations[static_cast<uint32_t>(AllocationTag::Count)] = {};
+};
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "shader_bindings.hpp"
+
+// What the bindings of one descriptor set point at. Built once for resources that outlive many
+// frames, registered with a DescriptorCache and then bound by id.
+struct DescriptorSetContents
+{
+	struct Write
+	{
+		uint32_t binding;
+		uint32_t array_index;
+		SpirvDescriptorType type;
+		// ImageView or Buffer, depending on type.
+		const void* resource;
+		Vulkan::StockSampler sampler;
+
+		bool operator==(const Write& other) const
+		{
+			return binding == other.binding && array_index == other.array_index && type == other.type && resource == other.resource && sampler == other.sampler;
+		}
+	};
+
+	uint32_t set = 0;
+	// Sorted by binding, then array index.
+	std::vector<Write> writes;
+
+	void SetSampledTexture(BindingSlot slot, const Vulkan::ImageView& view, Vulkan::StockSampler sampler)
+	{
+		Add(slot, SpirvDescriptorType::SampledTexture, &view, sampler);
+	}
+
+	// One element of a texture array.
+	void SetSampledTexture(BindingSlot slot, uint32_t array_index, const Vulkan::ImageView& view, Vulkan::StockSampler sampler)
+	{
+		Add(slot, SpirvDescriptorType::SampledTexture, &view, sampler, array_index);
+	}
+
+	void SetStorageTexture(BindingSlot slot, const Vulkan::ImageView& view)
+	{
+		Add(slot, SpirvDescriptorType::StorageImage, &view);
+	}
+
+	void SetStorageBuffer(BindingSlot slot, const Vulkan::Buffer& buffer)
+	{
+		Add(slot, SpirvDescriptorType::StorageBuffer, &buffer);
+	}
+
+	// resource must be what type expects. Every slot must be in the same set.
+	void Add(BindingSlot slot, SpirvDescriptorType type, const void* resource, Vulkan::StockSampler sampler = Vulkan::StockSampler::LinearClamp, uint32_t array_index = 0)
+	{
+		if (writes.empty())
+			set = slot.set;
+		else if (slot.set != set)
+			QM_LOG_ERROR("Descriptor set contents mix set %u and set %u\n", set, slot.set);
+
+		Write write = { slot.binding, array_index, type, resource, sampler };
+		auto it = std::lower_bound(writes.begin(), writes.end(), write, [](const Write& a, const Write& b) {
+			return a.binding != b.binding ? a.binding < b.binding : a.array_index < b.array_index;
+		});
+		if (it != writes.end() && it->binding == slot.binding && it->array_index == array_index)
+			*it = write;
+		else
+			writes.insert(it, write);
+	}
+
+	// FNV-1a over the set index and every write.
+	uint64_t GetHash() const
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		auto mix = [&hash](uint64_t value) {
+			for (uint32_t i = 0; i < 8; i++)
+			{
+				hash ^= (value >> (i * 8)) & 0xff;
+				hash *= 0x100000001b3ull;
+			}
+		};
+
+		mix(set);
+		for (const Write& write : writes)
+		{
+			mix(write.binding);
+			mix(write.array_index);
+			mix(static_cast<uint64_t>(write.type));
+			mix(reinterpret_cast<uintptr_t>(write.resource));
+			mix(static_cast<uint64_t>(write.sampler));
+		}
+		return hash;
+	}
+
+	bool operator==(const DescriptorSetContents& other) const
+	{
+		return set == other.set && writes == other.writes;
+	}
+};
+
+// Registry of descriptor set contents keyed by their hash. Identical contents registered from
+// different places (another program, a rebuilt resource list) share one id, so a set's contents
+// are hashed once when registered and never again per frame.
+//
+// QuantumVk allocates and writes the actual VkDescriptorSets when a command buffer's bindings
+// change; the examples only see the Set* calls. The cache sits in front of those: Binder skips
+// every call whose set already holds the same contents in the command buffer, and the statistics
+// count how often bound contents repeat what earlier frames bound, which is the case a backend
+// can serve from already written sets.
+struct DescriptorCache
+{
+	static constexpr uint32_t max_sets = 4;
+	static constexpr uint32_t invalid_id = ~0u;
+
+	struct Stats
+	{
+		uint64_t registrations = 0;
+		// Registrations that found identical contents.
+		uint64_t registration_hits = 0;
+		uint64_t binds = 0;
+		// Binds skipped because the command buffer already held the contents.
+		uint64_t skipped = 0;
+		// Binds that issued descriptor writes for contents an earlier frame had bound.
+		uint64_t reused = 0;
+	};
+
+	// Tracks what one command buffer has bound. Create one per command buffer, on the thread
+	// recording it.
+	struct Binder
+	{
+		explicit Binder(DescriptorCache& cache_)
+			: cache(&cache_)
+		{
+			for (uint32_t& id : bound)
+				id = invalid_id;
+		}
+
+		// True if the set has to be written: it holds something else in this command buffer.
+		bool Prepare(uint32_t id)
+		{
+			return cache->Prepare(bound, id);
+		}
+
+		void Bind(Vulkan::CommandBuffer& cmd, uint32_t id)
+		{
+			if (Prepare(id))
+				cache->Apply(cmd, id);
+		}
+
+		DescriptorCache* cache;
+		uint32_t bound[max_sets];
+	};
+
+	// Returns the id of contents, registering them if no identical contents were registered
+	// before. The resources must stay alive until Clear(). Not thread safe.
+	uint32_t Register(const DescriptorSetContents& contents)
+	{
+		if (contents.set >= max_sets)
+		{
+			QM_LOG_ERROR("Descriptor set %u is out of range\n", contents.set);
+			return invalid_id;
+		}
+
+		stats.registrations++;
+
+		uint64_t hash = contents.GetHash();
+		auto range = ids.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (entries[it->second].contents == contents)
+			{
+				stats.registration_hits++;
+				return it->second;
+			}
+		}
+
+		uint32_t id = static_cast<uint32_t>(entries.size());
+		entries.emplace_back(contents);
+		ids.emplace(hash, id);
+		return id;
+	}
+
+	// Must be called once per frame, before any Binder of the frame binds.
+	void BeginFrame()
+	{
+		frame++;
+	}
+
+	// Forgets every registered set, for example when the resources they point at are recreated.
+	// Ids returned before are invalid afterwards.
+	void Clear()
+	{
+		entries.clear();
+		ids.clear();
+	}
+
+	Stats GetStats() const
+	{
+		Stats result = stats;
+		result.binds = binds.load(std::memory_order_relaxed);
+		result.skipped = skipped.load(std::memory_order_relaxed);
+		result.reused = reused.load(std::memory_order_relaxed);
+		return result;
+	}
+
+	size_t GetSetCount() const
+	{
+		return entries.size();
+	}
+
+	void LogStats() const
+	{
+		Stats result = GetStats();
+		uint64_t written = result.binds - result.skipped;
+		QM_LOG_INFO("Descriptor cache: %zu distinct sets from %llu registrations (%.1f%% hits), %llu binds, %.1f%% skipped as already bound, "
+			"%.1f%% of the rest reused contents of an earlier frame\n", entries.size(),
+			static_cast<unsigned long long>(result.registrations), result.registrations ? 100.0 * result.registration_hits / result.registrations : 0.0,
+			static_cast<unsigned long long>(result.binds), result.binds ? 100.0 * result.skipped / result.binds : 0.0,
+			written ? 100.0 * result.reused / written : 0.0);
+	}
+
+private:
+
+	struct Entry
+	{
+		explicit Entry(const DescriptorSetContents& contents_)
+			: contents(contents_)
+		{
+		}
+
+		DescriptorSetContents contents;
+		// Last frame that wrote these contents, or ~0 if none did yet.
+		std::atomic<uint64_t> last_frame{ ~0ull };
+	};
+
+	// Binders of several recording threads may run at once.
+	bool Prepare(uint32_t* bound, uint32_t id)
+	{
+		if (id == invalid_id)
+			return false;
+
+		binds.fetch_add(1, std::memory_order_relaxed);
+
+		Entry& entry = entries[id];
+		uint32_t& slot = bound[entry.contents.set];
+		if (slot == id)
+		{
+			skipped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		slot = id;
+
+		uint64_t previous = entry.last_frame.exchange(frame, std::memory_order_relaxed);
+		if (previous != ~0ull && previous != frame)
+			reused.fetch_add(1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	void Apply(Vulkan::CommandBuffer& cmd, uint32_t id) const
+	{
+		const DescriptorSetContents& contents = entries[id].contents;
+		for (const DescriptorSetContents::Write& write : contents.writes)
+		{
+			switch (write.type)
+			{
+			case SpirvDescriptorType::SampledTexture:
+				cmd.SetSampledTexture(contents.set, write.binding, write.array_index, *static_cast<const Vulkan::ImageView*>(write.resource), write.sampler);
+				break;
+			case SpirvDescriptorType::StorageImage:
+				cmd.SetStorageTexture(contents.set, write.binding, write.array_index, *static_cast<const Vulkan::ImageView*>(write.resource));
+				break;
+			case SpirvDescriptorType::StorageBuffer:
+				cmd.SetStorageBuffer(contents.set, write.binding, write.array_index, *static_cast<const Vulkan::Buffer*>(write.resource));
+				break;
+			default:
+				QM_LOG_ERROR("Descriptor cache can't bind a %s\n", GetDescriptorTypeName(write.type));
+				break;
+			}
+		}
+	}
+
+	// A deque keeps entries in place as more are registered.
+	std::deque<Entry> entries;
+	std::unordered_multimap<uint64_t, uint32_t> ids;
+	uint64_t frame = 0;
+
+	Stats stats;
+	std::atomic<uint64_t> binds{ 0 };
+	std::atomic<uint64_t> skipped{ 0 };
+	std::atomic<uint64_t> reused{ 0 };
+};
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <fstream>
+#include <memory_resource>
+#include <string>
 #include <vector>
 #include <unordered_map>
 
@@ -9,11 +12,19 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
+#include "allocation_tracker.hpp"
+
+// Decoded images are charged to the caller's allocation tag, see allocation_tracker.hpp.
+#define STBI_MALLOC(size) TaggedMalloc(size)
+#define STBI_REALLOC(pointer, size) TaggedRealloc(pointer, size)
+#define STBI_FREE(pointer) TaggedFree(pointer)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tinyobjloader.h"
 
+#include "submesh.hpp"
+
 static std::vector<char> ReadFile(const char* filepath) {
     std::ifstream file(filepath, std::ios::ate | std::ios::binary);
 
@@ -53,51 +64,325 @@ namespace std {
     };
 }
 
-static void LoadObjModel(const char* filepath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+// Material of an OBJ file, read from the .mtl files it references.
+struct ObjMaterial
 {
-	vertices.clear();
-	indices.clear();
-	
-	tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
+	std::string name;
+	glm::vec3 diffuse_color = glm::vec3(1.0f);
+	// map_Kd, relative to the working directory. Empty if the material has none.
+	std::string diffuse_texture;
+};
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath)) {
-        throw std::runtime_error(warn + err);
+// Directory part of a path, including the trailing separator.
+static std::string GetDirectory(const char* filepath)
+{
+	std::string path = filepath;
+	size_t separator = path.find_last_of("/\\");
+	return separator == std::string::npos ? std::string() : path.substr(0, separator + 1);
+}
+
+// An OBJ file with its shapes and materials kept apart. Triangles are grouped into one submesh per
+// shape and material, and submeshes are sorted by material, then shape, so drawing them in order
+// binds every material once and same-material submeshes are contiguous in indices.
+struct ObjMesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<ObjMaterial> materials;
+	std::vector<std::string> shapes;
+	// Triangles without a material use material materials.size(), one past the last.
+	std::vector<Submesh> submeshes;
+};
+
+namespace ObjParse
+{
+    // Triangles of one shape using one material.
+    struct Group
+    {
+        uint32_t shape;
+        // Material index of the OBJ, -1 for none.
+        int material;
+        uint32_t triangles;
+        // Where the group's indices go in mesh.indices.
+        uint32_t first_index;
+    };
+
+    // Zero based attribute indices of a triangle corner, -1 where the face leaves one out.
+    struct Corner
+    {
+        int position;
+        int tex_coord;
+        int normal;
+    };
+
+    // What tinyobj's callbacks build up. Everything but the output mesh lives in scratch.
+    struct State
+    {
+        explicit State(ObjMesh& mesh_, const std::string& directory_, std::pmr::memory_resource* scratch)
+            : mesh(mesh_), directory(directory_), positions(scratch), tex_coords(scratch), normals(scratch),
+              corners(scratch), groups(scratch), triangle_groups(scratch), shape_groups(scratch), shape_name(scratch)
+        {
+        }
+
+        ObjMesh& mesh;
+        const std::string& directory;
+
+        std::pmr::vector<glm::vec3> positions;
+        std::pmr::vector<glm::vec2> tex_coords;
+        std::pmr::vector<glm::vec3> normals;
+
+        // Three per triangle, in file order, and the group of each triangle.
+        std::pmr::vector<Corner> corners;
+        std::pmr::vector<Group> groups;
+        std::pmr::vector<uint32_t> triangle_groups;
+
+        // Group of each material within the current shape, indexed by material + 1. ~0u until the
+        // shape uses it.
+        std::pmr::vector<uint32_t> shape_groups;
+        int material = -1;
+
+        // Like tinyobj::LoadObj, every g or o line starts a shape, which is only kept once it has a face.
+        std::pmr::string shape_name;
+        bool shape_started = false;
+    };
+
+    // OBJ indices count from 1, negative ones count back from the last attribute so far, 0 is
+    // missing.
+    static inline int ResolveIndex(int index, size_t count)
+    {
+        if (index > 0)
+            return index - 1;
+        if (index < 0)
+            return static_cast<int>(count) + index;
+        return -1;
     }
 
-    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+    static inline void OnVertex(void* user_data, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z, tinyobj::real_t)
+    {
+        static_cast<State*>(user_data)->positions.push_back({ x, y, z });
+    }
 
-    for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
-            Vertex vertex{};
+    static inline void OnNormal(void* user_data, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z)
+    {
+        static_cast<State*>(user_data)->normals.push_back({ x, y, z });
+    }
 
-            vertex.position = {
-                attrib.vertices[3 * index.vertex_index + 0],
-                attrib.vertices[3 * index.vertex_index + 1],
-                attrib.vertices[3 * index.vertex_index + 2]
-            };
+    static inline void OnTexCoord(void* user_data, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t)
+    {
+        static_cast<State*>(user_data)->tex_coords.push_back({ x, y });
+    }
 
-            vertex.tex_coord = {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-            };
+    // Polygons are split into a fan around their first corner, which is exact for the convex faces
+    // exporters write.
+    static inline void OnFace(void* user_data, tinyobj::index_t* indices, int index_count)
+    {
+        State& state = *static_cast<State*>(user_data);
+        if (index_count < 3)
+            return;
+
+        if (!state.shape_started) {
+            state.mesh.shapes.emplace_back(state.shape_name);
+            std::fill(state.shape_groups.begin(), state.shape_groups.end(), ~0u);
+            state.shape_started = true;
+        }
 
-			vertex.normal = 
-			{
-                attrib.normals[3 * index.normal_index + 0],
-                attrib.normals[3 * index.normal_index + 1],
-                attrib.normals[3 * index.normal_index + 2]
+        size_t slot = static_cast<size_t>(state.material + 1);
+        if (slot >= state.shape_groups.size())
+            state.shape_groups.resize(slot + 1, ~0u);
+        if (state.shape_groups[slot] == ~0u) {
+            state.shape_groups[slot] = static_cast<uint32_t>(state.groups.size());
+            state.groups.push_back({ static_cast<uint32_t>(state.mesh.shapes.size() - 1), state.material, 0, 0 });
+        }
+        uint32_t group = state.shape_groups[slot];
+
+        auto resolve = [&](const tinyobj::index_t& index) {
+            return Corner{
+                ResolveIndex(index.vertex_index, state.positions.size()),
+                ResolveIndex(index.texcoord_index, state.tex_coords.size()),
+                ResolveIndex(index.normal_index, state.normals.size())
             };
-            if (uniqueVertices.count(vertex) == 0) {
-                uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                vertices.push_back(vertex);
+        };
+
+        Corner first = resolve(indices[0]);
+        for (int i = 1; i + 1 < index_count; i++) {
+            state.corners.push_back(first);
+            state.corners.push_back(resolve(indices[i]));
+            state.corners.push_back(resolve(indices[i + 1]));
+            state.triangle_groups.push_back(group);
+            state.groups[group].triangles++;
+        }
+    }
+
+    static inline void OnUseMaterial(void* user_data, const char*, int material_id)
+    {
+        static_cast<State*>(user_data)->material = material_id;
+    }
+
+    // Called with every material read so far, each time an mtllib line is read.
+    static inline void OnMaterials(void* user_data, const tinyobj::material_t* materials, int material_count)
+    {
+        State& state = *static_cast<State*>(user_data);
+        state.mesh.materials.clear();
+        for (int i = 0; i < material_count; i++) {
+            ObjMaterial material;
+            material.name = materials[i].name;
+            material.diffuse_color = { materials[i].diffuse[0], materials[i].diffuse[1], materials[i].diffuse[2] };
+            if (!materials[i].diffuse_texname.empty())
+                material.diffuse_texture = state.directory + materials[i].diffuse_texname;
+            state.mesh.materials.push_back(material);
+        }
+    }
+
+    static inline void OnGroup(void* user_data, const char** names, int name_count)
+    {
+        State& state = *static_cast<State*>(user_data);
+        // Several group names are joined with spaces, as tinyobj::LoadObj does.
+        state.shape_name.clear();
+        for (int i = 0; i < name_count; i++) {
+            if (i != 0)
+                state.shape_name += ' ';
+            state.shape_name += names[i];
+        }
+        state.shape_started = false;
+    }
+
+    static inline void OnObject(void* user_data, const char* name)
+    {
+        State& state = *static_cast<State*>(user_data);
+        state.shape_name = name;
+        state.shape_started = false;
+    }
+}
+
+// Temporaries of the load come from scratch, pass a LoaderArena (see loader_arena.hpp) to keep
+// them out of the general heap. The file is parsed through tinyobj's callback API, so attributes and
+// faces go straight into scratch containers instead of tinyobj's own; only its line buffers and the
+// parsed .mtl materials use the heap.
+static void LoadObjMesh(const char* filepath, ObjMesh& mesh, std::pmr::memory_resource* scratch = std::pmr::new_delete_resource())
+{
+	mesh.vertices.clear();
+	mesh.indices.clear();
+	mesh.materials.clear();
+	mesh.shapes.clear();
+	mesh.submeshes.clear();
+
+    std::ifstream file(filepath);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::string("failed to open ") + filepath);
+    }
+
+    // mtllib paths are relative to the OBJ file.
+    std::string directory = GetDirectory(filepath);
+    tinyobj::MaterialFileReader material_reader(directory);
+
+    ObjParse::State state(mesh, directory, scratch);
+
+    tinyobj::callback_t callbacks;
+    callbacks.vertex_cb = ObjParse::OnVertex;
+    callbacks.normal_cb = ObjParse::OnNormal;
+    callbacks.texcoord_cb = ObjParse::OnTexCoord;
+    callbacks.index_cb = ObjParse::OnFace;
+    callbacks.usemtl_cb = ObjParse::OnUseMaterial;
+    callbacks.mtllib_cb = ObjParse::OnMaterials;
+    callbacks.group_cb = ObjParse::OnGroup;
+    callbacks.object_cb = ObjParse::OnObject;
+
+    std::string warn, err;
+    if (!tinyobj::LoadObjWithCallback(file, callbacks, &state, &material_reader, &warn, &err)) {
+        throw std::runtime_error(warn + err);
+    }
+
+    // Triangles with a material the .mtl files did not define use the default one.
+    uint32_t default_material = static_cast<uint32_t>(mesh.materials.size());
+    auto get_material = [&](const ObjParse::Group& group) {
+        bool valid = group.material >= 0 && static_cast<size_t>(group.material) < mesh.materials.size();
+        return valid ? static_cast<uint32_t>(group.material) : default_material;
+    };
+
+    // Groups were created in shape order, a stable sort keeps it within each material.
+    std::pmr::vector<ObjParse::Group>& groups = state.groups;
+    std::pmr::vector<uint32_t> group_order(groups.size(), 0, scratch);
+    for (uint32_t i = 0; i < group_order.size(); i++)
+        group_order[i] = i;
+    std::stable_sort(group_order.begin(), group_order.end(), [&](uint32_t a, uint32_t b) { return get_material(groups[a]) < get_material(groups[b]); });
+
+    // The parse counted every group's triangles, so indices are written straight to their final
+    // place without growing anything.
+    uint32_t index_count = 0;
+    for (uint32_t group : group_order) {
+        groups[group].first_index = index_count;
+        index_count += groups[group].triangles * 3;
+    }
+
+    mesh.indices.resize(index_count);
+    mesh.vertices.reserve(state.positions.size());
+
+    std::pmr::unordered_map<Vertex, uint32_t> uniqueVertices(scratch);
+    uniqueVertices.reserve(state.positions.size());
+
+    // Next index to write of each group.
+    std::pmr::vector<uint32_t> cursors(groups.size(), 0, scratch);
+    for (size_t group = 0; group < groups.size(); group++)
+        cursors[group] = groups[group].first_index;
+
+    for (size_t triangle = 0; triangle < state.triangle_groups.size(); triangle++) {
+        uint32_t& cursor = cursors[state.triangle_groups[triangle]];
+
+        for (size_t corner = 0; corner < 3; corner++) {
+            const ObjParse::Corner& index = state.corners[triangle * 3 + corner];
+
+            if (index.position < 0 || static_cast<size_t>(index.position) >= state.positions.size()) {
+                throw std::runtime_error(std::string("vertex index out of range in ") + filepath);
+            }
+
+            Vertex vertex{};
+            vertex.position = state.positions[index.position];
+
+            // Faces without texture coordinates or normals (f v or f v/vt) leave them out.
+            if (index.tex_coord >= 0 && static_cast<size_t>(index.tex_coord) < state.tex_coords.size())
+            {
+                vertex.tex_coord = { state.tex_coords[index.tex_coord].x, 1.0f - state.tex_coords[index.tex_coord].y };
+            }
+
+            if (index.normal >= 0 && static_cast<size_t>(index.normal) < state.normals.size())
+            {
+                vertex.normal = state.normals[index.normal];
+            }
+            else
+            {
+                vertex.normal = { 0.0f, 0.0f, 1.0f };
             }
 
-            indices.push_back(uniqueVertices[vertex]);
+            auto inserted = uniqueVertices.try_emplace(vertex, static_cast<uint32_t>(mesh.vertices.size()));
+            if (inserted.second)
+                mesh.vertices.push_back(vertex);
+
+            mesh.indices[cursor++] = inserted.first->second;
         }
-   }
+    }
+
+    mesh.submeshes.reserve(groups.size());
+    for (uint32_t group : group_order) {
+        Submesh submesh;
+        submesh.first_index = groups[group].first_index;
+        submesh.index_count = groups[group].triangles * 3;
+        submesh.material = get_material(groups[group]);
+        submesh.shape = groups[group].shape;
+
+        ComputeSubmeshBounds(mesh.vertices, mesh.indices, submesh);
+        mesh.submeshes.push_back(submesh);
+    }
+}
+
+// Loads an OBJ as a single vertex and index list, ignoring its materials.
+static void LoadObjModel(const char* filepath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	std::pmr::memory_resource* scratch = std::pmr::new_delete_resource())
+{
+	ObjMesh mesh;
+	LoadObjMesh(filepath, mesh, scratch);
+
+	vertices = std::move(mesh.vertices);
+	indices = std::move(mesh.indices);
 }
 
 static std::vector<unsigned char> LoadTexture(const char* filepath, int& texWidth, int& texHeight)
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// Runs a simulation in steps of constant length, however long frames take: each frame adds its
+// duration to an accumulator and the simulation takes as many whole steps as fit. Rendering then
+// blends the last two simulated states by GetAlpha(), so motion stays smooth when the frame rate
+// and step rate differ, and the simulation gives the same results on every machine.
+struct FixedTimestep
+{
+	explicit FixedTimestep(double step_ = 1.0 / 60.0, uint32_t max_steps_ = 8)
+		: step(step_), max_steps(max_steps_)
+	{
+	}
+
+	// Adds a frame of frame_delta seconds, and returns how many steps to simulate for it. After a
+	// stall, steps beyond max_steps are dropped rather than caught up on, which would only make the
+	// next frame longer still.
+	uint32_t Advance(double frame_delta)
+	{
+		accumulator += std::max(frame_delta, 0.0);
+
+		uint32_t steps = static_cast<uint32_t>(accumulator / step);
+		if (steps > max_steps)
+		{
+			dropped_steps += steps - max_steps;
+			steps = max_steps;
+			accumulator = step * steps;
+		}
+
+		accumulator -= step * steps;
+		step_count += steps;
+		return steps;
+	}
+
+	// How far between the previous and the latest simulated state rendering is, in [0, 1).
+	float GetAlpha() const
+	{
+		return static_cast<float>(accumulator / step);
+	}
+
+	// Time of the latest simulated state.
+	double GetTime() const
+	{
+		return step * double(step_count);
+	}
+
+	// Time rendering is at, between the previous and latest state.
+	double GetInterpolatedTime() const
+	{
+		return GetTime() - step + accumulator;
+	}
+
+	double step;
+	uint32_t max_steps;
+	uint64_t step_count = 0;
+	uint64_t dropped_steps = 0;
+
+private:
+
+	double accumulator = 0.0;
+};
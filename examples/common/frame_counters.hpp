@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts the bytes examples request from the command buffer's transient (per-frame) allocators.
+// Anything that shows up here every frame without changing is a candidate for static geometry.
+struct TransientAllocationCounters
+{
+	uint64_t vertex_bytes = 0;
+	uint64_t index_bytes = 0;
+	uint64_t constant_bytes = 0;
+	uint32_t allocations = 0;
+
+	uint64_t TotalBytes() const
+	{
+		return vertex_bytes + index_bytes + constant_bytes;
+	}
+
+	void Add(const TransientAllocationCounters& other)
+	{
+		vertex_bytes += other.vertex_bytes;
+		index_bytes += other.index_bytes;
+		constant_bytes += other.constant_bytes;
+		allocations += other.allocations;
+	}
+
+	void Reset()
+	{
+		*this = {};
+	}
+};
+
+// Accumulates per-frame counters and logs the average every report_interval frames.
+struct FrameCounters
+{
+	explicit FrameCounters(uint32_t report_interval_ = 300)
+		: report_interval(report_interval_)
+	{
+	}
+
+	// Call once at the end of every frame.
+	void EndFrame()
+	{
+		total.Add(frame);
+		last_frame = frame;
+		frame.Reset();
+
+		if (++frame_count == report_interval)
+		{
+			QM_LOG_INFO("Transient bytes per frame: %llu (vertex %llu, index %llu, constant %llu), allocations per frame: %u\n",
+				static_cast<unsigned long long>(total.TotalBytes() / frame_count),
+				static_cast<unsigned long long>(total.vertex_bytes / frame_count),
+				static_cast<unsigned long long>(total.index_bytes / frame_count),
+				static_cast<unsigned long long>(total.constant_bytes / frame_count),
+				total.allocations / frame_count);
+
+			total.Reset();
+			frame_count = 0;
+		}
+	}
+
+	TransientAllocationCounters frame;
+	TransientAllocationCounters last_frame;
+	TransientAllocationCounters total;
+	uint32_t frame_count = 0;
+	uint32_t report_interval;
+};
+
+// Counted wrappers around the CommandBuffer transient allocators. Threads recording in parallel
+// should count into their own TransientAllocationCounters and Add() them to FrameCounters::frame.
+
+static inline void* AllocateVertexData(Vulkan::CommandBuffer& cmd, TransientAllocationCounters& counters, uint32_t binding, VkDeviceSize size)
+{
+	counters.vertex_bytes += size;
+	counters.allocations++;
+	return cmd.AllocateVertexData(binding, size);
+}
+
+static inline void* AllocateIndexData(Vulkan::CommandBuffer& cmd, TransientAllocationCounters& counters, VkDeviceSize size, VkIndexType index_type)
+{
+	counters.index_bytes += size;
+	counters.allocations++;
+	return cmd.AllocateIndexData(size, index_type);
+}
+
+static inline void* AllocateConstantData(Vulkan::CommandBuffer& cmd, TransientAllocationCounters& counters, uint32_t set, uint32_t binding, uint32_t array_index, VkDeviceSize size)
+{
+	counters.constant_bytes += size;
+	counters.allocations++;
+	return cmd.AllocateConstantData(set, binding, array_index, size);
+}
+
+static inline void* AllocateVertexData(Vulkan::CommandBuffer& cmd, FrameCounters& counters, uint32_t binding, VkDeviceSize size)
+{
+	return AllocateVertexData(cmd, counters.frame, binding, size);
+}
+
+static inline void* AllocateIndexData(Vulkan::CommandBuffer& cmd, FrameCounters& counters, VkDeviceSize size, VkIndexType index_type)
+{
+	return AllocateIndexData(cmd, counters.frame, size, index_type);
+}
+
+static inline void* AllocateConstantData(Vulkan::CommandBuffer& cmd, FrameCounters& counters, uint32_t set, uint32_t binding, uint32_t array_index, VkDeviceSize size)
+{
+	return AllocateConstantData(cmd, counters.frame, set, binding, array_index, size);
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+struct FramePacingSettings
+{
+	// Frame contexts of the device, how many frames the CPU may record ahead of the GPU.
+	uint32_t frames_in_flight = 2;
+
+	// Before sampling input, wait until at most max_queued_frames submitted frames are still
+	// running on the GPU, so input is as fresh as possible when the frame is drawn. 0 waits for
+	// the GPU to go idle.
+	bool wait_for_gpu = false;
+	uint32_t max_queued_frames = 1;
+
+	Vulkan::PresentMode present_mode = Vulkan::PresentMode::SyncToVBlank;
+
+	// Log every frame's timings, not only the periodic averages.
+	bool log_every_frame = false;
+};
+
+static inline const char* GetPresentModeName(Vulkan::PresentMode mode)
+{
+	switch (mode)
+	{
+	case Vulkan::PresentMode::UnlockedMaybeTear:
+		return "relaxed";
+	case Vulkan::PresentMode::UnlockedForceTearing:
+		return "immediate";
+	case Vulkan::PresentMode::UnlockedNoTearing:
+		return "mailbox";
+	default:
+		return "fifo";
+	}
+}
+
+// Consumes argv[i] and its values if it is one of the pacing options, shared by the examples:
+// --frames-in-flight n, --wait-gpu [max queued frames], --present-mode fifo|relaxed|immediate|mailbox
+// and --log-latency.
+static inline bool ParseFramePacingArgument(int argc, char** argv, int& i, FramePacingSettings& settings)
+{
+	if (std::strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+	{
+		settings.frames_in_flight = static_cast<uint32_t>(std::clamp(std::atoi(argv[++i]), 1, 4));
+	}
+	else if (std::strcmp(argv[i], "--wait-gpu") == 0)
+	{
+		settings.wait_for_gpu = true;
+		if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9')
+			settings.max_queued_frames = static_cast<uint32_t>(std::clamp(std::atoi(argv[++i]), 0, 4));
+	}
+	else if (std::strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc)
+	{
+		const char* name = argv[++i];
+		if (std::strcmp(name, "relaxed") == 0)
+			settings.present_mode = Vulkan::PresentMode::UnlockedMaybeTear;
+		else if (std::strcmp(name, "immediate") == 0)
+			settings.present_mode = Vulkan::PresentMode::UnlockedForceTearing;
+		else if (std::strcmp(name, "mailbox") == 0)
+			settings.present_mode = Vulkan::PresentMode::UnlockedNoTearing;
+		else
+			settings.present_mode = Vulkan::PresentMode::SyncToVBlank;
+	}
+	else if (std::strcmp(argv[i], "--log-latency") == 0)
+	{
+		settings.log_every_frame = true;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+// Controls how far the CPU runs ahead of the GPU and measures the latency that results. Each frame
+// calls BeginFrame() before sampling input, MarkInputSampled() once it has, Submit() for the
+// frame's command buffer instead of Device::Submit(), and EndFrame() after WSI::EndFrame().
+//
+// Latency is from input sampling to the GPU finishing the frame's commands, as seen by the CPU:
+// either when it waits for the frame, or when a later BeginFrame() finds its fence signalled, so
+// without --wait-gpu it can be late by up to a frame. Display latency comes on top.
+struct FramePacer
+{
+	// Call after WSI::Init(), before the first frame.
+	void Init(Vulkan::WSI& wsi, const FramePacingSettings& settings_, uint32_t report_interval_ = 300)
+	{
+		settings = settings_;
+		report_interval = report_interval_;
+		device = &wsi.GetDevice();
+
+		wsi.SetPresentMode(settings.present_mode);
+		device->InitFrameContexts(settings.frames_in_flight);
+
+		// Frames older than every one the device or the wait can leave running are complete.
+		frames.resize(std::max(settings.frames_in_flight, settings.max_queued_frames + 1) + 2);
+
+		QM_LOG_INFO("Frame pacing: %u frames in flight, %s present mode, %s\n", settings.frames_in_flight, GetPresentModeName(settings.present_mode),
+			settings.wait_for_gpu ? (settings.max_queued_frames == 0 ? "input sampled once the GPU is idle" : "input sampled with at most the set frames queued") : "no wait before input");
+	}
+
+	void BeginFrame()
+	{
+		Frame& frame = GetFrame(frame_index);
+
+		// The slot's last frame is old enough to be complete, its fence only needs collecting. Its
+		// timings are still in the slot, so this frame's begin is stamped after.
+		Clock::time_point begin = Now();
+		if (frame.fence)
+			Complete(frame_index - frames.size(), frame, true);
+		frame.begin = begin;
+
+		if (settings.wait_for_gpu && frame_index > settings.max_queued_frames)
+		{
+			uint64_t waited_index = frame_index - settings.max_queued_frames - 1;
+			Frame& waited = GetFrame(waited_index);
+			if (waited.fence)
+				Complete(waited_index, waited, true);
+		}
+
+		frame.wait_end = Now();
+
+		// Collect whatever else the GPU finished meanwhile.
+		for (uint64_t i = frame_index > frames.size() ? frame_index - frames.size() + 1 : 0; i < frame_index; i++)
+		{
+			Frame& previous = GetFrame(i);
+			if (previous.fence)
+				Complete(i, previous, false);
+		}
+	}
+
+	void MarkInputSampled()
+	{
+		GetFrame(frame_index).input = Now();
+	}
+
+	void Submit(Vulkan::CommandBufferHandle& cmd)
+	{
+		Frame& frame = GetFrame(frame_index);
+		device->Submit(cmd, &frame.fence);
+		frame.submit = Now();
+	}
+
+	void EndFrame()
+	{
+		Frame& frame = GetFrame(frame_index);
+		frame.end = Now();
+
+		interval.frames++;
+		interval.frame_ms += Milliseconds(frame.begin, frame.end);
+		interval.wait_ms += Milliseconds(frame.begin, frame.wait_end);
+		interval.present_ms += Milliseconds(frame.submit, frame.end);
+
+		frame_index++;
+
+		if (interval.frames == report_interval)
+		{
+			LogInterval(interval, "");
+			total.Add(interval);
+			interval = {};
+		}
+	}
+
+	void LogStats()
+	{
+		total.Add(interval);
+		interval = {};
+		if (total.frames != 0)
+			LogInterval(total, " over the run");
+	}
+
+private:
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Frame
+	{
+		Vulkan::Fence fence;
+		Clock::time_point begin;
+		Clock::time_point wait_end;
+		Clock::time_point input;
+		Clock::time_point submit;
+		Clock::time_point end;
+	};
+
+	struct Stats
+	{
+		uint64_t frames = 0;
+		uint64_t completed = 0;
+		double frame_ms = 0.0;
+		double wait_ms = 0.0;
+		double present_ms = 0.0;
+		double latency_ms = 0.0;
+		double max_latency_ms = 0.0;
+
+		void Add(const Stats& other)
+		{
+			frames += other.frames;
+			completed += other.completed;
+			frame_ms += other.frame_ms;
+			wait_ms += other.wait_ms;
+			present_ms += other.present_ms;
+			latency_ms += other.latency_ms;
+			max_latency_ms = std::max(max_latency_ms, other.max_latency_ms);
+		}
+	};
+
+	static Clock::time_point Now()
+	{
+		return Clock::now();
+	}
+
+	static double Milliseconds(Clock::time_point begin, Clock::time_point end)
+	{
+		return std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
+	Frame& GetFrame(uint64_t index)
+	{
+		return frames[index % frames.size()];
+	}
+
+	// Records the frame's latency once its fence has signalled, waiting for it if wait is set.
+	void Complete(uint64_t index, Frame& frame, bool wait)
+	{
+		if (wait)
+			frame.fence->Wait();
+		else if (!frame.fence->WaitTimeout(0))
+			return;
+
+		frame.fence.Reset();
+
+		double latency_ms = Milliseconds(frame.input, Now());
+		interval.completed++;
+		interval.latency_ms += latency_ms;
+		interval.max_latency_ms = std::max(interval.max_latency_ms, latency_ms);
+
+		if (settings.log_every_frame)
+		{
+			QM_LOG_INFO("Frame %llu: %.2f ms input to GPU done, %.2f ms frame, %.2f ms waiting for the GPU, %.2f ms submit to present\n",
+				static_cast<unsigned long long>(index), latency_ms, Milliseconds(frame.begin, frame.end), Milliseconds(frame.begin, frame.wait_end),
+				Milliseconds(frame.submit, frame.end));
+		}
+	}
+
+	void LogInterval(const Stats& stats, const char* suffix)
+	{
+		QM_LOG_INFO("Frame pacing%s: %.2f ms per frame, %.2f ms waiting for the GPU, %.2f ms submit to present, input to GPU done %.2f ms (max %.2f ms)\n", suffix,
+			stats.frame_ms / stats.frames, stats.wait_ms / stats.frames, stats.present_ms / stats.frames,
+			stats.completed ? stats.latency_ms / stats.completed : 0.0, stats.max_latency_ms);
+	}
+
+	Vulkan::Device* device = nullptr;
+	FramePacingSettings settings;
+	uint32_t report_interval = 300;
+	std::vector<Frame> frames;
+	uint64_t frame_index = 0;
+	Stats interval;
+	Stats total;
+};
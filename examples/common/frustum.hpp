@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// View frustum as six planes (left, right, bottom, top, near, far). Each plane is stored as
+// (normal, distance) with the normal pointing inwards, so a point p is inside when
+// dot(plane.xyz, p) + plane.w >= 0 for all planes.
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Extracts the planes of view_proj = proj * view (Gribb/Hartmann). The examples build their
+// projection with glm::perspective, which maps depth to [-1, 1]; culling against that near
+// plane is conservative under Vulkan's [0, 1] clip space.
+static inline Frustum ExtractFrustum(const glm::mat4& view_proj)
+{
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[3] + rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	return frustum;
+}
+
+static inline bool SphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius)
+{
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+	}
+
+	return true;
+}
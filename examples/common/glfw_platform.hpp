@@ -1,15 +1,24 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+
+#include "input_queue.hpp"
+
 static void fb_size_cb(GLFWwindow* window, int width, int height);
+static void cursor_pos_cb(GLFWwindow* window, double x, double y);
+static void mouse_button_cb(GLFWwindow* window, int button, int action, int);
 
 struct GLFWPlatform : public Vulkan::WSIPlatform
 {
 
-	GLFWPlatform()
+	// A hidden window still gets a swapchain, for runs that render without being watched.
+	explicit GLFWPlatform(bool visible = true)
 	{
 		width = 1280;
 		height = 720;
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 		window = glfwCreateWindow(width, height, "GLFW Window", nullptr, nullptr);
 
 		glfwSetWindowUserPointer(window, this);
@@ -59,14 +68,69 @@ struct GLFWPlatform : public Vulkan::WSIPlatform
 
 	virtual void PollInput()
 	{
-		glfwPollEvents();
+		if (!external_event_loop)
+			PumpEvents(false);
+
+		// Resizes are applied on the thread running the WSI, whichever thread received them, and
+		// only once the size has held for resize_debounce seconds. Dragging a window edge reports
+		// a new size every few milliseconds; until it settles the old swapchain keeps presenting,
+		// rather than the swapchain and everything sized to it being recreated for each one.
+		if (pending_size.load(std::memory_order_relaxed) == 0 || glfwGetTime() - last_resize_time.load() < resize_debounce)
+			return;
+
+		uint64_t size = pending_size.exchange(0);
+		if (size != 0)
+		{
+			resize = true;
+			width = static_cast<uint32_t>(size >> 32) & 0x7fffffffu;
+			height = static_cast<uint32_t>(size);
+		}
 	}
 
+	// Called from the window's event callbacks.
 	void NotifyResize(int width_, int height_)
 	{
-		resize = true;
-		width = static_cast<uint32_t>(width_);
-		height = static_cast<uint32_t>(height_);
+		last_resize_time = glfwGetTime();
+		pending_size = (uint64_t(1) << 63) | (uint64_t(width_) << 32) | uint32_t(height_);
+	}
+
+	// How long a new window size must hold before the swapchain follows it, in seconds.
+	void SetResizeDebounce(double seconds)
+	{
+		resize_debounce = seconds;
+	}
+
+	// Handles window events, first waiting for one if wait is set. Must be called on the thread
+	// that created the window.
+	void PumpEvents(bool wait)
+	{
+		if (wait)
+			glfwWaitEvents();
+		else
+			glfwPollEvents();
+
+		if (input_queue)
+			input_queue->Flush();
+	}
+
+	// Queues cursor and mouse button events from then on, for another thread to consume.
+	void SetInputQueue(InputQueue* queue)
+	{
+		input_queue = queue;
+		glfwSetCursorPosCallback(window, queue ? cursor_pos_cb : nullptr);
+		glfwSetMouseButtonCallback(window, queue ? mouse_button_cb : nullptr);
+	}
+
+	InputQueue* GetInputQueue()
+	{
+		return input_queue;
+	}
+
+	// With an external event loop, another thread pumps events, see RunRenderThread(), and
+	// PollInput() only picks up what it received.
+	void SetExternalEventLoop(bool external)
+	{
+		external_event_loop = external;
 	}
 
 	GLFWwindow* GetNativeWindow()
@@ -80,6 +144,13 @@ private:
 	unsigned width = 0;
 	unsigned height = 0;
 
+	// Size of the last resize not yet applied, with the top bit set.
+	std::atomic<uint64_t> pending_size{ 0 };
+	std::atomic<double> last_resize_time{ 0.0 };
+	double resize_debounce = 0.1;
+	bool external_event_loop = false;
+	InputQueue* input_queue = nullptr;
+
 };
 
 static void fb_size_cb(GLFWwindow* window, int width, int height)
@@ -87,3 +158,16 @@ static void fb_size_cb(GLFWwindow* window, int width, int height)
 	auto* glfw = static_cast<GLFWPlatform*>(glfwGetWindowUserPointer(window));
 	glfw->NotifyResize(width, height);
 }
+
+static void cursor_pos_cb(GLFWwindow* window, double x, double y)
+{
+	auto* glfw = static_cast<GLFWPlatform*>(glfwGetWindowUserPointer(window));
+	glfw->GetInputQueue()->PushCursor(x, y, glfwGetTime());
+}
+
+static void mouse_button_cb(GLFWwindow* window, int button, int action, int)
+{
+	auto* glfw = static_cast<GLFWPlatform*>(glfwGetWindowUserPointer(window));
+	if (action == GLFW_PRESS || action == GLFW_RELEASE)
+		glfw->GetInputQueue()->PushButton(button, action == GLFW_PRESS, glfwGetTime());
+}
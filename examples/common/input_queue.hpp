@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "spsc_ring.hpp"
+
+enum class InputEventType : uint32_t
+{
+	CursorMove,
+	ButtonPress,
+	ButtonRelease
+};
+
+struct InputEvent
+{
+	InputEventType type = InputEventType::CursorMove;
+	// GLFW_MOUSE_BUTTON_* of button events.
+	int button = 0;
+	// Cursor position in window coordinates, at the time of the event.
+	double x = 0.0;
+	double y = 0.0;
+	// glfwGetTime() when the event was received.
+	double time = 0.0;
+};
+
+// Window events on their way from the thread handling them to the one rendering. Cursor motion is
+// coalesced, only the last position of each batch of events is queued, while button events are
+// kept in order with the motion around them, so the consumer knows exactly which motion happened
+// with a button held. Events that do not fit in the ring wait on the producer side, in order, until
+// they do. Only if that backlog overflows are events dropped, and never a button release that is
+// still needed, so a drag cannot get stuck.
+struct InputQueue
+{
+	// Producer side, the thread handling window events.
+	void PushCursor(double x, double y, double time)
+	{
+		if (has_pending_cursor)
+			coalesced_events++;
+
+		pending_cursor.x = x;
+		pending_cursor.y = y;
+		pending_cursor.time = time;
+		has_pending_cursor = true;
+	}
+
+	void PushButton(int button, bool pressed, double time)
+	{
+		// The motion before the button goes first.
+		if (has_pending_cursor)
+		{
+			Stage(pending_cursor);
+			has_pending_cursor = false;
+		}
+
+		InputEvent event;
+		event.type = pressed ? InputEventType::ButtonPress : InputEventType::ButtonRelease;
+		event.button = button;
+		event.x = cursor_x;
+		event.y = cursor_y;
+		event.time = time;
+		Stage(event);
+
+		FlushBacklog();
+	}
+
+	// Call after each batch of events. Events that do not fit are kept for the next, in order.
+	void Flush()
+	{
+		FlushBacklog();
+
+		if (has_pending_cursor && backlog_count == 0 && ring.Push(pending_cursor))
+		{
+			cursor_x = pending_cursor.x;
+			cursor_y = pending_cursor.y;
+			has_pending_cursor = false;
+		}
+	}
+
+	// Consumer side, the rendering thread. now is glfwGetTime(), to track how long events waited.
+	bool Pop(InputEvent& event, double now)
+	{
+		if (!ring.Pop(event))
+			return false;
+
+		double age = std::max(now - event.time, 0.0);
+		consumed_events++;
+		total_age += age;
+		max_age = std::max(max_age, age);
+		return true;
+	}
+
+	// Call once both threads are done with the queue.
+	void LogStats() const
+	{
+		if (consumed_events == 0)
+			return;
+
+		QM_LOG_INFO("Input queue: %llu events consumed, %llu cursor moves coalesced, %llu dropped, waited %.2f ms on average (max %.2f ms)\n",
+			static_cast<unsigned long long>(consumed_events), static_cast<unsigned long long>(coalesced_events), static_cast<unsigned long long>(dropped_events),
+			total_age / consumed_events * 1000.0, max_age * 1000.0);
+	}
+
+private:
+
+	// Adds an event behind the ones waiting for space in the ring. A full backlog drops its oldest
+	// event the consumer can do without: anything but a button release, or a release followed by
+	// another of the same button. With more slots than buttons, there always is one.
+	void Stage(const InputEvent& event)
+	{
+		if (event.type == InputEventType::CursorMove)
+		{
+			cursor_x = event.x;
+			cursor_y = event.y;
+		}
+
+		if (backlog_count == max_backlog)
+		{
+			uint32_t victim = 0;
+			while (victim < backlog_count && !IsDroppable(victim))
+				victim++;
+
+			dropped_events++;
+			if (victim == backlog_count)
+				return;
+
+			std::copy(backlog + victim + 1, backlog + backlog_count, backlog + victim);
+			backlog_count--;
+		}
+
+		backlog[backlog_count++] = event;
+	}
+
+	bool IsDroppable(uint32_t index) const
+	{
+		if (backlog[index].type != InputEventType::ButtonRelease)
+			return true;
+
+		for (uint32_t i = index + 1; i < backlog_count; i++)
+		{
+			if (backlog[i].type == InputEventType::ButtonRelease && backlog[i].button == backlog[index].button)
+				return true;
+		}
+		return false;
+	}
+
+	void FlushBacklog()
+	{
+		uint32_t pushed = 0;
+		while (pushed < backlog_count && ring.Push(backlog[pushed]))
+			pushed++;
+
+		std::copy(backlog + pushed, backlog + backlog_count, backlog);
+		backlog_count -= pushed;
+	}
+
+	SpscRing<InputEvent, 256> ring;
+
+	// Producer state. The pending cursor position is always newer than the backlog.
+	static constexpr uint32_t max_backlog = 64;
+	InputEvent backlog[max_backlog];
+	uint32_t backlog_count = 0;
+	InputEvent pending_cursor;
+	bool has_pending_cursor = false;
+	double cursor_x = 0.0;
+	double cursor_y = 0.0;
+	uint64_t coalesced_events = 0;
+	uint64_t dropped_events = 0;
+
+	// Consumer state.
+	uint64_t consumed_events = 0;
+	double total_age = 0.0;
+	double max_age = 0.0;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+// Runs render on a thread of its own, while the calling thread handles window system events for
+// as long as it runs. GLFW only delivers events on the thread that created the window, so this
+// is the way to have input callbacks run as soon as the OS delivers each event, rather than once
+// a frame in PollInput(). The render thread's PollInput() then only applies what the input
+// thread received, see GLFWPlatform.
+template<typename Render>
+static inline void RunRenderThread(GLFWPlatform& platform, Render&& render)
+{
+	std::atomic<bool> rendering{ true };
+	platform.SetExternalEventLoop(true);
+
+	std::thread render_thread([&]() {
+		render();
+		rendering = false;
+		glfwPostEmptyEvent();
+	});
+
+	// Sleeps until an event arrives. The empty event wakes it once rendering ends.
+	while (rendering)
+		platform.PumpEvents(true);
+
+	render_thread.join();
+	platform.SetExternalEventLoop(false);
+}
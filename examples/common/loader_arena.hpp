@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+// Memory resource counting what passes through it to another resource.
+struct CountingResource : std::pmr::memory_resource
+{
+	explicit CountingResource(std::pmr::memory_resource* upstream_ = std::pmr::new_delete_resource())
+		: upstream(upstream_)
+	{
+	}
+
+	uint64_t allocations = 0;
+	uint64_t bytes = 0;
+
+private:
+
+	void* do_allocate(size_t size, size_t alignment) override
+	{
+		allocations++;
+		bytes += size;
+		return upstream->allocate(size, alignment);
+	}
+
+	void do_deallocate(void* pointer, size_t size, size_t alignment) override
+	{
+		upstream->deallocate(pointer, size, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+
+	std::pmr::memory_resource* upstream;
+};
+
+// Linear allocator for the temporaries of a load: every allocation is carved out of a few large
+// blocks, deallocation does nothing, and the blocks are freed together when the arena is released
+// or destroyed. Hand Get() to loaders taking a std::pmr::memory_resource, and keep the arena alive
+// until their results have been uploaded or copied out.
+//
+// Not thread safe; give each loading thread its own arena.
+struct LoaderArena
+{
+	// Blocks start at initial_size and grow geometrically.
+	explicit LoaderArena(size_t initial_size = 1024 * 1024)
+		: blocks(std::pmr::new_delete_resource()), arena(initial_size, &blocks), requests(&arena)
+	{
+	}
+
+	LoaderArena(const LoaderArena&) = delete;
+	LoaderArena& operator=(const LoaderArena&) = delete;
+
+	std::pmr::memory_resource* Get()
+	{
+		return &requests;
+	}
+
+	// Frees every block. Anything allocated from Get() must be gone.
+	void Release()
+	{
+		arena.release();
+	}
+
+	// Allocations served from the arena, and their bytes.
+	uint64_t GetAllocationCount() const
+	{
+		return requests.allocations;
+	}
+
+	uint64_t GetAllocatedBytes() const
+	{
+		return requests.bytes;
+	}
+
+	// Blocks the arena took from the heap, and their bytes.
+	uint64_t GetBlockCount() const
+	{
+		return blocks.allocations;
+	}
+
+	uint64_t GetBlockBytes() const
+	{
+		return blocks.bytes;
+	}
+
+private:
+
+	CountingResource blocks;
+	std::pmr::monotonic_buffer_resource arena;
+	CountingResource requests;
+};
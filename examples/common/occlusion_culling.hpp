@@ -0,0 +1,566 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <vector>
+
+#include "simd_culling.hpp"
+#include "worker_pool.hpp"
+
+// Software occlusion culling. A few large, nearby occluders are rasterized depth-only into a small
+// CPU depth buffer, then object bounds are tested against a hierarchical (max depth per block)
+// version of it, falling back to single pixels only where a block is not conclusive.
+// Rasterization is binned into screen tiles: workers first transform and set up disjoint ranges
+// of triangles into their own bins, then each worker owns whole tiles, so no pixel is ever
+// written by two threads. Rows of 4 pixels are shaded at once with SSE.
+//
+// Depth is z/w remapped to [0, 1], smaller is nearer, and the buffer is cleared to 1.
+
+// Positions only triangle mesh. Occluders should be simplified versions of the drawn meshes that
+// stay inside them, otherwise they can hide geometry that is actually visible.
+struct OccluderMesh
+{
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+
+	uint32_t GetTriangleCount() const
+	{
+		return static_cast<uint32_t>(indices.size() / 3);
+	}
+};
+
+template<typename VertexType>
+static OccluderMesh CreateOccluderMesh(const std::vector<VertexType>& vertices, const std::vector<uint32_t>& indices)
+{
+	OccluderMesh mesh;
+	mesh.positions.reserve(vertices.size());
+	for (const VertexType& vertex : vertices)
+		mesh.positions.push_back(vertex.position);
+	mesh.indices = indices;
+	return mesh;
+}
+
+struct OccluderInstance
+{
+	const OccluderMesh* mesh;
+	glm::mat4 model;
+};
+
+struct OcclusionStats
+{
+	uint32_t occluders = 0;
+	uint32_t input_triangles = 0;
+	// Triangles that survived clipping and were binned, split in two if clipped by the near plane.
+	uint32_t rasterized_triangles = 0;
+	double render_ms = 0.0;
+};
+
+struct OcclusionBuffer
+{
+	static constexpr uint32_t tile_size = 32;
+	static constexpr uint32_t block_size = 8;
+
+	// Size is rounded up to whole tiles.
+	void Init(uint32_t width_, uint32_t height_)
+	{
+		tiles_x = (width_ + tile_size - 1) / tile_size;
+		tiles_y = (height_ + tile_size - 1) / tile_size;
+		width = tiles_x * tile_size;
+		height = tiles_y * tile_size;
+		blocks_x = width / block_size;
+		blocks_y = height / block_size;
+
+		depth.assign(width * height, 1.0f);
+		hiz.assign(blocks_x * blocks_y, 1.0f);
+	}
+
+	// Clears the buffer and renders the occluders with thread_count workers from pool, or on the
+	// calling thread without a pool.
+	void Render(const glm::mat4& view_proj_, const std::vector<OccluderInstance>& occluders, WorkerPool* pool, uint32_t thread_count)
+	{
+		Util::Timer timer;
+		timer.start();
+
+		view_proj = view_proj_;
+		thread_count = pool ? std::max(1u, std::min(thread_count, pool->GetThreadCount())) : 1;
+
+		triangle_offsets.resize(occluders.size() + 1);
+		triangle_offsets[0] = 0;
+		for (size_t i = 0; i < occluders.size(); i++)
+			triangle_offsets[i + 1] = triangle_offsets[i] + occluders[i].mesh->GetTriangleCount();
+
+		uint32_t total_triangles = triangle_offsets.back();
+
+		bins.resize(thread_count);
+		for (ThreadBins& thread_bins : bins)
+		{
+			thread_bins.triangles.clear();
+			thread_bins.tiles.resize(tiles_x * tiles_y);
+			for (std::vector<uint32_t>& tile : thread_bins.tiles)
+				tile.clear();
+		}
+
+		auto run = [&](WorkerJob job) {
+			if (pool && thread_count > 1)
+				pool->Run(thread_count, job);
+			else
+				job(0);
+		};
+
+		run([&](uint32_t worker) {
+			uint32_t begin = static_cast<uint32_t>(uint64_t(total_triangles) * worker / thread_count);
+			uint32_t end = static_cast<uint32_t>(uint64_t(total_triangles) * (worker + 1) / thread_count);
+			SetupTriangles(occluders, begin, end, bins[worker]);
+		});
+
+		run([&](uint32_t worker) {
+			for (uint32_t tile = worker; tile < tiles_x * tiles_y; tile += thread_count)
+				RasterizeTile(tile);
+		});
+
+		stats.occluders = static_cast<uint32_t>(occluders.size());
+		stats.input_triangles = total_triangles;
+		stats.rasterized_triangles = 0;
+		for (const ThreadBins& thread_bins : bins)
+			stats.rasterized_triangles += static_cast<uint32_t>(thread_bins.triangles.size());
+		stats.render_ms = timer.end() * 1000.0;
+	}
+
+	// Pixels a box covers on screen, clamped to the buffer, and its nearest depth.
+	struct ScreenBounds
+	{
+		uint32_t min_x, min_y, max_x, max_y;
+		float nearest;
+	};
+
+	// False if the box crosses the near plane or is entirely off screen, neither of which occlusion
+	// culling decides.
+	bool ProjectBounds(const glm::vec3& bounds_min, const glm::vec3& bounds_max, ScreenBounds& bounds) const
+	{
+		float rect_min_x = FLT_MAX, rect_min_y = FLT_MAX;
+		float rect_max_x = -FLT_MAX, rect_max_y = -FLT_MAX;
+		float nearest = FLT_MAX;
+
+		for (uint32_t corner = 0; corner < 8; corner++)
+		{
+			glm::vec4 position((corner & 1) ? bounds_max.x : bounds_min.x, (corner & 2) ? bounds_max.y : bounds_min.y, (corner & 4) ? bounds_max.z : bounds_min.z, 1.0f);
+			glm::vec4 clip = view_proj * position;
+
+			if (clip.z < -clip.w)
+				return false;
+
+			glm::vec3 screen = ToScreen(clip);
+			rect_min_x = std::min(rect_min_x, screen.x);
+			rect_min_y = std::min(rect_min_y, screen.y);
+			rect_max_x = std::max(rect_max_x, screen.x);
+			rect_max_y = std::max(rect_max_y, screen.y);
+			nearest = std::min(nearest, screen.z);
+		}
+
+		if (rect_max_x < 0.0f || rect_max_y < 0.0f || rect_min_x >= float(width) || rect_min_y >= float(height))
+			return false;
+
+		bounds.min_x = static_cast<uint32_t>(std::max(rect_min_x, 0.0f));
+		bounds.min_y = static_cast<uint32_t>(std::max(rect_min_y, 0.0f));
+		bounds.max_x = static_cast<uint32_t>(std::min(rect_max_x, float(width - 1)));
+		bounds.max_y = static_cast<uint32_t>(std::min(rect_max_y, float(height - 1)));
+		bounds.nearest = nearest;
+		return true;
+	}
+
+	// False only if the box is entirely hidden behind the last rendered occluders. Boxes crossing
+	// the near plane or outside the screen are left to frustum culling and reported visible.
+	bool IsVisible(const glm::vec3& bounds_min, const glm::vec3& bounds_max) const
+	{
+		ScreenBounds bounds;
+		if (!ProjectBounds(bounds_min, bounds_max, bounds))
+			return true;
+
+		for (uint32_t by = bounds.min_y / block_size; by <= bounds.max_y / block_size; by++)
+		{
+			for (uint32_t bx = bounds.min_x / block_size; bx <= bounds.max_x / block_size; bx++)
+			{
+				// Most blocks are resolved by their farthest depth, only blocks that are partly
+				// farther than the box are checked per pixel.
+				if (bounds.nearest > hiz[by * blocks_x + bx])
+					continue;
+
+				uint32_t x0 = std::max(bounds.min_x, bx * block_size);
+				uint32_t x1 = std::min(bounds.max_x, bx * block_size + block_size - 1);
+				uint32_t y0 = std::max(bounds.min_y, by * block_size);
+				uint32_t y1 = std::min(bounds.max_y, by * block_size + block_size - 1);
+
+				for (uint32_t y = y0; y <= y1; y++)
+				{
+					for (uint32_t x = x0; x <= x1; x++)
+					{
+						if (bounds.nearest <= depth[y * width + x])
+							return true;
+					}
+				}
+			}
+		}
+
+		return false;
+	}
+
+	// Brute-force reference of Render() for checking it: every occluder triangle is clipped and
+	// tested at each pixel center of its screen bounds, without binning, tiles or SIMD. Pixels
+	// within edge_tolerance pixels of a triangle's edge count as covered, so the reference covers
+	// at least what Render() does. Uses the buffer's size and the last Render()'s view_proj.
+	void RenderReference(const std::vector<OccluderInstance>& occluders, std::vector<float>& reference, float edge_tolerance = 1e-3f) const
+	{
+		reference.assign(width * height, 1.0f);
+
+		for (const OccluderInstance& occluder : occluders)
+		{
+			glm::mat4 mvp = view_proj * occluder.model;
+			const OccluderMesh& mesh = *occluder.mesh;
+
+			for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+			{
+				glm::vec4 clip[3];
+				for (int v = 0; v < 3; v++)
+					clip[v] = mvp * glm::vec4(mesh.positions[mesh.indices[i + v]], 1.0f);
+
+				// Same near plane clip as SetupTriangle(), projecting behind the eye is meaningless.
+				glm::vec4 polygon[4];
+				uint32_t count = 0;
+				for (int v = 0; v < 3; v++)
+				{
+					const glm::vec4& a = clip[v];
+					const glm::vec4& b = clip[(v + 1) % 3];
+					float distance_a = a.z + a.w;
+					float distance_b = b.z + b.w;
+
+					if (distance_a >= 0.0f)
+						polygon[count++] = a;
+					if ((distance_a >= 0.0f) != (distance_b >= 0.0f))
+						polygon[count++] = a + (b - a) * (distance_a / (distance_a - distance_b));
+				}
+
+				for (uint32_t fan = 1; fan + 1 < count; fan++)
+					RasterizeReference(ToScreen(polygon[0]), ToScreen(polygon[fan]), ToScreen(polygon[fan + 1]), reference, edge_tolerance);
+			}
+		}
+	}
+
+	// Writes the depth buffer, or the hierarchical buffer, as an 8 bit binary PGM. Depth is
+	// normalized over the covered range with near in white; uncovered pixels are black.
+	bool WriteDepthDump(const char* path, bool hierarchical) const
+	{
+		const std::vector<float>& values = hierarchical ? hiz : depth;
+		uint32_t dump_width = hierarchical ? blocks_x : width;
+		uint32_t dump_height = hierarchical ? blocks_y : height;
+
+		float covered_min = 1.0f, covered_max = 0.0f;
+		for (float value : values)
+		{
+			if (value < 1.0f)
+			{
+				covered_min = std::min(covered_min, value);
+				covered_max = std::max(covered_max, value);
+			}
+		}
+
+		float scale = covered_max > covered_min ? 1.0f / (covered_max - covered_min) : 0.0f;
+
+		std::vector<unsigned char> pixels(values.size());
+		for (size_t i = 0; i < values.size(); i++)
+			pixels[i] = values[i] < 1.0f ? static_cast<unsigned char>(255.0f - 223.0f * (values[i] - covered_min) * scale) : 0;
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		file << "P5\n" << dump_width << ' ' << dump_height << "\n255\n";
+		file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+
+		return bool(file);
+	}
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t blocks_x = 0;
+	uint32_t blocks_y = 0;
+	std::vector<float> depth;
+	// Farthest depth of each block_size x block_size block.
+	std::vector<float> hiz;
+	OcclusionStats stats;
+
+private:
+
+	// Edge functions are a * x + b * y + c, non-negative inside. Depth is z0 + zx * x + zy * y.
+	struct Triangle
+	{
+		float edge_a[3];
+		float edge_b[3];
+		float edge_c[3];
+		float z0, zx, zy;
+		int32_t min_x, min_y, max_x, max_y;
+	};
+
+	struct ThreadBins
+	{
+		std::vector<Triangle> triangles;
+		// Per tile, indices into triangles.
+		std::vector<std::vector<uint32_t>> tiles;
+	};
+
+	void RasterizeReference(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, std::vector<float>& reference, float edge_tolerance) const
+	{
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (std::fabs(area) < 1e-6f)
+			return;
+
+		int32_t min_x = std::max(0, static_cast<int32_t>(std::floor(std::min({ v0.x, v1.x, v2.x }) - 1.0f)));
+		int32_t min_y = std::max(0, static_cast<int32_t>(std::floor(std::min({ v0.y, v1.y, v2.y }) - 1.0f)));
+		int32_t max_x = std::min(int32_t(width) - 1, static_cast<int32_t>(std::ceil(std::max({ v0.x, v1.x, v2.x }) + 1.0f)));
+		int32_t max_y = std::min(int32_t(height) - 1, static_cast<int32_t>(std::ceil(std::max({ v0.y, v1.y, v2.y }) + 1.0f)));
+
+		const glm::vec3* v[3] = { &v0, &v1, &v2 };
+
+		for (int32_t y = min_y; y <= max_y; y++)
+		{
+			for (int32_t x = min_x; x <= max_x; x++)
+			{
+				glm::vec2 p(float(x) + 0.5f, float(y) + 0.5f);
+
+				// Barycentric weights, with the winding folded in so both windings come out positive.
+				float weights[3];
+				bool inside = true;
+				for (int i = 0; i < 3; i++)
+				{
+					const glm::vec3& a = *v[(i + 1) % 3];
+					const glm::vec3& b = *v[(i + 2) % 3];
+					float edge = ((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)) / area;
+					float edge_length = glm::length(glm::vec2(b.x - a.x, b.y - a.y));
+					inside &= edge * std::fabs(area) / edge_length >= -edge_tolerance;
+					weights[i] = edge;
+				}
+
+				if (inside)
+				{
+					float z = weights[0] * v0.z + weights[1] * v1.z + weights[2] * v2.z;
+					float& pixel = reference[y * width + x];
+					pixel = std::min(pixel, z);
+				}
+			}
+		}
+	}
+
+	glm::vec3 ToScreen(const glm::vec4& clip) const
+	{
+		float inv_w = 1.0f / clip.w;
+		return glm::vec3((clip.x * inv_w * 0.5f + 0.5f) * float(width), (0.5f - clip.y * inv_w * 0.5f) * float(height), clip.z * inv_w * 0.5f + 0.5f);
+	}
+
+	void SetupTriangles(const std::vector<OccluderInstance>& occluders, uint32_t begin, uint32_t end, ThreadBins& out) const
+	{
+		if (begin == end)
+			return;
+
+		size_t instance = std::upper_bound(triangle_offsets.begin(), triangle_offsets.end(), begin) - triangle_offsets.begin() - 1;
+		glm::mat4 mvp;
+		uint32_t mvp_instance = ~0u;
+
+		for (uint32_t triangle = begin; triangle < end; triangle++)
+		{
+			while (triangle >= triangle_offsets[instance + 1])
+				instance++;
+
+			const OccluderMesh& mesh = *occluders[instance].mesh;
+			if (mvp_instance != instance)
+			{
+				mvp = view_proj * occluders[instance].model;
+				mvp_instance = static_cast<uint32_t>(instance);
+			}
+
+			const uint32_t* indices = &mesh.indices[(triangle - triangle_offsets[instance]) * 3];
+			glm::vec4 clip[3];
+			for (int i = 0; i < 3; i++)
+				clip[i] = mvp * glm::vec4(mesh.positions[indices[i]], 1.0f);
+
+			SetupTriangle(clip, out);
+		}
+	}
+
+	void SetupTriangle(const glm::vec4 clip[3], ThreadBins& out) const
+	{
+		// Trivially outside one of the planes.
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w)
+				return;
+			if (axis < 2 && clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w && clip[2][axis] < -clip[2].w)
+				return;
+		}
+
+		// Clip against the near plane, z >= -w. One triangle becomes at most a quad.
+		glm::vec4 polygon[4];
+		uint32_t count = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec4& a = clip[i];
+			const glm::vec4& b = clip[(i + 1) % 3];
+			float distance_a = a.z + a.w;
+			float distance_b = b.z + b.w;
+
+			if (distance_a >= 0.0f)
+				polygon[count++] = a;
+			if ((distance_a >= 0.0f) != (distance_b >= 0.0f))
+				polygon[count++] = a + (b - a) * (distance_a / (distance_a - distance_b));
+		}
+
+		if (count < 3)
+			return;
+
+		glm::vec3 screen[4];
+		for (uint32_t i = 0; i < count; i++)
+			screen[i] = ToScreen(polygon[i]);
+
+		BinTriangle(screen[0], screen[1], screen[2], out);
+		if (count == 4)
+			BinTriangle(screen[0], screen[2], screen[3], out);
+	}
+
+	void BinTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, ThreadBins& out) const
+	{
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (std::fabs(area) < 1e-6f)
+			return;
+
+		// Both windings are rasterized, the viewer draws meshes without face culling.
+		if (area < 0.0f)
+		{
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		Triangle triangle;
+		triangle.min_x = std::max(0, static_cast<int32_t>(std::floor(std::min({ v0.x, v1.x, v2.x }))));
+		triangle.min_y = std::max(0, static_cast<int32_t>(std::floor(std::min({ v0.y, v1.y, v2.y }))));
+		triangle.max_x = std::min(int32_t(width) - 1, static_cast<int32_t>(std::ceil(std::max({ v0.x, v1.x, v2.x }))));
+		triangle.max_y = std::min(int32_t(height) - 1, static_cast<int32_t>(std::ceil(std::max({ v0.y, v1.y, v2.y }))));
+
+		if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y)
+			return;
+
+		const glm::vec3* v[3] = { &v0, &v1, &v2 };
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec3& a = *v[i];
+			const glm::vec3& b = *v[(i + 1) % 3];
+			triangle.edge_a[i] = a.y - b.y;
+			triangle.edge_b[i] = b.x - a.x;
+			triangle.edge_c[i] = -(triangle.edge_a[i] * a.x + triangle.edge_b[i] * a.y);
+		}
+
+		glm::vec3 d1 = v1 - v0;
+		glm::vec3 d2 = v2 - v0;
+		triangle.zx = (d1.z * d2.y - d2.z * d1.y) / area;
+		triangle.zy = (d2.z * d1.x - d1.z * d2.x) / area;
+		triangle.z0 = v0.z - triangle.zx * v0.x - triangle.zy * v0.y;
+
+		uint32_t index = static_cast<uint32_t>(out.triangles.size());
+		out.triangles.push_back(triangle);
+
+		for (uint32_t ty = uint32_t(triangle.min_y) / tile_size; ty <= uint32_t(triangle.max_y) / tile_size; ty++)
+		{
+			for (uint32_t tx = uint32_t(triangle.min_x) / tile_size; tx <= uint32_t(triangle.max_x) / tile_size; tx++)
+				out.tiles[ty * tiles_x + tx].push_back(index);
+		}
+	}
+
+	void RasterizeTile(uint32_t tile)
+	{
+		int32_t tile_x0 = int32_t(tile % tiles_x * tile_size);
+		int32_t tile_y0 = int32_t(tile / tiles_x * tile_size);
+		int32_t tile_x1 = tile_x0 + int32_t(tile_size) - 1;
+		int32_t tile_y1 = tile_y0 + int32_t(tile_size) - 1;
+
+		for (int32_t y = tile_y0; y <= tile_y1; y++)
+			std::fill_n(&depth[y * width + tile_x0], tile_size, 1.0f);
+
+		// Bins are walked in worker order, so the result doesn't depend on the thread count.
+		for (const ThreadBins& thread_bins : bins)
+		{
+			for (uint32_t index : thread_bins.tiles[tile])
+			{
+				const Triangle& triangle = thread_bins.triangles[index];
+
+				// Rows start on a multiple of 4 so every SSE group stays inside the tile.
+				int32_t x0 = std::max(triangle.min_x, tile_x0) & ~3;
+				int32_t x1 = std::min(triangle.max_x, tile_x1);
+				int32_t y0 = std::max(triangle.min_y, tile_y0);
+				int32_t y1 = std::min(triangle.max_y, tile_y1);
+
+				for (int32_t y = y0; y <= y1; y++)
+					RasterizeRow(triangle, x0, x1, y, &depth[y * width]);
+			}
+		}
+
+		for (uint32_t by = uint32_t(tile_y0) / block_size; by <= uint32_t(tile_y1) / block_size; by++)
+		{
+			for (uint32_t bx = uint32_t(tile_x0) / block_size; bx <= uint32_t(tile_x1) / block_size; bx++)
+			{
+				float farthest = 0.0f;
+				for (uint32_t y = by * block_size; y < (by + 1) * block_size; y++)
+				{
+					const float* row = &depth[y * width + bx * block_size];
+					for (uint32_t x = 0; x < block_size; x++)
+						farthest = std::max(farthest, row[x]);
+				}
+				hiz[by * blocks_x + bx] = farthest;
+			}
+		}
+	}
+
+	// Samples at pixel centers, keeps the nearest depth.
+	static void RasterizeRow(const Triangle& triangle, int32_t x0, int32_t x1, int32_t y, float* row)
+	{
+		float py = float(y) + 0.5f;
+		float row_c[3];
+		for (int i = 0; i < 3; i++)
+			row_c[i] = triangle.edge_b[i] * py + triangle.edge_c[i];
+		float row_z = triangle.zy * py + triangle.z0;
+
+#ifdef QM_EXAMPLES_CULLING_X86
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+		for (int32_t x = x0; x <= x1; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps(float(x)), lane_offsets);
+
+			__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.edge_a[0]), px), _mm_set1_ps(row_c[0])), zero);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.edge_a[1]), px), _mm_set1_ps(row_c[1])), zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.edge_a[2]), px), _mm_set1_ps(row_c[2])), zero));
+
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.zx), px), _mm_set1_ps(row_z));
+			__m128 current = _mm_loadu_ps(row + x);
+			__m128 nearest = _mm_min_ps(current, z);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+		}
+#else
+		for (int32_t x = x0; x <= x1; x++)
+		{
+			float px = float(x) + 0.5f;
+			bool inside = triangle.edge_a[0] * px + row_c[0] >= 0.0f && triangle.edge_a[1] * px + row_c[1] >= 0.0f && triangle.edge_a[2] * px + row_c[2] >= 0.0f;
+			if (inside)
+				row[x] = std::min(row[x], triangle.zx * px + row_z);
+		}
+#endif
+	}
+
+	uint32_t tiles_x = 0;
+	uint32_t tiles_y = 0;
+	glm::mat4 view_proj = glm::mat4(1.0f);
+	std::vector<uint32_t> triangle_offsets;
+	std::vector<ThreadBins> bins;
+};
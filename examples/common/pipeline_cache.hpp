@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Persists the device's VkPipelineCache between runs. The file name is keyed by the driver's
+// pipelineCacheUUID, so caches from another GPU or driver version are never fed to the device.
+
+static std::string GetPipelineCachePath(Vulkan::Device& device)
+{
+	const VkPhysicalDeviceProperties& props = device.GetGPUProperties();
+
+	std::string path = "pipeline_cache_";
+	char hex[3];
+	for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+	{
+		std::snprintf(hex, sizeof(hex), "%02x", props.pipelineCacheUUID[i]);
+		path += hex;
+	}
+	path += ".bin";
+
+	return path;
+}
+
+// Validates the VkPipelineCacheHeaderVersionOne at the start of the blob against the current device.
+static bool IsPipelineCacheCompatible(Vulkan::Device& device, const std::vector<uint8_t>& data)
+{
+	const size_t header_size = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+	if (data.size() < header_size)
+		return false;
+
+	uint32_t header[4];
+	std::memcpy(header, data.data(), sizeof(header));
+
+	const VkPhysicalDeviceProperties& props = device.GetGPUProperties();
+
+	return header[0] >= header_size &&
+		header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header[2] == props.vendorID &&
+		header[3] == props.deviceID &&
+		std::memcmp(data.data() + sizeof(header), props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+// Call before creating any programs. Returns false if there was no usable cache.
+static bool LoadPipelineCache(Vulkan::Device& device)
+{
+	std::string path = GetPipelineCachePath(device);
+
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(data.data()), data.size());
+
+	if (!file || !IsPipelineCacheCompatible(device, data))
+	{
+		QM_LOG_INFO("Ignoring incompatible pipeline cache %s\n", path.c_str());
+		return false;
+	}
+
+	if (!device.InitPipelineCache(data.data(), data.size()))
+		return false;
+
+	QM_LOG_INFO("Loaded pipeline cache %s (%zu bytes)\n", path.c_str(), data.size());
+	return true;
+}
+
+// Call after the device is idle, before it is destroyed.
+static bool SavePipelineCache(Vulkan::Device& device)
+{
+	size_t size = device.GetPipelineCacheSize();
+	if (size == 0)
+		return false;
+
+	std::vector<uint8_t> data(size);
+	if (!device.GetPipelineCacheData(data.data(), data.size()))
+		return false;
+
+	std::string path = GetPipelineCachePath(device);
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	return bool(file);
+}
@@ -0,0 +1,431 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "shader_bindings.hpp"
+
+// Pipelines are compiled lazily the first time a draw uses a new combination of state, which stalls
+// the first frame. A PipelineStateDesc captures everything that goes into a pipeline (program,
+// render pass formats, vertex layout and raster state), and PipelineWarmup compiles a list of them
+// on worker threads before the main loop starts. Examples apply the same descriptors while
+// rendering, so the warmed pipelines are exactly the ones that get used.
+
+struct VertexAttribDesc
+{
+	uint32_t location;
+	uint32_t binding;
+	VkFormat format;
+	uint32_t offset;
+
+	bool operator==(const VertexAttribDesc& other) const
+	{
+		return location == other.location && binding == other.binding && format == other.format && offset == other.offset;
+	}
+};
+
+struct VertexBindingDesc
+{
+	uint32_t binding;
+	uint32_t stride;
+
+	bool operator==(const VertexBindingDesc& other) const
+	{
+		return binding == other.binding && stride == other.stride;
+	}
+};
+
+struct PipelineStateDesc
+{
+	// Name the program was registered with in PipelineWarmup.
+	std::string program;
+
+	// Render pass compatibility
+	std::vector<VkFormat> color_formats;
+	VkFormat depth_format = VK_FORMAT_UNDEFINED;
+
+	// Vertex layout
+	std::vector<VertexBindingDesc> bindings;
+	std::vector<VertexAttribDesc> attribs;
+
+	// Raster state, applied on top of SetOpaqueState()
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+	bool depth_test = false;
+	bool depth_write = false;
+	VkCompareOp depth_compare = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+	bool operator==(const PipelineStateDesc& other) const
+	{
+		return program == other.program && color_formats == other.color_formats && depth_format == other.depth_format &&
+			bindings == other.bindings && attribs == other.attribs && topology == other.topology && cull_mode == other.cull_mode &&
+			depth_test == other.depth_test && depth_write == other.depth_write && depth_compare == other.depth_compare;
+	}
+
+	// Sets program and all pipeline state. Must be called inside a render pass matching the formats.
+	void Apply(Vulkan::CommandBuffer& cmd, Vulkan::Program& program_) const
+	{
+		cmd.SetProgram(program_);
+
+		cmd.SetOpaqueState();
+		cmd.SetDepthTest(depth_test, depth_write);
+		cmd.SetDepthCompare(depth_compare);
+
+		for (const VertexAttribDesc& attrib : attribs)
+			cmd.SetVertexAttrib(attrib.location, attrib.binding, attrib.format, attrib.offset);
+
+		for (const VertexBindingDesc& binding : bindings)
+			cmd.SetVertexBinding(binding.binding, binding.stride);
+
+		cmd.SetPrimitiveTopology(topology);
+		cmd.SetCullMode(cull_mode);
+	}
+};
+
+// One descriptor per line, whitespace separated integers after the program name.
+static inline void WritePipelineStateDesc(std::ostream& out, const PipelineStateDesc& desc)
+{
+	out << desc.program << ' ' << desc.color_formats.size();
+	for (VkFormat format : desc.color_formats)
+		out << ' ' << format;
+	out << ' ' << desc.depth_format;
+
+	out << ' ' << desc.bindings.size();
+	for (const VertexBindingDesc& binding : desc.bindings)
+		out << ' ' << binding.binding << ' ' << binding.stride;
+
+	out << ' ' << desc.attribs.size();
+	for (const VertexAttribDesc& attrib : desc.attribs)
+		out << ' ' << attrib.location << ' ' << attrib.binding << ' ' << attrib.format << ' ' << attrib.offset;
+
+	out << ' ' << desc.topology << ' ' << desc.cull_mode << ' ' << desc.depth_test << ' ' << desc.depth_write << ' ' << desc.depth_compare << '\n';
+}
+
+// Returns false for a malformed descriptor, including counts or indices past the device limits,
+// which the file is not trusted to respect.
+static inline bool ReadPipelineStateDesc(std::istream& in, PipelineStateDesc& desc)
+{
+	desc = {};
+
+	auto read_enum = [&in](auto& value) {
+		int64_t raw;
+		in >> raw;
+		value = static_cast<std::remove_reference_t<decltype(value)>>(raw);
+	};
+
+	size_t count;
+
+	if (!(in >> desc.program >> count) || count > Vulkan::VULKAN_NUM_ATTACHMENTS)
+		return false;
+	desc.color_formats.resize(count);
+	for (VkFormat& format : desc.color_formats)
+		read_enum(format);
+	read_enum(desc.depth_format);
+
+	if (!(in >> count) || count > Vulkan::VULKAN_NUM_VERTEX_BUFFERS)
+		return false;
+	desc.bindings.resize(count);
+	for (VertexBindingDesc& binding : desc.bindings)
+	{
+		if (!(in >> binding.binding >> binding.stride) || binding.binding >= Vulkan::VULKAN_NUM_VERTEX_BUFFERS)
+			return false;
+	}
+
+	if (!(in >> count) || count > Vulkan::VULKAN_NUM_VERTEX_ATTRIBS)
+		return false;
+	desc.attribs.resize(count);
+	for (VertexAttribDesc& attrib : desc.attribs)
+	{
+		in >> attrib.location >> attrib.binding;
+		read_enum(attrib.format);
+		in >> attrib.offset;
+		if (!in || attrib.location >= Vulkan::VULKAN_NUM_VERTEX_ATTRIBS || attrib.binding >= Vulkan::VULKAN_NUM_VERTEX_BUFFERS)
+			return false;
+	}
+
+	read_enum(desc.topology);
+	read_enum(desc.cull_mode);
+	in >> desc.depth_test >> desc.depth_write;
+	read_enum(desc.depth_compare);
+
+	return bool(in);
+}
+
+struct PipelineWarmup
+{
+	struct RegisteredProgram
+	{
+		Vulkan::Program* program = nullptr;
+		// The program's reflected resources. Warmup draws bind a placeholder to each of them.
+		ShaderBindings bindings;
+	};
+
+	void RegisterProgram(const std::string& name, Vulkan::Program& program, const ShaderBindings& bindings)
+	{
+		programs[name] = { &program, bindings };
+	}
+
+	// Adds a descriptor unless an identical one is already in the list.
+	void Add(const PipelineStateDesc& desc)
+	{
+		if (std::find(states.begin(), states.end(), desc) == states.end())
+			states.push_back(desc);
+	}
+
+	// Adds the descriptors saved by a previous run. Malformed lines are skipped, and so are
+	// descriptors for programs that are not registered when compiling.
+	bool LoadList(const char* path)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+			return false;
+
+		std::string line;
+		uint32_t skipped = 0;
+		PipelineStateDesc desc;
+		while (std::getline(file, line))
+		{
+			std::istringstream line_stream(line);
+			if (ReadPipelineStateDesc(line_stream, desc))
+				Add(desc);
+			else if (!line.empty())
+				skipped++;
+		}
+
+		if (skipped != 0)
+			QM_LOG_ERROR("Skipped %u malformed pipeline states in %s\n", skipped, path);
+
+		return true;
+	}
+
+	bool SaveList(const char* path) const
+	{
+		std::ofstream file(path, std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		for (const PipelineStateDesc& desc : states)
+			WritePipelineStateDesc(file, desc);
+
+		return bool(file);
+	}
+
+	// Compiles every descriptor by recording a tiny draw with it into frame_rp's attachments, spread
+	// over thread_count workers using thread indices [first_thread_index, first_thread_index + thread_count).
+	// Pipelines are keyed by the compatible render pass, which covers the attachments' formats, domain
+	// and swapchain layout as well, so frame_rp must use images that match the frames' (see
+	// FrameRenderContext::GetWarmupRenderPass()). Descriptors with other formats are skipped.
+	// Every resource the program declares is bound to a zeroed placeholder, so the draws are valid.
+	// The device must have been initialized with enough thread indices. Blocks until done.
+	void Compile(Vulkan::Device& device, const Vulkan::RenderPassInfo& frame_rp, uint32_t first_thread_index, uint32_t thread_count)
+	{
+		Util::Timer timer;
+		timer.start();
+
+		struct WarmupPass
+		{
+			const PipelineStateDesc* desc;
+			const RegisteredProgram* program;
+			Vulkan::RenderPassInfo::Subpass subpass;
+		};
+
+		std::vector<WarmupPass> passes;
+		passes.reserve(states.size());
+
+		Vulkan::RenderPassInfo rp = frame_rp;
+		rp.store_attachments = 0;
+
+		uint32_t max_stride = 0;
+		bool needs_texture = false;
+		bool needs_storage_image = false;
+		// Large enough for the vertices and instances the draws read from storage buffers at index 0.
+		VkDeviceSize placeholder_size = 64 * 1024;
+
+		auto matches_frame = [&](const PipelineStateDesc& desc) {
+			if (desc.color_formats.size() != rp.num_color_attachments)
+				return false;
+			for (uint32_t i = 0; i < rp.num_color_attachments; i++)
+			{
+				if (desc.color_formats[i] != rp.color_attachments[i].view->GetFormat())
+					return false;
+			}
+			VkFormat depth_format = rp.depth_stencil.view ? rp.depth_stencil.view->GetFormat() : VK_FORMAT_UNDEFINED;
+			return desc.depth_format == depth_format;
+		};
+
+		for (const PipelineStateDesc& desc : states)
+		{
+			auto itr = programs.find(desc.program);
+			if (itr == programs.end() || !matches_frame(desc))
+				continue;
+
+			passes.emplace_back();
+			WarmupPass& pass = passes.back();
+			pass.desc = &desc;
+			pass.program = &itr->second;
+
+			pass.subpass.num_color_attachments = rp.num_color_attachments;
+			for (uint32_t i = 0; i < rp.num_color_attachments; i++)
+				pass.subpass.color_attachments[i] = i;
+
+			if (desc.depth_format != VK_FORMAT_UNDEFINED)
+				pass.subpass.depth_stencil_mode = desc.depth_write ? Vulkan::RenderPassInfo::DepthStencil::ReadWrite : Vulkan::RenderPassInfo::DepthStencil::ReadOnly;
+
+			for (const VertexBindingDesc& binding : desc.bindings)
+				max_stride = std::max(max_stride, binding.stride);
+
+			for (const ShaderBindings::Binding& binding : pass.program->bindings.bindings)
+			{
+				needs_texture |= binding.type == SpirvDescriptorType::SampledTexture;
+				needs_storage_image |= binding.type == SpirvDescriptorType::StorageImage;
+				placeholder_size = std::max<VkDeviceSize>(placeholder_size, binding.block_size);
+			}
+		}
+
+		// Every warmup draw reads three zeroed vertices from this buffer.
+		Vulkan::BufferHandle dummy_vertices;
+		if (max_stride != 0)
+		{
+			std::vector<uint8_t> zeros(max_stride * 3);
+
+			Vulkan::BufferCreateInfo create_info{};
+			create_info.domain = Vulkan::BufferDomain::Device;
+			create_info.size = zeros.size();
+			create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+			create_info.sharing_mode = Vulkan::BufferSharingMode::Exclusive;
+			create_info.exclusive_owner = Vulkan::BUFFER_COMMAND_QUEUE_GENERIC;
+
+			dummy_vertices = device.CreateBuffer(create_info, zeros.data());
+		}
+
+		// Placeholders for the programs' resources.
+		Vulkan::BufferHandle placeholder_buffer;
+		{
+			std::vector<uint8_t> zeros(placeholder_size);
+
+			Vulkan::BufferCreateInfo create_info{};
+			create_info.domain = Vulkan::BufferDomain::Device;
+			create_info.size = zeros.size();
+			create_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			create_info.sharing_mode = Vulkan::BufferSharingMode::Exclusive;
+			create_info.exclusive_owner = Vulkan::BUFFER_COMMAND_QUEUE_GENERIC;
+
+			placeholder_buffer = device.CreateBuffer(create_info, zeros.data());
+		}
+
+		Vulkan::ImageHandle placeholder_texture;
+		if (needs_texture)
+		{
+			const uint32_t black = 0;
+
+			Vulkan::ImageCreateInfo create_info = Vulkan::ImageCreateInfo::Immutable2dImage(1, 1, VK_FORMAT_R8G8B8A8_UNORM, false);
+			create_info.sharing_mode = Vulkan::ImageSharingMode::Exclusive;
+			create_info.exclusive_owner = Vulkan::IMAGE_COMMAND_QUEUE_GENERIC;
+
+			Vulkan::ImageStagingCopyInfo copy{};
+			copy.image_extent = { 1, 1, 1 };
+			copy.num_layers = 1;
+
+			placeholder_texture = device.CreateImage(create_info, sizeof(black), &black, 1, &copy);
+		}
+
+		Vulkan::ImageHandle placeholder_storage_image;
+		if (needs_storage_image)
+		{
+			// R32_SFLOAT is a storage format every device supports.
+			Vulkan::ImageCreateInfo create_info = Vulkan::ImageCreateInfo::RenderTarget(1, 1, VK_FORMAT_R32_SFLOAT);
+			create_info.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+			create_info.initial_layout = VK_IMAGE_LAYOUT_GENERAL;
+			create_info.sharing_mode = Vulkan::ImageSharingMode::Exclusive;
+			create_info.exclusive_owner = Vulkan::IMAGE_COMMAND_QUEUE_GENERIC;
+
+			placeholder_storage_image = device.CreateImage(create_info);
+		}
+
+		auto bind_placeholders = [&](Vulkan::CommandBuffer& cmd, const ShaderBindings& bindings) {
+			for (const ShaderBindings::Binding& binding : bindings.bindings)
+			{
+				for (uint32_t i = 0; i < std::max(binding.array_size, 1u); i++)
+				{
+					switch (binding.type)
+					{
+					case SpirvDescriptorType::UniformBuffer:
+						cmd.SetUniformBuffer(binding.slot.set, binding.slot.binding, i, *placeholder_buffer, 0, std::max<VkDeviceSize>(binding.block_size, 16));
+						break;
+					case SpirvDescriptorType::StorageBuffer:
+						cmd.SetStorageBuffer(binding.slot.set, binding.slot.binding, i, *placeholder_buffer);
+						break;
+					case SpirvDescriptorType::SampledTexture:
+						cmd.SetSampledTexture(binding.slot.set, binding.slot.binding, i, placeholder_texture->GetView(), Vulkan::StockSampler::NearestClamp);
+						break;
+					case SpirvDescriptorType::StorageImage:
+						cmd.SetStorageTexture(binding.slot.set, binding.slot.binding, i, placeholder_storage_image->GetView());
+						break;
+					default:
+						// Separate images and samplers and texel buffers are not used by the examples' graphics programs.
+						break;
+					}
+				}
+			}
+
+			if (bindings.push_constant_size != 0)
+			{
+				uint8_t zeros[256] = {};
+				cmd.PushConstants(zeros, 0, std::min<VkDeviceSize>(bindings.push_constant_size, sizeof(zeros)));
+			}
+		};
+
+		thread_count = std::max(1u, std::min(thread_count, static_cast<uint32_t>(passes.size())));
+
+		auto worker = [&](uint32_t worker_index) {
+			auto cmd = device.RequestCommandBufferForThread(first_thread_index + worker_index, Vulkan::CommandBuffer::Type::Generic);
+
+			for (size_t i = worker_index; i < passes.size(); i += thread_count)
+			{
+				const WarmupPass& pass = passes[i];
+
+				Vulkan::RenderPassInfo pass_rp = rp;
+				pass_rp.num_subpasses = 1;
+				pass_rp.subpasses = &pass.subpass;
+
+				cmd->BeginRenderPass(pass_rp);
+				pass.desc->Apply(*cmd, *pass.program->program);
+				bind_placeholders(*cmd, pass.program->bindings);
+
+				for (const VertexBindingDesc& binding : pass.desc->bindings)
+					cmd->BindVertexBuffer(binding.binding, *dummy_vertices, 0);
+
+				cmd->Draw(3);
+				cmd->EndRenderPass();
+			}
+
+			device.Submit(cmd);
+		};
+
+		std::vector<std::thread> workers;
+		for (uint32_t i = 1; i < thread_count; i++)
+			workers.emplace_back(worker, i);
+
+		worker(0);
+
+		for (std::thread& thread : workers)
+			thread.join();
+
+		QM_LOG_INFO("Warmed up %zu pipelines on %u threads in %f ms\n", passes.size(), thread_count, timer.end() * 1000.0);
+	}
+
+	std::unordered_map<std::string, RegisteredProgram> programs;
+	std::vector<PipelineStateDesc> states;
+};
+
+// Threads used for warmup. The main thread acts as one of them.
+static inline uint32_t GetWarmupThreadCount()
+{
+	return std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+}
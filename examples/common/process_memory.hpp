@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/resource.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Resident set size of the process now, in bytes, or 0 where unknown.
+static uint64_t GetResidentBytes()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters{};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.WorkingSetSize;
+	return 0;
+#elif defined(__APPLE__)
+	mach_task_basic_info info{};
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS)
+		return info.resident_size;
+	return 0;
+#else
+	FILE* file = std::fopen("/proc/self/statm", "r");
+	if (!file)
+		return 0;
+
+	unsigned long long pages = 0, resident = 0;
+	int read = std::fscanf(file, "%llu %llu", &pages, &resident);
+	std::fclose(file);
+	return read == 2 ? resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+#endif
+}
+
+// Highest resident set size of the process, in bytes, since it started or since the last
+// successful ResetPeakResidentBytes().
+static uint64_t GetPeakResidentBytes()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters{};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+#if !defined(__APPLE__)
+	// VmHWM follows resets through clear_refs, ru_maxrss does not.
+	if (FILE* file = std::fopen("/proc/self/status", "r"))
+	{
+		char line[256];
+		unsigned long long kb = 0;
+		bool found = false;
+		while (!found && std::fgets(line, sizeof(line), file))
+			found = std::sscanf(line, "VmHWM: %llu kB", &kb) == 1;
+		std::fclose(file);
+		if (found)
+			return kb * 1024;
+	}
+#endif
+
+	rusage usage{};
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#if defined(__APPLE__)
+	return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Restarts GetPeakResidentBytes() from the current resident size. Only Linux can, returns false
+// elsewhere, where the peak covers the whole life of the process.
+static bool ResetPeakResidentBytes()
+{
+#if defined(__linux__)
+	FILE* file = std::fopen("/proc/self/clear_refs", "w");
+	if (!file)
+		return false;
+
+	bool reset = std::fputs("5", file) >= 0;
+	return std::fclose(file) == 0 && reset;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+// xoshiro128** (Blackman and Vigna): 128 bits of state, a few adds, shifts and rotates per number,
+// and the same sequence for a seed on every platform, unlike std::rand(). Not thread safe; give
+// each thread its own generator.
+struct Random
+{
+	explicit Random(uint64_t seed = 0)
+	{
+		Seed(seed);
+	}
+
+	// Expands the seed with SplitMix64, so nearby seeds still give unrelated sequences.
+	void Seed(uint64_t seed)
+	{
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			z ^= z >> 31;
+
+			state[i * 2 + 0] = static_cast<uint32_t>(z);
+			state[i * 2 + 1] = static_cast<uint32_t>(z >> 32);
+		}
+	}
+
+	uint32_t Next()
+	{
+		uint32_t result = Rotl(state[1] * 5, 7) * 9;
+		uint32_t t = state[1] << 9;
+
+		state[2] ^= state[0];
+		state[3] ^= state[1];
+		state[1] ^= state[2];
+		state[0] ^= state[3];
+		state[2] ^= t;
+		state[3] = Rotl(state[3], 11);
+
+		return result;
+	}
+
+	// Uniform in [0, 1).
+	float NextFloat()
+	{
+		return static_cast<float>(Next() >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+
+	static uint32_t Rotl(uint32_t x, int k)
+	{
+		return (x << k) | (x >> (32 - k));
+	}
+
+	uint32_t state[4];
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "spirv_reflect.hpp"
+
+// Where a shader resource lives.
+struct BindingSlot
+{
+	uint32_t set = 0;
+	uint32_t binding = 0;
+};
+
+static inline const char* GetDescriptorTypeName(SpirvDescriptorType type)
+{
+	switch (type)
+	{
+	case SpirvDescriptorType::UniformBuffer: return "uniform buffer";
+	case SpirvDescriptorType::StorageBuffer: return "storage buffer";
+	case SpirvDescriptorType::SampledTexture: return "sampled texture";
+	case SpirvDescriptorType::SampledImage: return "sampled image";
+	case SpirvDescriptorType::Sampler: return "sampler";
+	case SpirvDescriptorType::StorageImage: return "storage image";
+	case SpirvDescriptorType::UniformTexelBuffer: return "uniform texel buffer";
+	case SpirvDescriptorType::StorageTexelBuffer: return "storage texel buffer";
+	}
+	return "unknown";
+}
+
+// Descriptor bindings of a shader or a whole program, reflected from SPIR-V once when the shaders
+// are loaded (see LoadShader() in shader_loader.hpp). Examples look resources up by name rather
+// than hard coding set and binding numbers, and a host struct that no longer covers its block is
+// reported at startup.
+struct ShaderBindings
+{
+	struct Binding
+	{
+		std::string name;
+		SpirvDescriptorType type = SpirvDescriptorType::UniformBuffer;
+		BindingSlot slot;
+		uint32_t array_size = 1;
+		uint32_t block_size = 0;
+		VkShaderStageFlags stages = 0;
+	};
+
+	// Sorted by set, then binding.
+	std::vector<Binding> bindings;
+	uint32_t push_constant_size = 0;
+	VkShaderStageFlags push_constant_stages = 0;
+
+	// Reflects one shader stage and merges its bindings. False if the code can't be parsed.
+	bool AddShader(const uint32_t* code, size_t word_count, VkShaderStageFlags stage)
+	{
+		SpirvReflection reflection;
+		if (!ReflectSpirv(code, word_count, reflection))
+			return false;
+
+		ShaderBindings shader;
+		for (const SpirvDescriptor& descriptor : reflection.descriptors)
+			shader.bindings.push_back({ descriptor.name, descriptor.type, { descriptor.set, descriptor.binding }, descriptor.array_size, descriptor.block_size, stage });
+		if (reflection.push_constant_size != 0)
+		{
+			shader.push_constant_size = reflection.push_constant_size;
+			shader.push_constant_stages = stage;
+		}
+
+		return Add(shader);
+	}
+
+	// Merges the bindings of other, for example another stage of the same program. Bindings both
+	// use must agree. False, with the conflict logged, if they don't.
+	bool Add(const ShaderBindings& other)
+	{
+		bool compatible = true;
+
+		for (const Binding& binding : other.bindings)
+		{
+			auto it = std::find_if(bindings.begin(), bindings.end(), [&binding](const Binding& existing) {
+				return existing.slot.set == binding.slot.set && existing.slot.binding == binding.slot.binding;
+			});
+
+			if (it == bindings.end())
+			{
+				bindings.push_back(binding);
+				continue;
+			}
+
+			if (it->type != binding.type || it->array_size != binding.array_size)
+			{
+				QM_LOG_ERROR("Set %u binding %u is a %s (%s) in one stage and a %s (%s) in another\n", binding.slot.set, binding.slot.binding,
+					GetDescriptorTypeName(it->type), it->name.c_str(), GetDescriptorTypeName(binding.type), binding.name.c_str());
+				compatible = false;
+			}
+
+			it->block_size = std::max(it->block_size, binding.block_size);
+			it->stages |= binding.stages;
+		}
+
+		std::sort(bindings.begin(), bindings.end(), [](const Binding& a, const Binding& b) {
+			return a.slot.set != b.slot.set ? a.slot.set < b.slot.set : a.slot.binding < b.slot.binding;
+		});
+
+		push_constant_size = std::max(push_constant_size, other.push_constant_size);
+		push_constant_stages |= other.push_constant_stages;
+
+		return compatible;
+	}
+
+	const Binding* Find(const char* name) const
+	{
+		for (const Binding& binding : bindings)
+		{
+			if (binding.name == name)
+				return &binding;
+		}
+		return nullptr;
+	}
+
+	// Slot of the resource called name. Logs an error, and returns set 0 binding 0, if the shaders
+	// have no such resource, it has another type, or host_size bytes don't cover its block.
+	BindingSlot Get(const char* name, SpirvDescriptorType type, size_t host_size = 0) const
+	{
+		const Binding* binding = Find(name);
+		if (!binding)
+		{
+			QM_LOG_ERROR("Shaders have no resource called %s\n", name);
+			return {};
+		}
+
+		if (binding->type != type)
+			QM_LOG_ERROR("%s is a %s in the shaders, not a %s\n", name, GetDescriptorTypeName(binding->type), GetDescriptorTypeName(type));
+		if (host_size != 0 && host_size < binding->block_size)
+			QM_LOG_ERROR("%s is %u bytes in the shaders, but the host struct only has %zu\n", name, binding->block_size, host_size);
+
+		return binding->slot;
+	}
+};
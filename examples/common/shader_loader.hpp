@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include "shader_bindings.hpp"
+
+struct EmbeddedShader
+{
+	const char* name;
+	const uint32_t* code;
+	size_t word_count;
+};
+
+// Generated by add_example_shaders() in CMakeLists.txt from the example's glsl/ directory.
+#include "shaders/embedded_shaders.hpp"
+
+// SPIR-V of glsl/<name>, compiled and embedded at build time. Empty if the example has no such shader.
+static std::vector<uint32_t> LoadShaderCode(const char* name)
+{
+	for (const EmbeddedShader& shader : embedded_shaders)
+	{
+		if (std::strcmp(shader.name, name) == 0)
+			return std::vector<uint32_t>(shader.code, shader.code + shader.word_count);
+	}
+
+	QM_LOG_ERROR("%s is not one of the example's shaders\n", name);
+	return {};
+}
+
+// Creates a shader from glsl/<name>, see LoadShaderCode().
+static Vulkan::ShaderHandle LoadShader(Vulkan::Device& device, const char* name)
+{
+	std::vector<uint32_t> code = LoadShaderCode(name);
+	return device.CreateShader(code.size(), code.data());
+}
+
+// Same as above, and adds the shader's descriptor bindings to bindings.
+static Vulkan::ShaderHandle LoadShader(Vulkan::Device& device, const char* name, ShaderBindings& bindings, VkShaderStageFlags stage)
+{
+	std::vector<uint32_t> code = LoadShaderCode(name);
+	if (!bindings.AddShader(code.data(), code.size(), stage))
+		QM_LOG_ERROR("Failed to reflect the bindings of %s\n", name);
+	return device.CreateShader(code.size(), code.data());
+}
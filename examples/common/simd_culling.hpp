@@ -0,0 +1,499 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "frustum.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define QM_EXAMPLES_CULLING_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC allows AVX intrinsics in any function.
+#define QM_EXAMPLES_TARGET_AVX
+#else
+// Only the AVX kernel is compiled for AVX, it is selected at runtime.
+#define QM_EXAMPLES_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+// CPU frustum culling for many instances. Bounds are stored as structure of arrays so one plane can
+// be tested against 4 (SSE) or 8 (AVX) boxes per instruction. CullingBvh groups instances
+// spatially so whole subtrees can be accepted or rejected with a single test.
+
+enum class CullingPath
+{
+	Scalar,
+	SSE,
+	AVX
+};
+
+static inline const char* GetCullingPathName(CullingPath path)
+{
+	switch (path)
+	{
+	case CullingPath::SSE:
+		return "SSE";
+	case CullingPath::AVX:
+		return "AVX";
+	default:
+		return "Scalar";
+	}
+}
+
+static inline bool IsCullingPathSupported(CullingPath path)
+{
+#ifdef QM_EXAMPLES_CULLING_X86
+	if (path != CullingPath::AVX)
+		return true;
+
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+	return os_saves_ymm && (info[2] & (1 << 28)) != 0;
+#else
+	return __builtin_cpu_supports("avx");
+#endif
+#else
+	return path == CullingPath::Scalar;
+#endif
+}
+
+static inline CullingPath GetBestCullingPath()
+{
+	if (IsCullingPathSupported(CullingPath::AVX))
+		return CullingPath::AVX;
+	if (IsCullingPathSupported(CullingPath::SSE))
+		return CullingPath::SSE;
+	return CullingPath::Scalar;
+}
+
+// Axis aligned boxes, one array per component. Arrays are padded so SIMD kernels can always load a
+// full batch past the last box.
+struct AabbSoA
+{
+	static constexpr uint32_t padding = 8;
+
+	void Resize(uint32_t count_)
+	{
+		count = count_;
+		uint32_t padded = ((count + 7) & ~7u) + padding;
+		for (std::vector<float>* component : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z })
+			component->assign(padded, 0.0f);
+	}
+
+	void Set(uint32_t index, const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+	{
+		min_x[index] = bounds_min.x;
+		min_y[index] = bounds_min.y;
+		min_z[index] = bounds_min.z;
+		max_x[index] = bounds_max.x;
+		max_y[index] = bounds_max.y;
+		max_z[index] = bounds_max.z;
+	}
+
+	std::vector<float> min_x, min_y, min_z;
+	std::vector<float> max_x, max_y, max_z;
+	uint32_t count = 0;
+};
+
+// Bounding spheres, same layout rules as AabbSoA.
+struct SphereSoA
+{
+	void Resize(uint32_t count_)
+	{
+		count = count_;
+		uint32_t padded = ((count + 7) & ~7u) + AabbSoA::padding;
+		for (std::vector<float>* component : { &center_x, &center_y, &center_z, &radius })
+			component->assign(padded, 0.0f);
+	}
+
+	void Set(uint32_t index, const glm::vec3& center, float radius_)
+	{
+		center_x[index] = center.x;
+		center_y[index] = center.y;
+		center_z[index] = center.z;
+		radius[index] = radius_;
+	}
+
+	std::vector<float> center_x, center_y, center_z, radius;
+	uint32_t count = 0;
+};
+
+// Bounds of a model space box after transformation (Arvo).
+static inline void TransformAabb(const glm::mat4& transform, const glm::vec3& bounds_min, const glm::vec3& bounds_max, glm::vec3& out_min, glm::vec3& out_max)
+{
+	glm::vec3 translation = glm::vec3(transform[3]);
+	out_min = translation;
+	out_max = translation;
+
+	for (int column = 0; column < 3; column++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			float a = transform[column][row] * bounds_min[column];
+			float b = transform[column][row] * bounds_max[column];
+			out_min[row] += std::min(a, b);
+			out_max[row] += std::max(a, b);
+		}
+	}
+}
+
+namespace CullingDetail
+{
+	// Per plane, the box corner furthest along the normal (the "positive vertex"). A box is outside
+	// when that corner is behind any plane. Picking it per plane keeps the kernels branch free.
+	struct PlaneCorners
+	{
+		const float* x[6];
+		const float* y[6];
+		const float* z[6];
+	};
+
+	static inline PlaneCorners SelectCorners(const Frustum& frustum, const AabbSoA& boxes)
+	{
+		PlaneCorners corners;
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			corners.x[p] = plane.x > 0.0f ? boxes.max_x.data() : boxes.min_x.data();
+			corners.y[p] = plane.y > 0.0f ? boxes.max_y.data() : boxes.min_y.data();
+			corners.z[p] = plane.z > 0.0f ? boxes.max_z.data() : boxes.min_z.data();
+		}
+		return corners;
+	}
+
+	static inline void EmitMask(uint32_t mask, uint32_t base, uint32_t end, const uint32_t* ids, std::vector<uint32_t>& visible)
+	{
+		for (uint32_t bit = 0; mask != 0; bit++, mask >>= 1)
+		{
+			uint32_t slot = base + bit;
+			if ((mask & 1) && slot < end)
+				visible.push_back(ids ? ids[slot] : slot);
+		}
+	}
+
+	static inline void CullAabbsScalar(const Frustum& frustum, const AabbSoA& boxes, uint32_t begin, uint32_t end, const uint32_t* ids, std::vector<uint32_t>& visible)
+	{
+		PlaneCorners corners = SelectCorners(frustum, boxes);
+
+		for (uint32_t i = begin; i < end; i++)
+		{
+			bool inside = true;
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				float dist = plane.x * corners.x[p][i] + plane.y * corners.y[p][i] + plane.z * corners.z[p][i] + plane.w;
+				inside = inside && dist >= 0.0f;
+			}
+
+			if (inside)
+				visible.push_back(ids ? ids[i] : i);
+		}
+	}
+
+	static inline void CullSpheresScalar(const Frustum& frustum, const SphereSoA& spheres, uint32_t begin, uint32_t end, const uint32_t* ids, std::vector<uint32_t>& visible)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			bool inside = true;
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				float dist = plane.x * spheres.center_x[i] + plane.y * spheres.center_y[i] + plane.z * spheres.center_z[i] + plane.w;
+				inside = inside && dist >= -spheres.radius[i];
+			}
+
+			if (inside)
+				visible.push_back(ids ? ids[i] : i);
+		}
+	}
+
+#ifdef QM_EXAMPLES_CULLING_X86
+	static inline void CullAabbsSSE(const Frustum& frustum, const AabbSoA& boxes, uint32_t begin, uint32_t end, const uint32_t* ids, std::vector<uint32_t>& visible)
+	{
+		PlaneCorners corners = SelectCorners(frustum, boxes);
+		const __m128 zero = _mm_setzero_ps();
+
+		for (uint32_t i = begin; i < end; i += 4)
+		{
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m128 dist = _mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(corners.x[p] + i));
+				dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(corners.y[p] + i)));
+				dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(corners.z[p] + i)));
+				dist = _mm_add_ps(dist, _mm_set1_ps(plane.w));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, zero));
+			}
+
+			EmitMask(static_cast<uint32_t>(_mm_movemask_ps(inside)), i, end, ids, visible);
+		}
+	}
+
+	static inline void CullSpheresSSE(const Frustum& frustum, const SphereSoA& spheres, uint32_t begin, uint32_t end, const uint32_t* ids, std::vector<uint32_t>& visible)
+	{
+		const __m128 zero = _mm_setzero_ps();
+
+		for (uint32_t i = begin; i < end; i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(spheres.center_x.data() + i);
+			__m128 cy = _mm_loadu_ps(spheres.center_y.data() + i);
+			__m128 cz = _mm_loadu_ps(spheres.center_z.data() + i);
+			__m128 neg_radius = _mm_sub_ps(zero, _mm_loadu_ps(spheres.radius.data() + i));
+
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m128 dist = _mm_mul_ps(_mm_set1_ps(plane.x), cx);
+				dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane.y), cy));
+				dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane.z), cz));
+				dist = _mm_add_ps(dist, _mm_set1_ps(plane.w));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, neg_radius));
+			}
+
+			EmitMask(static_cast<uint32_t>(_mm_movemask_ps(inside)), i, end, ids, visible);
+		}
+	}
+
+	QM_EXAMPLES_TARGET_AVX static void CullAabbsAVX(const Frustum& frustum, const AabbSoA& boxes, uint32_t begin, uint32_t end, const uint32_t* ids, std::vector<uint32_t>& visible)
+	{
+		PlaneCorners corners = SelectCorners(frustum, boxes);
+		const __m256 zero = _mm256_setzero_ps();
+
+		for (uint32_t i = begin; i < end; i += 8)
+		{
+			__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m256 dist = _mm256_mul_ps(_mm256_set1_ps(plane.x), _mm256_loadu_ps(corners.x[p] + i));
+				dist = _mm256_add_ps(dist, _mm256_mul_ps(_mm256_set1_ps(plane.y), _mm256_loadu_ps(corners.y[p] + i)));
+				dist = _mm256_add_ps(dist, _mm256_mul_ps(_mm256_set1_ps(plane.z), _mm256_loadu_ps(corners.z[p] + i)));
+				dist = _mm256_add_ps(dist, _mm256_set1_ps(plane.w));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, zero, _CMP_GE_OQ));
+			}
+
+			EmitMask(static_cast<uint32_t>(_mm256_movemask_ps(inside)), i, end, ids, visible);
+		}
+	}
+
+	QM_EXAMPLES_TARGET_AVX static void CullSpheresAVX(const Frustum& frustum, const SphereSoA& spheres, uint32_t begin, uint32_t end, const uint32_t* ids, std::vector<uint32_t>& visible)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+
+		for (uint32_t i = begin; i < end; i += 8)
+		{
+			__m256 cx = _mm256_loadu_ps(spheres.center_x.data() + i);
+			__m256 cy = _mm256_loadu_ps(spheres.center_y.data() + i);
+			__m256 cz = _mm256_loadu_ps(spheres.center_z.data() + i);
+			__m256 neg_radius = _mm256_sub_ps(zero, _mm256_loadu_ps(spheres.radius.data() + i));
+
+			__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m256 dist = _mm256_mul_ps(_mm256_set1_ps(plane.x), cx);
+				dist = _mm256_add_ps(dist, _mm256_mul_ps(_mm256_set1_ps(plane.y), cy));
+				dist = _mm256_add_ps(dist, _mm256_mul_ps(_mm256_set1_ps(plane.z), cz));
+				dist = _mm256_add_ps(dist, _mm256_set1_ps(plane.w));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, neg_radius, _CMP_GE_OQ));
+			}
+
+			EmitMask(static_cast<uint32_t>(_mm256_movemask_ps(inside)), i, end, ids, visible);
+		}
+	}
+#endif
+}
+
+// Appends to visible the ids of boxes [begin, end) that intersect the frustum. ids maps box index to
+// the id that is emitted, or nullptr to emit box indices. The path must be supported by this CPU.
+static inline void CullAabbs(const Frustum& frustum, const AabbSoA& boxes, uint32_t begin, uint32_t end, const uint32_t* ids, std::vector<uint32_t>& visible, CullingPath path)
+{
+#ifdef QM_EXAMPLES_CULLING_X86
+	if (path == CullingPath::AVX)
+		return CullingDetail::CullAabbsAVX(frustum, boxes, begin, end, ids, visible);
+	if (path == CullingPath::SSE)
+		return CullingDetail::CullAabbsSSE(frustum, boxes, begin, end, ids, visible);
+#endif
+	CullingDetail::CullAabbsScalar(frustum, boxes, begin, end, ids, visible);
+}
+
+static inline void CullSpheres(const Frustum& frustum, const SphereSoA& spheres, uint32_t begin, uint32_t end, const uint32_t* ids, std::vector<uint32_t>& visible, CullingPath path)
+{
+#ifdef QM_EXAMPLES_CULLING_X86
+	if (path == CullingPath::AVX)
+		return CullingDetail::CullSpheresAVX(frustum, spheres, begin, end, ids, visible);
+	if (path == CullingPath::SSE)
+		return CullingDetail::CullSpheresSSE(frustum, spheres, begin, end, ids, visible);
+#endif
+	CullingDetail::CullSpheresScalar(frustum, spheres, begin, end, ids, visible);
+}
+
+// Bounding volume hierarchy over instance boxes. The tree topology is built once, Refit() updates
+// the bounds after instances move, which is much cheaper than a rebuild and keeps culling
+// efficient as long as instances stay roughly where they were.
+struct CullingBvh
+{
+	// Up to two AVX batches per leaf.
+	static constexpr uint32_t max_leaf_size = 16;
+
+	struct Node
+	{
+		glm::vec3 bounds_min;
+		glm::vec3 bounds_max;
+		// Range of slots covered by this subtree, slots are instances in tree order.
+		uint32_t first_slot;
+		uint32_t slot_count;
+		// Index of the second child, the first child always follows its parent. 0 for leaves.
+		uint32_t right_child;
+	};
+
+	void Build(const std::vector<glm::vec3>& instance_min, const std::vector<glm::vec3>& instance_max)
+	{
+		uint32_t count = static_cast<uint32_t>(instance_min.size());
+
+		ids.resize(count);
+		for (uint32_t i = 0; i < count; i++)
+			ids[i] = i;
+
+		std::vector<glm::vec3> centers(count);
+		for (uint32_t i = 0; i < count; i++)
+			centers[i] = (instance_min[i] + instance_max[i]) * 0.5f;
+
+		nodes.clear();
+		nodes.reserve(count == 0 ? 1 : 2 * (count / max_leaf_size + 1));
+		if (count != 0)
+			BuildNode(centers, 0, count);
+
+		Refit(instance_min, instance_max);
+	}
+
+	// Updates all bounds from new per-instance boxes. Instance count must match Build().
+	void Refit(const std::vector<glm::vec3>& instance_min, const std::vector<glm::vec3>& instance_max)
+	{
+		uint32_t count = static_cast<uint32_t>(ids.size());
+		if (boxes.count != count)
+			boxes.Resize(count);
+
+		for (uint32_t slot = 0; slot < count; slot++)
+			boxes.Set(slot, instance_min[ids[slot]], instance_max[ids[slot]]);
+
+		// Children are stored after their parent, so a reverse walk sees children first.
+		for (size_t i = nodes.size(); i-- > 0;)
+		{
+			Node& node = nodes[i];
+			if (node.right_child == 0)
+			{
+				uint32_t first = node.first_slot;
+				uint32_t end = first + node.slot_count;
+				float min_x = boxes.min_x[first], min_y = boxes.min_y[first], min_z = boxes.min_z[first];
+				float max_x = boxes.max_x[first], max_y = boxes.max_y[first], max_z = boxes.max_z[first];
+				for (uint32_t slot = first + 1; slot < end; slot++)
+				{
+					min_x = std::min(min_x, boxes.min_x[slot]);
+					min_y = std::min(min_y, boxes.min_y[slot]);
+					min_z = std::min(min_z, boxes.min_z[slot]);
+					max_x = std::max(max_x, boxes.max_x[slot]);
+					max_y = std::max(max_y, boxes.max_y[slot]);
+					max_z = std::max(max_z, boxes.max_z[slot]);
+				}
+				node.bounds_min = glm::vec3(min_x, min_y, min_z);
+				node.bounds_max = glm::vec3(max_x, max_y, max_z);
+			}
+			else
+			{
+				const Node& left = nodes[i + 1];
+				const Node& right = nodes[node.right_child];
+				node.bounds_min = glm::min(left.bounds_min, right.bounds_min);
+				node.bounds_max = glm::max(left.bounds_max, right.bounds_max);
+			}
+		}
+	}
+
+	// Appends the ids of all visible instances, in tree order.
+	void Cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullingPath path) const
+	{
+		if (!nodes.empty())
+			CullNode(frustum, 0, 0x3f, visible, path);
+	}
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> ids;
+	AabbSoA boxes;
+
+private:
+
+	uint32_t BuildNode(std::vector<glm::vec3>& centers, uint32_t first, uint32_t count)
+	{
+		uint32_t index = static_cast<uint32_t>(nodes.size());
+		nodes.push_back({ glm::vec3(0.0f), glm::vec3(0.0f), first, count, 0 });
+
+		if (count <= max_leaf_size)
+			return index;
+
+		// Median split along the axis with the largest spread of centers.
+		glm::vec3 center_min = centers[ids[first]];
+		glm::vec3 center_max = center_min;
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			center_min = glm::min(center_min, centers[ids[i]]);
+			center_max = glm::max(center_max, centers[ids[i]]);
+		}
+
+		glm::vec3 spread = center_max - center_min;
+		int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+
+		uint32_t half = count / 2;
+		std::nth_element(ids.begin() + first, ids.begin() + first + half, ids.begin() + first + count,
+			[&centers, axis](uint32_t a, uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+
+		BuildNode(centers, first, half);
+		uint32_t right = BuildNode(centers, first + half, count - half);
+		nodes[index].right_child = right;
+
+		return index;
+	}
+
+	// plane_mask has a bit set for every plane the parent straddles. Planes the parent is fully
+	// inside of don't need to be tested again.
+	void CullNode(const Frustum& frustum, uint32_t index, uint32_t plane_mask, std::vector<uint32_t>& visible, CullingPath path) const
+	{
+		const Node& node = nodes[index];
+
+		for (int p = 0; p < 6; p++)
+		{
+			if ((plane_mask & (1u << p)) == 0)
+				continue;
+
+			const glm::vec4& plane = frustum.planes[p];
+			glm::vec3 positive(plane.x > 0.0f ? node.bounds_max.x : node.bounds_min.x, plane.y > 0.0f ? node.bounds_max.y : node.bounds_min.y, plane.z > 0.0f ? node.bounds_max.z : node.bounds_min.z);
+			glm::vec3 negative(plane.x > 0.0f ? node.bounds_min.x : node.bounds_max.x, plane.y > 0.0f ? node.bounds_min.y : node.bounds_max.y, plane.z > 0.0f ? node.bounds_min.z : node.bounds_max.z);
+
+			if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+				return;
+			if (glm::dot(glm::vec3(plane), negative) + plane.w >= 0.0f)
+				plane_mask &= ~(1u << p);
+		}
+
+		if (plane_mask == 0)
+		{
+			// Entirely inside, accept the whole subtree without further tests.
+			visible.insert(visible.end(), ids.begin() + node.first_slot, ids.begin() + node.first_slot + node.slot_count);
+		}
+		else if (node.right_child == 0)
+		{
+			CullAabbs(frustum, boxes, node.first_slot, node.first_slot + node.slot_count, ids.data(), visible, path);
+		}
+		else
+		{
+			CullNode(frustum, index + 1, plane_mask, visible, path);
+			CullNode(frustum, node.right_child, plane_mask, visible, path);
+		}
+	}
+};
@@ -0,0 +1,519 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Minimal SPIR-V reader: recovers the descriptor bindings of a module, its uniform, storage and push
+// constant blocks and the layout of every struct they contain, straight from the decorations the
+// compiler wrote. Has no dependencies besides the standard library, so the build can run it on
+// freshly compiled shaders (see cmake/spirv_layout.cpp) as well as the examples at startup
+// (see common/shader_bindings.hpp).
+
+struct SpirvMember
+{
+	std::string name;
+	uint32_t type_id = 0;
+	uint32_t offset = 0;
+	// Bytes the member occupies, 0 for runtime arrays.
+	uint32_t size = 0;
+	// Element stride for arrays, 0 otherwise.
+	uint32_t array_stride = 0;
+};
+
+struct SpirvStruct
+{
+	std::string name;
+	uint32_t id = 0;
+	// End of the last member. Not rounded up to the struct's alignment.
+	uint32_t size = 0;
+	std::vector<SpirvMember> members;
+};
+
+enum class SpirvBlockKind
+{
+	Uniform,
+	Storage,
+	PushConstant
+};
+
+struct SpirvBlock
+{
+	SpirvBlockKind kind = SpirvBlockKind::Uniform;
+	uint32_t set = 0;
+	uint32_t binding = 0;
+	// Index into SpirvReflection::structs.
+	uint32_t struct_index = 0;
+};
+
+enum class SpirvDescriptorType
+{
+	UniformBuffer,
+	StorageBuffer,
+	// sampler2D and friends.
+	SampledTexture,
+	SampledImage,
+	Sampler,
+	StorageImage,
+	UniformTexelBuffer,
+	StorageTexelBuffer
+};
+
+struct SpirvDescriptor
+{
+	// Block name for buffers, variable name for everything else.
+	std::string name;
+	SpirvDescriptorType type = SpirvDescriptorType::UniformBuffer;
+	uint32_t set = 0;
+	uint32_t binding = 0;
+	// 1 for single descriptors, 0 for runtime sized arrays.
+	uint32_t array_size = 1;
+	// Bytes up to the end of the block's last member, runtime arrays counting as empty. 0 for
+	// everything but buffers.
+	uint32_t block_size = 0;
+};
+
+struct SpirvReflection
+{
+	// Every struct reachable from a block: each block's own struct, followed by the structs nested in it.
+	std::vector<SpirvStruct> structs;
+	std::vector<SpirvBlock> blocks;
+	std::vector<SpirvDescriptor> descriptors;
+	uint32_t push_constant_size = 0;
+};
+
+namespace SpirvDetail
+{
+	enum : uint32_t
+	{
+		Magic = 0x07230203,
+
+		OpName = 5,
+		OpMemberName = 6,
+		OpTypeInt = 21,
+		OpTypeFloat = 22,
+		OpTypeVector = 23,
+		OpTypeMatrix = 24,
+		OpTypeImage = 25,
+		OpTypeSampler = 26,
+		OpTypeSampledImage = 27,
+		OpTypeArray = 28,
+		OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpConstant = 43,
+		OpVariable = 59,
+		OpDecorate = 71,
+		OpMemberDecorate = 72,
+
+		DecorationBlock = 2,
+		DecorationBufferBlock = 3,
+		DecorationArrayStride = 6,
+		DecorationMatrixStride = 7,
+		DecorationBinding = 33,
+		DecorationDescriptorSet = 34,
+		DecorationOffset = 35,
+
+		StorageClassUniformConstant = 0,
+		StorageClassUniform = 2,
+		StorageClassPushConstant = 9,
+		StorageClassStorageBuffer = 12,
+
+		DimBuffer = 5,
+		ImageSampled = 1,
+		ImageStorage = 2
+	};
+
+	struct Type
+	{
+		uint32_t opcode = 0;
+		// Scalar width in bits, component or column count, array length constant, pointer storage
+		// class, image dimension.
+		uint32_t width_or_count = 0;
+		// Component, column, element, pointee or sampled image type. For images, whether the image is
+		// sampled or storage.
+		uint32_t element = 0;
+		std::vector<uint32_t> members;
+	};
+
+	struct Decorations
+	{
+		bool block = false;
+		bool buffer_block = false;
+		uint32_t array_stride = 0;
+		uint32_t set = 0;
+		uint32_t binding = 0;
+	};
+
+	struct MemberDecorations
+	{
+		uint32_t offset = 0;
+		uint32_t matrix_stride = 0;
+	};
+
+	// Literal strings are nul terminated and padded to whole words.
+	static inline std::string ReadString(const uint32_t* words, uint32_t word_count)
+	{
+		const char* chars = reinterpret_cast<const char*>(words);
+		size_t length = 0;
+		while (length < word_count * sizeof(uint32_t) && chars[length] != '\0')
+			length++;
+		return std::string(chars, length);
+	}
+
+	struct Module
+	{
+		std::unordered_map<uint32_t, Type> types;
+		std::unordered_map<uint32_t, uint32_t> constants;
+		std::unordered_map<uint32_t, std::string> names;
+		std::unordered_map<uint32_t, std::vector<std::string>> member_names;
+		std::unordered_map<uint32_t, Decorations> decorations;
+		std::unordered_map<uint32_t, std::vector<MemberDecorations>> member_decorations;
+		// Variable ids in declaration order, and the pointer type of each.
+		std::vector<uint32_t> variables;
+		std::unordered_map<uint32_t, uint32_t> variable_types;
+
+		MemberDecorations& GetMemberDecorations(uint32_t type, uint32_t member)
+		{
+			std::vector<MemberDecorations>& list = member_decorations[type];
+			if (list.size() <= member)
+				list.resize(member + 1);
+			return list[member];
+		}
+
+		const Type* FindType(uint32_t id) const
+		{
+			auto it = types.find(id);
+			return it != types.end() ? &it->second : nullptr;
+		}
+
+		uint32_t GetArrayStride(uint32_t id) const
+		{
+			auto it = decorations.find(id);
+			return it != decorations.end() ? it->second.array_stride : 0;
+		}
+
+		// Size of a type laid out with the given matrix stride, 0 for runtime arrays and unknown types.
+		uint32_t GetSize(uint32_t id, uint32_t matrix_stride) const
+		{
+			const Type* type = FindType(id);
+			if (!type)
+				return 0;
+
+			switch (type->opcode)
+			{
+			case OpTypeInt:
+			case OpTypeFloat:
+				return type->width_or_count / 8;
+			case OpTypeVector:
+				return type->width_or_count * GetSize(type->element, 0);
+			case OpTypeMatrix:
+				return type->width_or_count * (matrix_stride ? matrix_stride : GetSize(type->element, 0));
+			case OpTypeArray:
+			{
+				auto length = constants.find(type->width_or_count);
+				return length != constants.end() ? length->second * GetArrayStride(id) : 0;
+			}
+			case OpTypeStruct:
+			{
+				uint32_t size = 0;
+				for (uint32_t i = 0; i < type->members.size(); i++)
+				{
+					MemberDecorations member = GetMember(id, i);
+					size = std::max(size, member.offset + GetSize(type->members[i], member.matrix_stride));
+				}
+				return size;
+			}
+			default:
+				return 0;
+			}
+		}
+
+		MemberDecorations GetMember(uint32_t type, uint32_t member) const
+		{
+			auto it = member_decorations.find(type);
+			if (it == member_decorations.end() || member >= it->second.size())
+				return {};
+			return it->second[member];
+		}
+
+		// Innermost non-array type, used to find structs nested in arrays.
+		uint32_t StripArrays(uint32_t id) const
+		{
+			const Type* type = FindType(id);
+			while (type && (type->opcode == OpTypeArray || type->opcode == OpTypeRuntimeArray))
+			{
+				id = type->element;
+				type = FindType(id);
+			}
+			return id;
+		}
+	};
+
+	static inline void AddStruct(const Module& module, uint32_t id, SpirvReflection& reflection, std::unordered_map<uint32_t, uint32_t>& struct_indices)
+	{
+		if (struct_indices.count(id))
+			return;
+
+		const Type& type = module.types.at(id);
+
+		SpirvStruct result;
+		result.id = id;
+		auto name = module.names.find(id);
+		if (name != module.names.end())
+			result.name = name->second;
+		result.size = module.GetSize(id, 0);
+
+		auto member_names = module.member_names.find(id);
+		for (uint32_t i = 0; i < type.members.size(); i++)
+		{
+			MemberDecorations decorations = module.GetMember(id, i);
+
+			SpirvMember member;
+			if (member_names != module.member_names.end() && i < member_names->second.size())
+				member.name = member_names->second[i];
+			member.type_id = type.members[i];
+			member.offset = decorations.offset;
+			member.size = module.GetSize(type.members[i], decorations.matrix_stride);
+			member.array_stride = module.GetArrayStride(type.members[i]);
+			result.members.push_back(std::move(member));
+		}
+
+		struct_indices[id] = static_cast<uint32_t>(reflection.structs.size());
+		reflection.structs.push_back(std::move(result));
+
+		for (uint32_t member : type.members)
+		{
+			uint32_t element = module.StripArrays(member);
+			const Type* element_type = module.FindType(element);
+			if (element_type && element_type->opcode == OpTypeStruct)
+				AddStruct(module, element, reflection, struct_indices);
+		}
+	}
+}
+
+// Returns false if code is not a SPIR-V module or is truncated.
+static inline bool ReflectSpirv(const uint32_t* code, size_t word_count, SpirvReflection& reflection)
+{
+	using namespace SpirvDetail;
+
+	reflection = {};
+	if (word_count < 5 || code[0] != Magic)
+		return false;
+
+	Module module;
+
+	size_t offset = 5;
+	while (offset < word_count)
+	{
+		uint32_t opcode = code[offset] & 0xffff;
+		uint32_t length = code[offset] >> 16;
+		if (length == 0 || offset + length > word_count)
+			return false;
+
+		const uint32_t* ops = code + offset + 1;
+		uint32_t op_count = length - 1;
+
+		switch (opcode)
+		{
+		case OpName:
+			if (op_count >= 2)
+				module.names[ops[0]] = ReadString(ops + 1, op_count - 1);
+			break;
+
+		case OpMemberName:
+			if (op_count >= 3)
+			{
+				std::vector<std::string>& names = module.member_names[ops[0]];
+				if (names.size() <= ops[1])
+					names.resize(ops[1] + 1);
+				names[ops[1]] = ReadString(ops + 2, op_count - 2);
+			}
+			break;
+
+		case OpTypeInt:
+		case OpTypeFloat:
+			if (op_count >= 2)
+				module.types[ops[0]] = { opcode, ops[1], 0, {} };
+			break;
+
+		case OpTypeVector:
+		case OpTypeMatrix:
+		case OpTypeArray:
+			if (op_count >= 3)
+				module.types[ops[0]] = { opcode, ops[2], ops[1], {} };
+			break;
+
+		case OpTypeRuntimeArray:
+			if (op_count >= 2)
+				module.types[ops[0]] = { opcode, 0, ops[1], {} };
+			break;
+
+		case OpTypeStruct:
+			if (op_count >= 1)
+				module.types[ops[0]] = { opcode, 0, 0, std::vector<uint32_t>(ops + 1, ops + op_count) };
+			break;
+
+		case OpTypePointer:
+			if (op_count >= 3)
+				module.types[ops[0]] = { opcode, ops[1], ops[2], {} };
+			break;
+
+		case OpTypeImage:
+			if (op_count >= 7)
+				module.types[ops[0]] = { opcode, ops[2], ops[6], {} };
+			break;
+
+		case OpTypeSampler:
+			if (op_count >= 1)
+				module.types[ops[0]] = { opcode, 0, 0, {} };
+			break;
+
+		case OpTypeSampledImage:
+			if (op_count >= 2)
+				module.types[ops[0]] = { opcode, 0, ops[1], {} };
+			break;
+
+		case OpConstant:
+			// Array lengths are 32-bit integer constants, wider constants only need their low word.
+			if (op_count >= 3)
+				module.constants[ops[1]] = ops[2];
+			break;
+
+		case OpVariable:
+			if (op_count >= 3)
+			{
+				module.variables.push_back(ops[1]);
+				module.variable_types[ops[1]] = ops[0];
+			}
+			break;
+
+		case OpDecorate:
+			if (op_count >= 2)
+			{
+				Decorations& decorations = module.decorations[ops[0]];
+				uint32_t value = op_count >= 3 ? ops[2] : 0;
+				switch (ops[1])
+				{
+				case DecorationBlock: decorations.block = true; break;
+				case DecorationBufferBlock: decorations.buffer_block = true; break;
+				case DecorationArrayStride: decorations.array_stride = value; break;
+				case DecorationDescriptorSet: decorations.set = value; break;
+				case DecorationBinding: decorations.binding = value; break;
+				default: break;
+				}
+			}
+			break;
+
+		case OpMemberDecorate:
+			if (op_count >= 4)
+			{
+				if (ops[2] == DecorationOffset)
+					module.GetMemberDecorations(ops[0], ops[1]).offset = ops[3];
+				else if (ops[2] == DecorationMatrixStride)
+					module.GetMemberDecorations(ops[0], ops[1]).matrix_stride = ops[3];
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		offset += length;
+	}
+
+	std::unordered_map<uint32_t, uint32_t> struct_indices;
+
+	for (uint32_t variable : module.variables)
+	{
+		const Type* pointer = module.FindType(module.variable_types[variable]);
+		if (!pointer || pointer->opcode != OpTypePointer)
+			continue;
+
+		// Arrays of descriptors share one element type.
+		uint32_t struct_id = module.StripArrays(pointer->element);
+		const Type* type = module.FindType(struct_id);
+		if (!type)
+			continue;
+
+		const Decorations& type_decorations = module.decorations[struct_id];
+		const Decorations& variable_decorations = module.decorations[variable];
+
+		SpirvDescriptor descriptor;
+		descriptor.set = variable_decorations.set;
+		descriptor.binding = variable_decorations.binding;
+
+		const Type* array = module.FindType(pointer->element);
+		if (array && array->opcode == OpTypeArray)
+		{
+			auto length = module.constants.find(array->width_or_count);
+			descriptor.array_size = length != module.constants.end() ? length->second : 1;
+		}
+		else if (array && array->opcode == OpTypeRuntimeArray)
+		{
+			descriptor.array_size = 0;
+		}
+
+		if (pointer->width_or_count == StorageClassUniformConstant)
+		{
+			auto name = module.names.find(variable);
+			if (name != module.names.end())
+				descriptor.name = name->second;
+
+			const Type* image = type->opcode == OpTypeSampledImage ? module.FindType(type->element) : type;
+			if (!image)
+				continue;
+
+			if (type->opcode == OpTypeSampler)
+				descriptor.type = SpirvDescriptorType::Sampler;
+			else if (type->opcode == OpTypeSampledImage)
+				descriptor.type = image->width_or_count == DimBuffer ? SpirvDescriptorType::UniformTexelBuffer : SpirvDescriptorType::SampledTexture;
+			else if (type->opcode == OpTypeImage && image->element == ImageStorage)
+				descriptor.type = image->width_or_count == DimBuffer ? SpirvDescriptorType::StorageTexelBuffer : SpirvDescriptorType::StorageImage;
+			else if (type->opcode == OpTypeImage && image->element == ImageSampled)
+				descriptor.type = image->width_or_count == DimBuffer ? SpirvDescriptorType::UniformTexelBuffer : SpirvDescriptorType::SampledImage;
+			else
+				continue;
+
+			reflection.descriptors.push_back(std::move(descriptor));
+			continue;
+		}
+
+		if (type->opcode != OpTypeStruct)
+			continue;
+
+		SpirvBlock block;
+		block.set = variable_decorations.set;
+		block.binding = variable_decorations.binding;
+
+		if (pointer->width_or_count == StorageClassPushConstant)
+			block.kind = SpirvBlockKind::PushConstant;
+		else if (pointer->width_or_count == StorageClassStorageBuffer || (pointer->width_or_count == StorageClassUniform && type_decorations.buffer_block))
+			block.kind = SpirvBlockKind::Storage;
+		else if (pointer->width_or_count == StorageClassUniform && type_decorations.block)
+			block.kind = SpirvBlockKind::Uniform;
+		else
+			continue;
+
+		AddStruct(module, struct_id, reflection, struct_indices);
+		block.struct_index = struct_indices[struct_id];
+		reflection.blocks.push_back(block);
+
+		const SpirvStruct& block_struct = reflection.structs[block.struct_index];
+
+		if (block.kind == SpirvBlockKind::PushConstant)
+		{
+			reflection.push_constant_size = std::max(reflection.push_constant_size, block_struct.size);
+			continue;
+		}
+
+		descriptor.name = block_struct.name;
+		descriptor.type = block.kind == SpirvBlockKind::Storage ? SpirvDescriptorType::StorageBuffer : SpirvDescriptorType::UniformBuffer;
+		descriptor.block_size = block_struct.size;
+		reflection.descriptors.push_back(std::move(descriptor));
+	}
+
+	return true;
+}
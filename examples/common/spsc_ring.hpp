@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Fixed capacity queue between exactly one producer thread and one consumer thread, without locks:
+// each side owns one index and only reads the other's. The indices are on separate cache lines,
+// and each side caches the other's last seen index, so the common case touches no shared line.
+template<typename T, uint32_t capacity>
+struct SpscRing
+{
+	static_assert(capacity != 0 && (capacity & (capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+	// Producer only. Returns false if the ring is full.
+	bool Push(const T& value)
+	{
+		uint32_t write = tail.load(std::memory_order_relaxed);
+		if (write - head_seen == capacity)
+		{
+			head_seen = head.load(std::memory_order_acquire);
+			if (write - head_seen == capacity)
+				return false;
+		}
+
+		items[write & (capacity - 1)] = value;
+		tail.store(write + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. Returns false if the ring is empty.
+	bool Pop(T& value)
+	{
+		uint32_t read = head.load(std::memory_order_relaxed);
+		if (read == tail_seen)
+		{
+			tail_seen = tail.load(std::memory_order_acquire);
+			if (read == tail_seen)
+				return false;
+		}
+
+		value = items[read & (capacity - 1)];
+		head.store(read + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+
+	// Written by the consumer.
+	alignas(64) std::atomic<uint32_t> head{ 0 };
+	uint32_t tail_seen = 0;
+
+	// Written by the producer.
+	alignas(64) std::atomic<uint32_t> tail{ 0 };
+	uint32_t head_seen = 0;
+
+	alignas(64) T items[capacity];
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+
+// Geometry that never changes after load. It is uploaded once into device local buffers, so
+// examples bind it every frame instead of re-uploading it through AllocateVertexData.
+struct StaticGeometry
+{
+	Vulkan::BufferHandle vertex_buffer;
+	Vulkan::BufferHandle index_buffer;
+
+	uint32_t vertex_count = 0;
+	uint32_t index_count = 0;
+
+	void Bind(Vulkan::CommandBuffer& cmd) const
+	{
+		cmd.BindVertexBuffer(0, *vertex_buffer, 0);
+		if (index_buffer)
+			cmd.BindIndexBuffer(*index_buffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+
+	void Draw(Vulkan::CommandBuffer& cmd) const
+	{
+		if (index_buffer)
+			cmd.DrawIndexed(index_count);
+		else
+			cmd.Draw(vertex_count);
+	}
+
+	void Reset()
+	{
+		vertex_buffer.Reset();
+		index_buffer.Reset();
+		vertex_count = 0;
+		index_count = 0;
+	}
+};
+
+static Vulkan::BufferHandle CreateStaticBuffer(Vulkan::Device& device, VkBufferUsageFlags usage, VkDeviceSize size, const void* data)
+{
+	Vulkan::BufferCreateInfo create_info{};
+	create_info.domain = Vulkan::BufferDomain::Device;
+	create_info.size = size;
+	create_info.usage = usage;
+	create_info.sharing_mode = Vulkan::BufferSharingMode::Exclusive;
+	create_info.exclusive_owner = Vulkan::BUFFER_COMMAND_QUEUE_GENERIC;
+
+	return device.CreateBuffer(create_info, data);
+}
+
+// Uploads vertices, and optionally 32-bit indices, once.
+template<typename VertexType>
+static StaticGeometry CreateStaticGeometry(Vulkan::Device& device, const std::vector<VertexType>& vertices, const std::vector<uint32_t>& indices = {})
+{
+	StaticGeometry geometry;
+
+	geometry.vertex_count = static_cast<uint32_t>(vertices.size());
+	geometry.vertex_buffer = CreateStaticBuffer(device, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, sizeof(VertexType) * vertices.size(), vertices.data());
+
+	if (!indices.empty())
+	{
+		geometry.index_count = static_cast<uint32_t>(indices.size());
+		geometry.index_buffer = CreateStaticBuffer(device, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sizeof(uint32_t) * indices.size(), indices.data());
+	}
+
+	return geometry;
+}
+
+// Draws a single triangle covering the whole viewport. Positions are derived from gl_VertexIndex in
+// glsl/fullscreen.vert, so no vertex buffer or vertex attributes are needed.
+static inline void DrawFullscreenTriangle(Vulkan::CommandBuffer& cmd)
+{
+	cmd.SetPrimitiveTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	cmd.SetCullMode(VK_CULL_MODE_NONE);
+	cmd.Draw(3);
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// Compile time std140/std430 layout checks for host copies of shader blocks. A host struct that
+// passes IsPacked() has every member exactly where the rule puts it and no slack past the block's
+// rounded size, so it can be memcpy'd into a buffer in one shot, alone or as an array element.
+//
+//	static constexpr auto layout = StdLayout::Describe<Params>(QM_EXAMPLES_LAYOUT_MEMBER(Params, a), QM_EXAMPLES_LAYOUT_MEMBER(Params, b));
+//	static_assert(layout.IsPacked(StdLayout::Std140), "Params must follow std140");
+//
+// List only the members the GLSL declares. Explicit tail padding may be left out.
+
+// Block layouts reflected from the compiled shaders, generated by add_example_shaders(). Matches()
+// checks a host layout against them.
+#include "shaders/shader_layouts.hpp"
+
+namespace StdLayout
+{
+	enum Rule
+	{
+		Std140,
+		Std430,
+		RuleCount
+	};
+
+	constexpr size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// Base alignment and size of the GLSL type a host type stands for. Specialized below for
+	// scalars, vectors, column major matrices and arrays of those.
+	template<typename T>
+	struct TypeLayout;
+
+	template<size_t scalar_size, size_t components>
+	struct VectorLayout
+	{
+		// Three component vectors align like four, but only occupy three.
+		static constexpr size_t alignment[RuleCount] = { scalar_size * (components == 3 ? 4 : components), scalar_size * (components == 3 ? 4 : components) };
+		static constexpr size_t size[RuleCount] = { scalar_size * components, scalar_size * components };
+	};
+
+	// A matrix is an array of its columns.
+	template<size_t columns, size_t rows>
+	struct MatrixLayout
+	{
+		static constexpr size_t column_alignment = 4 * (rows == 3 ? 4 : rows);
+		static constexpr size_t alignment[RuleCount] = { column_alignment < 16 ? 16 : column_alignment, column_alignment };
+		static constexpr size_t size[RuleCount] = { columns * alignment[Std140], columns * alignment[Std430] };
+	};
+
+	template<> struct TypeLayout<float> : VectorLayout<4, 1> {};
+	template<> struct TypeLayout<int32_t> : VectorLayout<4, 1> {};
+	template<> struct TypeLayout<uint32_t> : VectorLayout<4, 1> {};
+	template<> struct TypeLayout<glm::vec2> : VectorLayout<4, 2> {};
+	template<> struct TypeLayout<glm::vec3> : VectorLayout<4, 3> {};
+	template<> struct TypeLayout<glm::vec4> : VectorLayout<4, 4> {};
+	template<> struct TypeLayout<glm::ivec2> : VectorLayout<4, 2> {};
+	template<> struct TypeLayout<glm::ivec3> : VectorLayout<4, 3> {};
+	template<> struct TypeLayout<glm::ivec4> : VectorLayout<4, 4> {};
+	template<> struct TypeLayout<glm::uvec2> : VectorLayout<4, 2> {};
+	template<> struct TypeLayout<glm::uvec3> : VectorLayout<4, 3> {};
+	template<> struct TypeLayout<glm::uvec4> : VectorLayout<4, 4> {};
+	template<> struct TypeLayout<glm::mat2> : MatrixLayout<2, 2> {};
+	template<> struct TypeLayout<glm::mat3> : MatrixLayout<3, 3> {};
+	template<> struct TypeLayout<glm::mat4> : MatrixLayout<4, 4> {};
+
+	// std140 rounds the element alignment, and so the stride, up to a vec4. std430 does not.
+	template<typename T, size_t count>
+	struct TypeLayout<T[count]>
+	{
+		static constexpr size_t alignment[RuleCount] = { AlignUp(TypeLayout<T>::alignment[Std140], 16), TypeLayout<T>::alignment[Std430] };
+		static constexpr size_t stride[RuleCount] = { AlignUp(TypeLayout<T>::size[Std140], alignment[Std140]), AlignUp(TypeLayout<T>::size[Std430], alignment[Std430]) };
+		static constexpr size_t size[RuleCount] = { stride[Std140] * count, stride[Std430] * count };
+	};
+
+	struct MemberLayout
+	{
+		size_t offset;
+		size_t host_size;
+		size_t alignment[RuleCount];
+		size_t size[RuleCount];
+	};
+
+	template<typename T>
+	constexpr MemberLayout DescribeMember(size_t offset)
+	{
+		return { offset, sizeof(T), { TypeLayout<T>::alignment[Std140], TypeLayout<T>::alignment[Std430] }, { TypeLayout<T>::size[Std140], TypeLayout<T>::size[Std430] } };
+	}
+
+	template<size_t member_count>
+	struct HostLayout
+	{
+		size_t host_size;
+		MemberLayout members[member_count];
+
+		// Offset the rule gives member i.
+		constexpr size_t GetOffset(Rule rule, size_t i) const
+		{
+			size_t offset = 0;
+			for (size_t m = 0; m <= i; m++)
+				offset = AlignUp(m == 0 ? 0 : offset + members[m - 1].size[rule], members[m].alignment[rule]);
+			return offset;
+		}
+
+		// Structs align to their most aligned member, rounded up to a vec4 under std140.
+		constexpr size_t GetAlignment(Rule rule) const
+		{
+			size_t alignment = rule == Std140 ? 16 : 1;
+			for (size_t m = 0; m < member_count; m++)
+				alignment = members[m].alignment[rule] > alignment ? members[m].alignment[rule] : alignment;
+			return alignment;
+		}
+
+		// Size the rule gives the struct, which is also its stride in arrays.
+		constexpr size_t GetSize(Rule rule) const
+		{
+			return AlignUp(GetOffset(rule, member_count - 1) + members[member_count - 1].size[rule], GetAlignment(rule));
+		}
+
+		constexpr bool IsPacked(Rule rule) const
+		{
+			for (size_t m = 0; m < member_count; m++)
+			{
+				if (members[m].offset != GetOffset(rule, m) || members[m].host_size != members[m].size[rule])
+					return false;
+			}
+			return host_size == GetSize(rule);
+		}
+
+		// Reflected is one of the generated ShaderLayouts types. Member offsets must match one to
+		// one, and the host struct must cover the whole block.
+		template<typename Reflected>
+		constexpr bool Matches() const
+		{
+			if (Reflected::member_count != member_count || host_size < Reflected::size)
+				return false;
+			for (size_t m = 0; m < member_count; m++)
+			{
+				if (members[m].offset != Reflected::offsets[m])
+					return false;
+			}
+			return true;
+		}
+	};
+
+	template<typename Struct, typename... Members>
+	constexpr HostLayout<sizeof...(Members)> Describe(Members... members)
+	{
+		return { sizeof(Struct), { members... } };
+	}
+}
+
+#define QM_EXAMPLES_LAYOUT_MEMBER(Struct, member) StdLayout::DescribeMember<decltype(Struct::member)>(offsetof(Struct, member))
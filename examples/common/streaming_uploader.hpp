@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "static_geometry.hpp"
+#include "upload_scheduler.hpp"
+
+// Uploads buffers and images in the background of rendering instead of before it. Data is queued
+// on the CPU, and every frame up to a byte budget of it is staged through a persistently mapped
+// ring (see UploadScheduler) and copied on the async transfer queue. The generic queue waits on
+// the transfer submission's semaphore before the frame's own work, so anything the scheduler
+// reports complete may be used by commands recorded after Flush().
+//
+// Destinations are created with concurrent sharing, so they need no queue family ownership
+// transfer between the two queues; the semaphore alone orders the copy before its use.
+struct StreamingUploader
+{
+	void Init(Vulkan::Device& device_, VkDeviceSize frame_budget)
+	{
+		device = &device_;
+		scheduler.Init(frame_budget, std::max(1u, device->GetNumFrameContexts()));
+
+		Vulkan::BufferCreateInfo create_info{};
+		create_info.domain = Vulkan::BufferDomain::Host;
+		create_info.size = scheduler.GetRingSize();
+		create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		create_info.sharing_mode = Vulkan::BufferSharingMode::Exclusive;
+		create_info.exclusive_owner = Vulkan::BUFFER_COMMAND_QUEUE_ASYNC_TRANSFER;
+
+		ring = device->CreateBuffer(create_info);
+		mapped = static_cast<uint8_t*>(device->MapHostBuffer(*ring, Vulkan::MEMORY_ACCESS_WRITE_BIT));
+	}
+
+	// Device local buffer with nothing in it yet, for UploadBuffer().
+	Vulkan::BufferHandle CreateBuffer(VkBufferUsageFlags usage, VkDeviceSize size)
+	{
+		Vulkan::BufferCreateInfo create_info{};
+		create_info.domain = Vulkan::BufferDomain::Device;
+		create_info.size = size;
+		create_info.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		create_info.sharing_mode = Vulkan::BufferSharingMode::Concurrent;
+
+		return device->CreateBuffer(create_info);
+	}
+
+	// Sampled RGBA8 sRGB image with a single level and nothing in it yet, for UploadImage().
+	Vulkan::ImageHandle CreateImage(uint32_t width, uint32_t height)
+	{
+		Vulkan::ImageCreateInfo create_info = Vulkan::ImageCreateInfo::Immutable2dImage(width, height, VK_FORMAT_R8G8B8A8_SRGB, false);
+		create_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		create_info.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		create_info.sharing_mode = Vulkan::ImageSharingMode::Concurrent;
+
+		return device->CreateImage(create_info);
+	}
+
+	// Queues size bytes of data for dst at dst_offset. The data is copied, and the destination
+	// must stay alive until the returned ticket completes.
+	uint64_t UploadBuffer(const Vulkan::Buffer& dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size)
+	{
+		uint64_t ticket = scheduler.Enqueue(size);
+		if (ticket == 0)
+			return 0;
+
+		Pending& pending = pending_uploads[ticket];
+		pending.buffer = &dst;
+		pending.dst_offset = dst_offset;
+		pending.data.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+		return ticket;
+	}
+
+	// Queues tightly packed RGBA8 texels for level 0 of image. Pieces are whole rows, and the image
+	// is in SHADER_READ_ONLY_OPTIMAL once the ticket completes.
+	uint64_t UploadImage(const Vulkan::Image& dst, uint32_t width, uint32_t height, const void* texels)
+	{
+		VkDeviceSize row_size = VkDeviceSize(width) * 4;
+		uint64_t ticket = scheduler.Enqueue(row_size * height, row_size);
+		if (ticket == 0)
+			return 0;
+
+		Pending& pending = pending_uploads[ticket];
+		pending.image = &dst;
+		pending.width = width;
+		pending.height = height;
+		pending.data.assign(static_cast<const uint8_t*>(texels), static_cast<const uint8_t*>(texels) + row_size * height);
+		return ticket;
+	}
+
+	// Stages and submits this frame's share of the queued uploads. Call once per frame, after
+	// WSI::BeginFrame() and before recording work that uses uploads.
+	void Flush()
+	{
+		scheduler.BeginFrame(chunks);
+		if (chunks.empty())
+			return;
+
+		auto cmd = device->RequestCommandBuffer(Vulkan::CommandBuffer::Type::AsyncTransfer);
+
+		for (const UploadScheduler::Chunk& chunk : chunks)
+		{
+			auto it = pending_uploads.find(chunk.ticket);
+			Pending& pending = it->second;
+
+			std::memcpy(mapped + chunk.ring_offset, pending.data.data() + chunk.offset, chunk.size);
+
+			if (pending.buffer)
+			{
+				if (chunk.size != 0)
+					cmd->CopyBuffer(*pending.buffer, pending.dst_offset + chunk.offset, *ring, chunk.ring_offset, chunk.size);
+			}
+			else
+			{
+				if (chunk.first)
+				{
+					cmd->ImageBarrier(*pending.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+						VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+				}
+
+				VkDeviceSize row_size = VkDeviceSize(pending.width) * 4;
+				uint32_t first_row = static_cast<uint32_t>(chunk.offset / row_size);
+				uint32_t rows = static_cast<uint32_t>(chunk.size / row_size);
+				if (rows != 0)
+					cmd->CopyBufferToImage(*pending.image, *ring, chunk.ring_offset, { 0, int32_t(first_row), 0 }, { pending.width, rows, 1 }, 0, 0, 0, 0, 1);
+
+				// The transfer queue can't name the shader stages that read the image, the semaphore
+				// wait on the generic queue orders those.
+				if (chunk.last)
+				{
+					cmd->ImageBarrier(*pending.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+						VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+				}
+			}
+
+			if (chunk.last)
+				pending_uploads.erase(it);
+		}
+
+		Vulkan::SemaphoreHandle semaphore;
+		device->Submit(cmd, nullptr, 1, &semaphore);
+		device->AddWaitSemaphore(Vulkan::CommandBuffer::Type::Generic, semaphore,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+	}
+
+	bool IsComplete(uint64_t ticket) const
+	{
+		return scheduler.IsComplete(ticket);
+	}
+
+	bool IsIdle() const
+	{
+		return scheduler.IsIdle();
+	}
+
+	void LogStats() const
+	{
+		const UploadScheduler::Stats& stats = scheduler.GetStats();
+		QM_LOG_INFO("Streaming: %llu of %llu uploads done, %llu bytes over %llu frames, peak %llu bytes in a frame (budget %llu), "
+			"%.1f frames average latency\n", static_cast<unsigned long long>(stats.completed), static_cast<unsigned long long>(stats.requests),
+			static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.busy_frames),
+			static_cast<unsigned long long>(stats.peak_frame_bytes), static_cast<unsigned long long>(scheduler.GetFrameBudget()),
+			stats.completed ? double(stats.latency_frames) / stats.completed : 0.0);
+	}
+
+	void Reset()
+	{
+		if (ring)
+			device->UnmapHostBuffer(*ring, Vulkan::MEMORY_ACCESS_WRITE_BIT);
+		ring.Reset();
+		mapped = nullptr;
+		pending_uploads.clear();
+	}
+
+private:
+
+	struct Pending
+	{
+		const Vulkan::Buffer* buffer = nullptr;
+		VkDeviceSize dst_offset = 0;
+		const Vulkan::Image* image = nullptr;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<uint8_t> data;
+	};
+
+	Vulkan::Device* device = nullptr;
+	Vulkan::BufferHandle ring;
+	uint8_t* mapped = nullptr;
+
+	UploadScheduler scheduler;
+	std::vector<UploadScheduler::Chunk> chunks;
+	std::unordered_map<uint64_t, Pending> pending_uploads;
+};
+
+// Static geometry whose buffers fill in over the next frames. Draw it once IsComplete(ticket).
+template<typename VertexType>
+static StaticGeometry CreateStreamedGeometry(StreamingUploader& uploader, const std::vector<VertexType>& vertices, const std::vector<uint32_t>& indices, uint64_t& ticket)
+{
+	StaticGeometry geometry;
+
+	geometry.vertex_count = static_cast<uint32_t>(vertices.size());
+	geometry.vertex_buffer = uploader.CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, sizeof(VertexType) * vertices.size());
+	ticket = uploader.UploadBuffer(*geometry.vertex_buffer, 0, vertices.data(), sizeof(VertexType) * vertices.size());
+
+	if (!indices.empty())
+	{
+		geometry.index_count = static_cast<uint32_t>(indices.size());
+		geometry.index_buffer = uploader.CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sizeof(uint32_t) * indices.size());
+		// Tickets complete in order, the last one covers both.
+		ticket = uploader.UploadBuffer(*geometry.index_buffer, 0, indices.data(), sizeof(uint32_t) * indices.size());
+	}
+
+	return geometry;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// A range of a mesh's index buffer drawn with one material. Indices refer to the vertices of the
+// whole mesh, so every submesh of a mesh shares one vertex buffer.
+struct Submesh
+{
+	uint32_t first_index = 0;
+	uint32_t index_count = 0;
+	uint32_t material = 0;
+	// Shape (OBJ "o"/"g" group) the triangles came from.
+	uint32_t shape = 0;
+
+	glm::vec3 bounds_min = glm::vec3(0.0f);
+	glm::vec3 bounds_max = glm::vec3(0.0f);
+	// xyz = center of the bounds, w = radius around it covering every vertex.
+	glm::vec4 sphere = glm::vec4(0.0f);
+};
+
+// Fills the bounds of submesh from the vertices its indices reference.
+template<typename VertexType>
+static void ComputeSubmeshBounds(const std::vector<VertexType>& vertices, const std::vector<uint32_t>& indices, Submesh& submesh)
+{
+	if (submesh.index_count == 0)
+	{
+		submesh.bounds_min = submesh.bounds_max = glm::vec3(0.0f);
+		submesh.sphere = glm::vec4(0.0f);
+		return;
+	}
+
+	const uint32_t* begin = indices.data() + submesh.first_index;
+	const uint32_t* end = begin + submesh.index_count;
+
+	submesh.bounds_min = submesh.bounds_max = vertices[*begin].position;
+	for (const uint32_t* index = begin; index != end; index++)
+	{
+		submesh.bounds_min = glm::min(submesh.bounds_min, vertices[*index].position);
+		submesh.bounds_max = glm::max(submesh.bounds_max, vertices[*index].position);
+	}
+
+	glm::vec3 center = (submesh.bounds_min + submesh.bounds_max) * 0.5f;
+	float radius = 0.0f;
+	for (const uint32_t* index = begin; index != end; index++)
+		radius = std::max(radius, glm::length(vertices[*index].position - center));
+
+	submesh.sphere = glm::vec4(center, radius);
+}
+
+// Number of times consecutive submeshes switch material, which is the number of material binds a
+// renderer drawing them in order needs beyond the first.
+static inline uint32_t CountMaterialChanges(const std::vector<Submesh>& submeshes)
+{
+	uint32_t changes = 0;
+	for (size_t i = 1; i < submeshes.size(); i++)
+		changes += submeshes[i].material != submeshes[i - 1].material ? 1 : 0;
+	return changes;
+}
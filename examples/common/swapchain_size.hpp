@@ -0,0 +1,33 @@
+#pragma once
+
+// Swapchain size as of the last frame, so size dependent state is only rebuilt when it changes.
+struct SwapchainSize
+{
+	// Call after WSI::BeginFrame(). Returns true on the first call and whenever the swapchain
+	// changed size since the last one, when size dependent state must be rebuilt. The size is
+	// compared every frame: the WSI also recreates the swapchain without a window resize (out of
+	// date or suboptimal swapchains, present mode changes, a lost surface), and the new one may
+	// have another size.
+	bool Update(Vulkan::Device& device)
+	{
+		uint32_t new_width = device.GetSwapchainWidth();
+		uint32_t new_height = device.GetSwapchainHeight();
+		if (changes != 0 && new_width == width && new_height == height)
+			return false;
+
+		width = new_width;
+		height = new_height;
+		changes++;
+		return true;
+	}
+
+	float GetAspect() const
+	{
+		return height != 0 ? float(width) / float(height) : 1.0f;
+	}
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// Times the size changed, the first one included.
+	uint32_t changes = 0;
+};
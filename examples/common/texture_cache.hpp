@@ -0,0 +1,582 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "allocation_tracker.hpp"
+#include "file_loader.hpp"
+
+// Uploads an RGBA8 sRGB image with a full mip chain, and returns a view of it.
+static Vulkan::ImageViewHandle CreateTextureView(Vulkan::Device& device, uint32_t width, uint32_t height, const void* pixels, Vulkan::ImageHandle& image)
+{
+	Vulkan::ImageCreateInfo create_info = Vulkan::ImageCreateInfo::Immutable2dImage(width, height, VK_FORMAT_R8G8B8A8_SRGB, true);
+	create_info.sharing_mode = Vulkan::ImageSharingMode::Exclusive;
+	create_info.exclusive_owner = Vulkan::IMAGE_COMMAND_QUEUE_GENERIC;
+
+	Vulkan::ImageStagingCopyInfo copy{};
+	copy.image_extent.width = width;
+	copy.image_extent.height = height;
+	copy.image_extent.depth = 1;
+	copy.num_layers = 1;
+
+	image = device.CreateImage(create_info, uint64_t(width) * height * 4, pixels, 1, &copy);
+	if (!image)
+		return {};
+
+	Vulkan::ImageViewCreateInfo view_info{};
+	view_info.image = image;
+	view_info.view_type = VK_IMAGE_VIEW_TYPE_2D;
+
+	return device.CreateImageView(view_info);
+}
+
+// Decoded textures keyed by a hash of their file's contents, so a file loaded twice, or copied
+// under another name, is read from disk and decoded once.
+//
+// Two tiers have their own byte budget and least recently used order: decoded RGBA8 pixels in
+// RAM, and images with mips in VRAM. Going over a budget evicts the least recently used entries
+// of that tier. An image is only evicted once nothing holds it (see Acquire() and Release()), and
+// QuantumVk frees it after the frames still using it complete. An evicted entry keeps its path,
+// so Prefetch() can decode it again on the loader thread before it is needed.
+//
+// A path is only hashed again when its size or modification time change. Everything except the
+// loader thread must be used from one thread.
+struct TextureCache
+{
+	static constexpr uint32_t invalid_id = ~0u;
+
+	struct Stats
+	{
+		// Requests served from memory and requests that decoded the file. Content hits are the hits
+		// of a path that had to be read, whose contents were in memory under another path.
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t content_hits = 0;
+		uint64_t ram_evictions = 0;
+		uint64_t vram_evictions = 0;
+		// Files decoded on the loader thread, and requests that had to wait for one.
+		uint64_t async_loads = 0;
+		uint64_t async_waits = 0;
+		uint64_t ram_bytes = 0;
+		uint64_t vram_bytes = 0;
+		uint64_t peak_ram_bytes = 0;
+		uint64_t peak_vram_bytes = 0;
+	};
+
+	TextureCache() = default;
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	~TextureCache()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			shutdown = true;
+		}
+		queued_cond.notify_all();
+
+		if (loader.joinable())
+			loader.join();
+	}
+
+	// device may be null when only LoadPixels() is used.
+	void Init(Vulkan::Device* device_, uint64_t ram_budget_, uint64_t vram_budget_)
+	{
+		device = device_;
+		ram_budget = ram_budget_;
+		vram_budget = vram_budget_;
+	}
+
+	// Reads and decodes path on the loader thread, unless its contents are already in RAM.
+	void Prefetch(const std::string& path)
+	{
+		AllocationScope allocation_scope(AllocationTag::Texture);
+
+		const Entry* entry = FindCurrent(path);
+		if (entry && !entry->pixels.empty())
+			return;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!in_flight.insert(path).second)
+			return;
+
+		queued.push_back(path);
+		if (!loader.joinable())
+			loader = std::thread(&TextureCache::LoaderLoop, this);
+		queued_cond.notify_one();
+	}
+
+	// Decoded RGBA8 pixels of path, or nullptr if it can't be loaded. The pixels stay valid until
+	// the next call into the cache.
+	const std::vector<uint8_t>* LoadPixels(const std::string& path, uint32_t& width, uint32_t& height)
+	{
+		AllocationScope allocation_scope(AllocationTag::Texture);
+
+		uint32_t id = LoadEntry(path);
+		if (id == invalid_id)
+			return nullptr;
+
+		Entry& entry = entries[id];
+		width = entry.width;
+		height = entry.height;
+		return &entry.pixels;
+	}
+
+	// Image of path with a full mip chain, held until Release(id). Returns invalid_id if it can't
+	// be loaded.
+	uint32_t Acquire(const std::string& path)
+	{
+		AllocationScope allocation_scope(AllocationTag::Texture);
+
+		MergeLoaded();
+
+		Entry* current = FindCurrent(path);
+		if (current && current->view)
+		{
+			stats.hits++;
+			Hold(*current);
+			return current->id;
+		}
+
+		uint32_t id = LoadEntry(path);
+		if (id == invalid_id)
+			return invalid_id;
+
+		Entry& entry = entries[id];
+		if (!entry.view)
+		{
+			entry.view = CreateTextureView(*device, entry.width, entry.height, entry.pixels.data(), entry.image);
+			if (!entry.view)
+			{
+				QM_LOG_ERROR("Failed to create an image for %s\n", path.c_str());
+				return invalid_id;
+			}
+
+			// A full mip chain adds a third.
+			entry.vram_bytes = uint64_t(entry.width) * entry.height * 4 * 4 / 3;
+			AddBytes(stats.vram_bytes, stats.peak_vram_bytes, entry.vram_bytes);
+		}
+
+		Hold(entry);
+		EvictVram();
+		return id;
+	}
+
+	const Vulkan::ImageView* GetView(uint32_t id) const
+	{
+		return id < entries.size() && entries[id].view ? &*entries[id].view : nullptr;
+	}
+
+	// Lets the image of an Acquire() be evicted again once the VRAM budget needs the space.
+	void Release(uint32_t id)
+	{
+		if (id >= entries.size() || entries[id].holds == 0)
+			return;
+
+		Entry& entry = entries[id];
+		if (--entry.holds == 0)
+		{
+			vram_lru.push_back(id);
+			entry.vram_position = std::prev(vram_lru.end());
+			entry.on_vram_lru = true;
+			EvictVram();
+		}
+	}
+
+	const Stats& GetStats() const
+	{
+		return stats;
+	}
+
+	void LogStats() const
+	{
+		QM_LOG_INFO("Texture cache: %llu hits, %llu misses (%llu served by identical contents), %llu async loads (%llu waited on), "
+			"%llu RAM and %llu VRAM evictions, %.1f of %.1f MB RAM (peak %.1f), %.1f of %.1f MB VRAM (peak %.1f)\n",
+			static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses), static_cast<unsigned long long>(stats.content_hits),
+			static_cast<unsigned long long>(stats.async_loads), static_cast<unsigned long long>(stats.async_waits),
+			static_cast<unsigned long long>(stats.ram_evictions), static_cast<unsigned long long>(stats.vram_evictions),
+			double(stats.ram_bytes) / (1024.0 * 1024.0), double(ram_budget) / (1024.0 * 1024.0), double(stats.peak_ram_bytes) / (1024.0 * 1024.0),
+			double(stats.vram_bytes) / (1024.0 * 1024.0), double(vram_budget) / (1024.0 * 1024.0), double(stats.peak_vram_bytes) / (1024.0 * 1024.0));
+	}
+
+	// Drops every image, for before the device is destroyed. Pixels and paths stay cached.
+	void ResetImages()
+	{
+		for (Entry& entry : entries)
+		{
+			entry.view.Reset();
+			entry.image.Reset();
+			entry.holds = 0;
+			entry.on_vram_lru = false;
+			entry.vram_bytes = 0;
+		}
+		vram_lru.clear();
+		stats.vram_bytes = 0;
+	}
+
+private:
+
+	// Identifies the version of a file a hash was computed from.
+	struct FileVersion
+	{
+		uint64_t size = 0;
+		std::filesystem::file_time_type write_time;
+
+		bool operator==(const FileVersion& other) const
+		{
+			return size == other.size && write_time == other.write_time;
+		}
+	};
+
+	struct Entry
+	{
+		uint32_t id = 0;
+		uint64_t hash = 0;
+		// Last path loaded with these contents, for reloading after an eviction.
+		std::string path;
+		uint32_t width = 0;
+		uint32_t height = 0;
+
+		// Empty while evicted from RAM.
+		std::vector<uint8_t> pixels;
+		std::list<uint32_t>::iterator ram_position;
+
+		Vulkan::ImageHandle image;
+		Vulkan::ImageViewHandle view;
+		uint64_t vram_bytes = 0;
+		// Outstanding Acquire()s. The entry is on vram_lru only while this is 0 and it has a view.
+		uint32_t holds = 0;
+		bool on_vram_lru = false;
+		std::list<uint32_t>::iterator vram_position;
+	};
+
+	struct PathInfo
+	{
+		FileVersion version;
+		uint32_t id;
+	};
+
+	// A file read and decoded by the loader thread.
+	struct Loaded
+	{
+		std::string path;
+		FileVersion version;
+		uint64_t hash = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<uint8_t> pixels;
+		bool failed = false;
+	};
+
+	static bool GetFileVersion(const std::string& path, FileVersion& version)
+	{
+		std::error_code error;
+		version.size = std::filesystem::file_size(path, error);
+		if (error)
+			return false;
+		version.write_time = std::filesystem::last_write_time(path, error);
+		return !error;
+	}
+
+	// FNV-1a over the file's bytes.
+	static uint64_t HashBytes(const std::vector<char>& bytes)
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (char byte : bytes)
+		{
+			hash ^= static_cast<uint8_t>(byte);
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	// Reads and hashes a file. Safe on any thread.
+	static bool ReadAndHash(Loaded& loaded, std::vector<char>& bytes)
+	{
+		try
+		{
+			if (!GetFileVersion(loaded.path, loaded.version))
+				throw std::runtime_error("missing file");
+			bytes = ReadFile(loaded.path.c_str());
+		}
+		catch (const std::runtime_error&)
+		{
+			loaded.failed = true;
+			return false;
+		}
+
+		loaded.hash = HashBytes(bytes);
+		return true;
+	}
+
+	// Safe on any thread.
+	static void Decode(Loaded& loaded, const std::vector<char>& bytes)
+	{
+		int width, height, channels;
+		stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(bytes.data()), static_cast<int>(bytes.size()), &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			loaded.failed = true;
+			return;
+		}
+
+		loaded.width = static_cast<uint32_t>(width);
+		loaded.height = static_cast<uint32_t>(height);
+		loaded.pixels.assign(pixels, pixels + size_t(width) * height * 4);
+		stbi_image_free(pixels);
+	}
+
+	// Entry whose contents path had when it was last hashed, if the file hasn't changed since.
+	Entry* FindCurrent(const std::string& path)
+	{
+		auto it = paths.find(path);
+		if (it == paths.end())
+			return nullptr;
+
+		FileVersion version;
+		if (!GetFileVersion(path, version) || !(version == it->second.version))
+			return nullptr;
+
+		return &entries[it->second.id];
+	}
+
+	// Returns the entry of path with its pixels in RAM, decoding the file if needed.
+	uint32_t LoadEntry(const std::string& path)
+	{
+		MergeLoaded();
+		WaitForLoad(path);
+
+		Entry* current = FindCurrent(path);
+		if (current && !current->pixels.empty())
+		{
+			stats.hits++;
+			TouchRam(*current);
+			return current->id;
+		}
+
+		Loaded loaded;
+		loaded.path = path;
+		std::vector<char> bytes;
+		if (ReadAndHash(loaded, bytes))
+		{
+			// Identical contents under another path, or a changed file, skip decoding.
+			auto it = ids.find(loaded.hash);
+			if (it != ids.end() && !entries[it->second].pixels.empty())
+			{
+				stats.hits++;
+				stats.content_hits += entries[it->second].path != path ? 1 : 0;
+				return Insert(loaded);
+			}
+
+			Decode(loaded, bytes);
+		}
+
+		if (loaded.failed)
+		{
+			QM_LOG_ERROR("Failed to load texture %s\n", path.c_str());
+			return invalid_id;
+		}
+
+		stats.misses++;
+		uint32_t id = Insert(loaded);
+		EvictRam(id);
+		return id;
+	}
+
+	// Adds a decoded file, sharing the entry of identical contents loaded before.
+	uint32_t Insert(Loaded& loaded)
+	{
+		uint32_t id;
+		auto it = ids.find(loaded.hash);
+		if (it != ids.end())
+		{
+			id = it->second;
+		}
+		else
+		{
+			id = static_cast<uint32_t>(entries.size());
+			entries.emplace_back();
+			entries.back().id = id;
+			entries.back().hash = loaded.hash;
+			ids[loaded.hash] = id;
+		}
+
+		Entry& entry = entries[id];
+		entry.path = loaded.path;
+		paths[loaded.path] = { loaded.version, id };
+
+		if (entry.pixels.empty())
+		{
+			entry.width = loaded.width;
+			entry.height = loaded.height;
+			entry.pixels = std::move(loaded.pixels);
+			AddBytes(stats.ram_bytes, stats.peak_ram_bytes, entry.pixels.size());
+
+			ram_lru.push_back(id);
+			entry.ram_position = std::prev(ram_lru.end());
+		}
+		else
+		{
+			TouchRam(entry);
+		}
+
+		return id;
+	}
+
+	void TouchRam(Entry& entry)
+	{
+		ram_lru.splice(ram_lru.end(), ram_lru, entry.ram_position);
+	}
+
+	void Hold(Entry& entry)
+	{
+		if (entry.holds++ == 0 && entry.on_vram_lru)
+		{
+			vram_lru.erase(entry.vram_position);
+			entry.on_vram_lru = false;
+		}
+	}
+
+	static void AddBytes(uint64_t& bytes, uint64_t& peak, uint64_t added)
+	{
+		bytes += added;
+		peak = std::max(peak, bytes);
+	}
+
+	// Drops the least recently used pixels until RAM is within budget, keeping keep.
+	void EvictRam(uint32_t keep)
+	{
+		auto it = ram_lru.begin();
+		while (stats.ram_bytes > ram_budget && it != ram_lru.end())
+		{
+			if (*it == keep)
+			{
+				++it;
+				continue;
+			}
+
+			Entry& entry = entries[*it];
+			stats.ram_bytes -= entry.pixels.size();
+			std::vector<uint8_t>().swap(entry.pixels);
+			stats.ram_evictions++;
+			it = ram_lru.erase(it);
+		}
+	}
+
+	// Drops the least recently used images nothing holds until VRAM is within budget.
+	void EvictVram()
+	{
+		while (stats.vram_bytes > vram_budget && !vram_lru.empty())
+		{
+			Entry& entry = entries[vram_lru.front()];
+			vram_lru.pop_front();
+			entry.on_vram_lru = false;
+
+			stats.vram_bytes -= entry.vram_bytes;
+			entry.vram_bytes = 0;
+			entry.view.Reset();
+			entry.image.Reset();
+			stats.vram_evictions++;
+		}
+	}
+
+	// Moves what the loader thread finished into the cache.
+	void MergeLoaded()
+	{
+		std::vector<Loaded> done;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.swap(loaded);
+		}
+
+		for (Loaded& file : done)
+		{
+			if (file.failed)
+			{
+				QM_LOG_ERROR("Failed to load texture %s\n", file.path.c_str());
+				continue;
+			}
+
+			stats.async_loads++;
+			uint32_t id = Insert(file);
+			EvictRam(id);
+		}
+	}
+
+	void WaitForLoad(const std::string& path)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (in_flight.count(path) == 0)
+				return;
+
+			stats.async_waits++;
+			loaded_cond.wait(lock, [&]() { return in_flight.count(path) == 0; });
+		}
+
+		MergeLoaded();
+	}
+
+	void LoaderLoop()
+	{
+		AllocationScope allocation_scope(AllocationTag::Texture);
+
+		for (;;)
+		{
+			Loaded file;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				queued_cond.wait(lock, [this]() { return shutdown || !queued.empty(); });
+				if (shutdown)
+					return;
+
+				file.path = std::move(queued.front());
+				queued.pop_front();
+			}
+
+			std::vector<char> bytes;
+			if (ReadAndHash(file, bytes))
+				Decode(file, bytes);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				in_flight.erase(file.path);
+				loaded.push_back(std::move(file));
+			}
+			loaded_cond.notify_all();
+		}
+	}
+
+	Vulkan::Device* device = nullptr;
+	uint64_t ram_budget = 0;
+	uint64_t vram_budget = 0;
+
+	// A deque keeps entries in place as more are added.
+	std::deque<Entry> entries;
+	std::unordered_map<uint64_t, uint32_t> ids;
+	std::unordered_map<std::string, PathInfo> paths;
+	// Least recently used first.
+	std::list<uint32_t> ram_lru;
+	std::list<uint32_t> vram_lru;
+
+	Stats stats;
+
+	// Shared with the loader thread.
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable queued_cond;
+	std::condition_variable loaded_cond;
+	std::deque<std::string> queued;
+	std::unordered_set<std::string> in_flight;
+	std::vector<Loaded> loaded;
+	bool shutdown = false;
+};
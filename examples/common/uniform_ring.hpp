@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "frame_counters.hpp"
+#include "shader_bindings.hpp"
+
+// Frame scoped allocator for uniform and storage data. One persistently mapped host buffer is split
+// into a region per frame context, and each frame bump allocates aligned blocks from its region,
+// so writing constants is an offset increment and a copy. Blocks are bound at their offset with
+// SetUniformBuffer. Uniform buffers are dynamic descriptors in the backend, so rebinding the ring
+// at another offset only changes the dynamic offset and reuses the same descriptor set.
+struct UniformRing
+{
+	struct Allocation
+	{
+		void* data = nullptr;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		// False if the frame's region was full. The data then lives in CPU memory until Bind()
+		// copies it into the command buffer's own constant data.
+		bool in_ring = false;
+	};
+
+	// frame_size is the space available to each frame; the ring grows if a frame needs more.
+	void Init(Vulkan::Device& device_, VkDeviceSize frame_size_)
+	{
+		device = &device_;
+
+		const VkPhysicalDeviceLimits& limits = device->GetGPUProperties().limits;
+		alignment = std::max<VkDeviceSize>(std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment), 16);
+		frame_count = std::max(1u, device->GetNumFrameContexts());
+
+		CreateBuffer(frame_size_);
+	}
+
+	// Must be called exactly once per device frame, after WSI::BeginFrame(). The region used now
+	// was last written frame_count frames ago, and the device has waited for that frame by then.
+	void BeginFrame()
+	{
+		if (!overflow_blocks.empty())
+		{
+			QM_LOG_INFO("Uniform ring overflowed by %zu blocks, growing to %llu bytes per frame\n", overflow_blocks.size(),
+				static_cast<unsigned long long>(frame_size * 2));
+			overflow_blocks.clear();
+
+			// Frames still in flight keep the old buffer alive until they complete.
+			Reset();
+			CreateBuffer(frame_size * 2);
+		}
+
+		frame_begin = (frame_index % frame_count) * frame_size;
+		frame_index++;
+		used = 0;
+	}
+
+	Allocation Allocate(VkDeviceSize size)
+	{
+		Allocation allocation;
+		allocation.size = size;
+
+		VkDeviceSize offset = (used + alignment - 1) & ~(alignment - 1);
+		if (offset + size <= frame_size)
+		{
+			used = offset + size;
+			peak_used = std::max(peak_used, used);
+
+			allocation.offset = frame_begin + offset;
+			allocation.data = mapped + allocation.offset;
+			allocation.in_ring = true;
+		}
+		else
+		{
+			overflow_blocks.emplace_back(size);
+			allocation.data = overflow_blocks.back().data();
+		}
+
+		return allocation;
+	}
+
+	template<typename T>
+	Allocation Write(const T& value)
+	{
+		Allocation allocation = Allocate(sizeof(T));
+		std::memcpy(allocation.data, &value, sizeof(T));
+		return allocation;
+	}
+
+	// An allocation can be bound any number of times, from any command buffer of the same frame.
+	void Bind(Vulkan::CommandBuffer& cmd, BindingSlot slot, const Allocation& allocation, TransientAllocationCounters& counters) const
+	{
+		if (allocation.in_ring)
+			cmd.SetUniformBuffer(slot.set, slot.binding, 0, *buffer, allocation.offset, allocation.size);
+		else
+			std::memcpy(AllocateConstantData(cmd, counters, slot.set, slot.binding, 0, allocation.size), allocation.data, allocation.size);
+	}
+
+	void Reset()
+	{
+		if (buffer)
+			device->UnmapHostBuffer(*buffer, Vulkan::MEMORY_ACCESS_WRITE_BIT);
+		buffer.Reset();
+		mapped = nullptr;
+	}
+
+	// Most bytes a single frame used so far.
+	VkDeviceSize peak_used = 0;
+
+private:
+
+	void CreateBuffer(VkDeviceSize frame_size_)
+	{
+		frame_size = (frame_size_ + alignment - 1) & ~(alignment - 1);
+
+		Vulkan::BufferCreateInfo create_info{};
+		create_info.domain = Vulkan::BufferDomain::Host;
+		create_info.size = frame_size * frame_count;
+		create_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		create_info.sharing_mode = Vulkan::BufferSharingMode::Exclusive;
+		create_info.exclusive_owner = Vulkan::BUFFER_COMMAND_QUEUE_GENERIC;
+
+		buffer = device->CreateBuffer(create_info);
+		mapped = static_cast<uint8_t*>(device->MapHostBuffer(*buffer, Vulkan::MEMORY_ACCESS_WRITE_BIT));
+	}
+
+	Vulkan::Device* device = nullptr;
+	Vulkan::BufferHandle buffer;
+	uint8_t* mapped = nullptr;
+
+	VkDeviceSize alignment = 256;
+	VkDeviceSize frame_size = 0;
+	uint32_t frame_count = 1;
+
+	uint64_t frame_index = 0;
+	VkDeviceSize frame_begin = 0;
+	VkDeviceSize used = 0;
+
+	std::vector<std::vector<uint8_t>> overflow_blocks;
+};
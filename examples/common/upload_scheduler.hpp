@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Decides which bytes of queued uploads are copied in which frame, without touching a device, so
+// the same schedule drives StreamingUploader and can be simulated on the CPU.
+//
+// The staging ring has one region of frame_budget bytes per frame in flight. Each frame fills its
+// region from the front of the queue, splitting requests at their granularity (a row of an image,
+// 16 bytes of a buffer) when the budget runs out, so no frame copies more than the budget however
+// large the uploads are. A region is written again frame_count frames later, when the frame that
+// copied out of it has completed.
+//
+// Every request gets a ticket, a value on a timeline that counts up in queue order. A request is
+// complete once its last chunk was scheduled: work recorded after that frame's copies sees the data.
+struct UploadScheduler
+{
+	struct Chunk
+	{
+		uint64_t ticket;
+		// Range of the request's data.
+		uint64_t offset;
+		uint64_t size;
+		// Where this frame's copy of the range starts in the staging ring.
+		uint64_t ring_offset;
+		bool first;
+		bool last;
+	};
+
+	struct Stats
+	{
+		uint64_t requests = 0;
+		uint64_t completed = 0;
+		uint64_t bytes = 0;
+		uint64_t frames = 0;
+		// Frames that copied anything, and frames that had more queued than the budget allowed.
+		uint64_t busy_frames = 0;
+		uint64_t saturated_frames = 0;
+		uint64_t peak_frame_bytes = 0;
+		// Sum over completed requests of the frames between queueing and completion.
+		uint64_t latency_frames = 0;
+		uint64_t peak_latency_frames = 0;
+	};
+
+	void Init(uint64_t frame_budget_, uint32_t frame_count_)
+	{
+		frame_budget = frame_budget_;
+		frame_count = std::max(1u, frame_count_);
+	}
+
+	uint64_t GetRingSize() const
+	{
+		return frame_budget * frame_count;
+	}
+
+	// Queues size bytes, copied in pieces that are multiples of granularity. Returns the ticket,
+	// or 0 if a single piece can't fit the budget.
+	uint64_t Enqueue(uint64_t size, uint64_t granularity = 16)
+	{
+		granularity = std::max<uint64_t>(granularity, 1);
+		if (granularity > frame_budget)
+		{
+			QM_LOG_ERROR("Upload pieces of %llu bytes don't fit the %llu byte frame budget\n",
+				static_cast<unsigned long long>(granularity), static_cast<unsigned long long>(frame_budget));
+			return 0;
+		}
+
+		Request request;
+		request.ticket = ++last_ticket;
+		request.size = size;
+		request.granularity = granularity;
+		request.queued_frame = stats.frames;
+		queue.push_back(request);
+
+		stats.requests++;
+		return request.ticket;
+	}
+
+	// Plans the current frame's copies into chunks. Call once per frame.
+	void BeginFrame(std::vector<Chunk>& chunks)
+	{
+		chunks.clear();
+
+		uint64_t region = (stats.frames % frame_count) * frame_budget;
+		uint64_t used = 0;
+
+		while (!queue.empty())
+		{
+			Request& request = queue.front();
+
+			// Whole pieces only, and the ring offset stays 16 byte aligned for buffer copies.
+			uint64_t aligned = (used + 15) & ~uint64_t(15);
+			uint64_t space = aligned < frame_budget ? frame_budget - aligned : 0;
+			uint64_t remaining = request.size - request.copied;
+			uint64_t size = std::min(remaining, space / request.granularity * request.granularity);
+
+			if (size == 0 && remaining != 0)
+				break;
+
+			Chunk chunk;
+			chunk.ticket = request.ticket;
+			chunk.offset = request.copied;
+			chunk.size = size;
+			chunk.ring_offset = region + aligned;
+			chunk.first = request.copied == 0;
+			chunk.last = size == remaining;
+			chunks.push_back(chunk);
+
+			request.copied += size;
+			used = aligned + size;
+
+			if (!chunk.last)
+				break;
+
+			uint64_t latency = stats.frames - request.queued_frame;
+			stats.latency_frames += latency;
+			stats.peak_latency_frames = std::max(stats.peak_latency_frames, latency);
+			stats.completed++;
+			completed_ticket = request.ticket;
+			queue.pop_front();
+		}
+
+		if (used != 0)
+			stats.busy_frames++;
+		if (!queue.empty())
+			stats.saturated_frames++;
+
+		stats.bytes += used;
+		stats.peak_frame_bytes = std::max(stats.peak_frame_bytes, used);
+		stats.frames++;
+	}
+
+	bool IsComplete(uint64_t ticket) const
+	{
+		return ticket != 0 && ticket <= completed_ticket;
+	}
+
+	bool IsIdle() const
+	{
+		return queue.empty();
+	}
+
+	uint64_t GetQueuedBytes() const
+	{
+		uint64_t bytes = 0;
+		for (const Request& request : queue)
+			bytes += request.size - request.copied;
+		return bytes;
+	}
+
+	const Stats& GetStats() const
+	{
+		return stats;
+	}
+
+	uint64_t GetFrameBudget() const
+	{
+		return frame_budget;
+	}
+
+private:
+
+	struct Request
+	{
+		uint64_t ticket;
+		uint64_t size;
+		uint64_t granularity;
+		uint64_t copied = 0;
+		uint64_t queued_frame;
+	};
+
+	uint64_t frame_budget = 4 * 1024 * 1024;
+	uint32_t frame_count = 2;
+
+	std::deque<Request> queue;
+	uint64_t last_ticket = 0;
+	uint64_t completed_ticket = 0;
+
+	Stats stats;
+};
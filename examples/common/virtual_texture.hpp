@@ -0,0 +1,671 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// CPU side of virtual texturing: a tiled file format, an LRU cache of physical pages and the
+// residency logic that turns feedback into tile loads and a page table. None of it touches a
+// device, so it can be driven by simulated feedback (see mesh_viewer/virtual_texture_simulation.hpp);
+// mesh_viewer/virtual_texture_renderer.hpp connects it to the GPU.
+
+// Tiles are tile_size texels square plus a border on every side, copied from the neighbouring tiles
+// (wrapping at the texture edges), so bilinear filtering inside a physical page never reads another
+// page. A tile is stored as page_size x page_size RGBA8 texels.
+struct VirtualTextureLayout
+{
+	static constexpr uint32_t tile_size = 128;
+	static constexpr uint32_t border = 4;
+	static constexpr uint32_t page_size = tile_size + 2 * border;
+	static constexpr uint32_t page_bytes = page_size * page_size * 4;
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// Level levels - 1 is the first that fits a single tile.
+	uint32_t levels = 0;
+
+	void Init(uint32_t width_, uint32_t height_)
+	{
+		width = width_;
+		height = height_;
+		levels = 1;
+		while (std::max(GetLevelWidth(levels - 1), GetLevelHeight(levels - 1)) > tile_size)
+			levels++;
+
+		level_first_tiles.resize(levels + 1);
+		level_first_tiles[0] = 0;
+		for (uint32_t level = 0; level < levels; level++)
+			level_first_tiles[level + 1] = level_first_tiles[level] + GetTilesX(level) * GetTilesY(level);
+	}
+
+	uint32_t GetLevelWidth(uint32_t level) const
+	{
+		return std::max(1u, width >> level);
+	}
+
+	uint32_t GetLevelHeight(uint32_t level) const
+	{
+		return std::max(1u, height >> level);
+	}
+
+	uint32_t GetTilesX(uint32_t level) const
+	{
+		return (GetLevelWidth(level) + tile_size - 1) / tile_size;
+	}
+
+	uint32_t GetTilesY(uint32_t level) const
+	{
+		return (GetLevelHeight(level) + tile_size - 1) / tile_size;
+	}
+
+	uint32_t GetTileCount() const
+	{
+		return level_first_tiles.empty() ? 0 : level_first_tiles.back();
+	}
+
+	// Index of a tile among every tile of every level, finest level first, rows in order.
+	uint32_t GetTileIndex(uint32_t level, uint32_t x, uint32_t y) const
+	{
+		return level_first_tiles[level] + y * GetTilesX(level) + x;
+	}
+
+	bool IsValid(uint32_t level, uint32_t x, uint32_t y) const
+	{
+		return level < levels && x < GetTilesX(level) && y < GetTilesY(level);
+	}
+
+	// First tile index of each level, plus the total count at the end.
+	std::vector<uint32_t> level_first_tiles;
+};
+
+// A tile as written by glsl/virtual.frag into the feedback buffer: level in the top 4 bits, then
+// 14 bits each of y and x. ~0u marks a feedback entry nothing was drawn to.
+namespace VirtualTile
+{
+	static constexpr uint32_t none = ~0u;
+
+	static inline uint32_t Pack(uint32_t level, uint32_t x, uint32_t y)
+	{
+		return (level << 28) | (y << 14) | x;
+	}
+
+	static inline uint32_t GetLevel(uint32_t tile)
+	{
+		return tile >> 28;
+	}
+
+	static inline uint32_t GetY(uint32_t tile)
+	{
+		return (tile >> 14) & 0x3fff;
+	}
+
+	static inline uint32_t GetX(uint32_t tile)
+	{
+		return tile & 0x3fff;
+	}
+
+	static inline uint32_t GetParent(uint32_t tile)
+	{
+		return Pack(GetLevel(tile) + 1, GetX(tile) / 2, GetY(tile) / 2);
+	}
+}
+
+// File layout: the header, then every tile's page in GetTileIndex() order, page_bytes each, so a
+// single tile is one seek and one read.
+struct VirtualTextureHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t tile_size;
+	uint32_t border;
+	uint32_t levels;
+	uint32_t reserved;
+};
+
+static constexpr char virtual_texture_magic[4] = { 'Q', 'M', 'V', 'T' };
+static constexpr uint32_t virtual_texture_version = 1;
+
+// Cuts RGBA8 texels into a virtual texture file, with a box filtered mip chain down to a single
+// tile. Meant as an offline step, it holds the whole image and its mips in memory.
+static bool WriteVirtualTexture(const char* filepath, const uint8_t* texels, uint32_t width, uint32_t height)
+{
+	VirtualTextureLayout layout;
+	layout.Init(width, height);
+
+	std::ofstream file(filepath, std::ios::binary);
+	if (!file)
+	{
+		QM_LOG_ERROR("Failed to create %s\n", filepath);
+		return false;
+	}
+
+	VirtualTextureHeader header{};
+	std::memcpy(header.magic, virtual_texture_magic, sizeof(header.magic));
+	header.version = virtual_texture_version;
+	header.width = width;
+	header.height = height;
+	header.tile_size = VirtualTextureLayout::tile_size;
+	header.border = VirtualTextureLayout::border;
+	header.levels = layout.levels;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	std::vector<uint8_t> level_texels(texels, texels + size_t(width) * height * 4);
+	std::vector<uint8_t> page(VirtualTextureLayout::page_bytes);
+
+	for (uint32_t level = 0; level < layout.levels; level++)
+	{
+		uint32_t level_width = layout.GetLevelWidth(level);
+		uint32_t level_height = layout.GetLevelHeight(level);
+
+		for (uint32_t tile_y = 0; tile_y < layout.GetTilesY(level); tile_y++)
+		{
+			for (uint32_t tile_x = 0; tile_x < layout.GetTilesX(level); tile_x++)
+			{
+				// Texels past the edge of the level, in the border or in a partial tile, wrap.
+				int32_t origin_x = int32_t(tile_x * VirtualTextureLayout::tile_size) - int32_t(VirtualTextureLayout::border);
+				int32_t origin_y = int32_t(tile_y * VirtualTextureLayout::tile_size) - int32_t(VirtualTextureLayout::border);
+
+				for (uint32_t y = 0; y < VirtualTextureLayout::page_size; y++)
+				{
+					uint32_t source_y = uint32_t((origin_y + int32_t(y) + int32_t(level_height) * 2) % int32_t(level_height));
+					for (uint32_t x = 0; x < VirtualTextureLayout::page_size; x++)
+					{
+						uint32_t source_x = uint32_t((origin_x + int32_t(x) + int32_t(level_width) * 2) % int32_t(level_width));
+						std::memcpy(&page[(y * VirtualTextureLayout::page_size + x) * 4], &level_texels[(size_t(source_y) * level_width + source_x) * 4], 4);
+					}
+				}
+
+				file.write(reinterpret_cast<const char*>(page.data()), page.size());
+			}
+		}
+
+		if (level + 1 == layout.levels)
+			break;
+
+		// 2x2 box filter, clamping odd edges.
+		uint32_t next_width = layout.GetLevelWidth(level + 1);
+		uint32_t next_height = layout.GetLevelHeight(level + 1);
+		std::vector<uint8_t> next(size_t(next_width) * next_height * 4);
+		for (uint32_t y = 0; y < next_height; y++)
+		{
+			uint32_t y0 = std::min(y * 2, level_height - 1);
+			uint32_t y1 = std::min(y * 2 + 1, level_height - 1);
+			for (uint32_t x = 0; x < next_width; x++)
+			{
+				uint32_t x0 = std::min(x * 2, level_width - 1);
+				uint32_t x1 = std::min(x * 2 + 1, level_width - 1);
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					uint32_t sum = level_texels[(size_t(y0) * level_width + x0) * 4 + c] + level_texels[(size_t(y0) * level_width + x1) * 4 + c] +
+						level_texels[(size_t(y1) * level_width + x0) * 4 + c] + level_texels[(size_t(y1) * level_width + x1) * 4 + c];
+					next[(size_t(y) * next_width + x) * 4 + c] = uint8_t((sum + 2) / 4);
+				}
+			}
+		}
+		level_texels.swap(next);
+	}
+
+	if (!file)
+	{
+		QM_LOG_ERROR("Failed to write %s\n", filepath);
+		return false;
+	}
+
+	return true;
+}
+
+// Reads single tiles out of a virtual texture file.
+struct VirtualTextureFile
+{
+	bool Open(const char* filepath)
+	{
+		file.open(filepath, std::ios::binary);
+
+		VirtualTextureHeader header{};
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!file || std::memcmp(header.magic, virtual_texture_magic, sizeof(header.magic)) != 0 || header.version != virtual_texture_version ||
+			header.tile_size != VirtualTextureLayout::tile_size || header.border != VirtualTextureLayout::border)
+		{
+			QM_LOG_ERROR("%s is not a virtual texture\n", filepath);
+			file.close();
+			return false;
+		}
+
+		layout.Init(header.width, header.height);
+		return true;
+	}
+
+	// Reads page_bytes of the tile's page into page.
+	bool ReadTile(uint32_t tile, uint8_t* page)
+	{
+		uint32_t level = VirtualTile::GetLevel(tile);
+		uint32_t x = VirtualTile::GetX(tile);
+		uint32_t y = VirtualTile::GetY(tile);
+		if (!layout.IsValid(level, x, y))
+			return false;
+
+		uint64_t offset = sizeof(VirtualTextureHeader) + uint64_t(layout.GetTileIndex(level, x, y)) * VirtualTextureLayout::page_bytes;
+		file.seekg(static_cast<std::streamoff>(offset));
+		file.read(reinterpret_cast<char*>(page), VirtualTextureLayout::page_bytes);
+		bytes_read += VirtualTextureLayout::page_bytes;
+		return bool(file);
+	}
+
+	VirtualTextureLayout layout;
+	uint64_t bytes_read = 0;
+
+private:
+
+	std::ifstream file;
+};
+
+// Fixed set of physical pages holding tiles, recycled least recently used first. Pages used in the
+// current frame, and pinned ones, are never evicted.
+struct TileCache
+{
+	static constexpr uint32_t invalid_page = ~0u;
+
+	void Init(uint32_t page_count)
+	{
+		pages.assign(page_count, {});
+		pages_by_tile.clear();
+
+		// Every page starts on the LRU list, empty.
+		head = invalid_page;
+		tail = invalid_page;
+		for (uint32_t page = 0; page < page_count; page++)
+			PushBack(page);
+	}
+
+	void BeginFrame()
+	{
+		frame++;
+	}
+
+	// Page holding tile, marked as used this frame, or invalid_page.
+	uint32_t Find(uint32_t tile)
+	{
+		auto it = pages_by_tile.find(tile);
+		if (it == pages_by_tile.end())
+			return invalid_page;
+
+		Touch(it->second);
+		return it->second;
+	}
+
+	bool Contains(uint32_t tile) const
+	{
+		return pages_by_tile.count(tile) != 0;
+	}
+
+	// Page to load tile into, marked as used this frame. evicted receives the tile the page held, or
+	// VirtualTile::none. Returns invalid_page when every page is used this frame or pinned.
+	uint32_t Allocate(uint32_t tile, uint32_t& evicted)
+	{
+		evicted = VirtualTile::none;
+
+		uint32_t page = head;
+		if (page == invalid_page || pages[page].pinned || pages[page].last_frame == frame)
+			return invalid_page;
+
+		if (pages[page].tile != VirtualTile::none)
+		{
+			evicted = pages[page].tile;
+			pages_by_tile.erase(evicted);
+			evictions++;
+		}
+
+		pages[page].tile = tile;
+		pages_by_tile[tile] = page;
+		Touch(page);
+		return page;
+	}
+
+	// Keeps the page out of the LRU list for good, for tiles every lookup falls back to.
+	void Pin(uint32_t page)
+	{
+		if (pages[page].pinned)
+			return;
+		pages[page].pinned = true;
+		Unlink(page);
+	}
+
+	uint32_t GetTile(uint32_t page) const
+	{
+		return pages[page].tile;
+	}
+
+	uint32_t GetPageCount() const
+	{
+		return static_cast<uint32_t>(pages.size());
+	}
+
+	size_t GetResidentCount() const
+	{
+		return pages_by_tile.size();
+	}
+
+	uint64_t evictions = 0;
+
+private:
+
+	struct Page
+	{
+		uint32_t tile = VirtualTile::none;
+		uint32_t prev = invalid_page;
+		uint32_t next = invalid_page;
+		uint64_t last_frame = ~0ull;
+		bool pinned = false;
+	};
+
+	// Moves the page to the most recently used end.
+	void Touch(uint32_t page)
+	{
+		pages[page].last_frame = frame;
+		if (pages[page].pinned || tail == page)
+			return;
+		Unlink(page);
+		PushBack(page);
+	}
+
+	void Unlink(uint32_t page)
+	{
+		Page& entry = pages[page];
+		if (entry.prev != invalid_page)
+			pages[entry.prev].next = entry.next;
+		else
+			head = entry.next;
+		if (entry.next != invalid_page)
+			pages[entry.next].prev = entry.prev;
+		else
+			tail = entry.prev;
+		entry.prev = entry.next = invalid_page;
+	}
+
+	void PushBack(uint32_t page)
+	{
+		pages[page].prev = tail;
+		pages[page].next = invalid_page;
+		if (tail != invalid_page)
+			pages[tail].next = page;
+		else
+			head = page;
+		tail = page;
+	}
+
+	std::vector<Page> pages;
+	std::unordered_map<uint32_t, uint32_t> pages_by_tile;
+	// Least recently used first.
+	uint32_t head = invalid_page;
+	uint32_t tail = invalid_page;
+	uint64_t frame = 0;
+};
+
+// Turns feedback into tile loads and keeps the page table in sync with the cache.
+//
+// Every requested tile, and every coarser tile covering it, is kept resident while requested.
+// Missing tiles load coarsest first, at most max_loads_per_frame a frame, so a new view sharpens
+// over a few frames instead of stalling one. The coarsest level is loaded up front and pinned, so
+// every lookup has a page to fall back to.
+struct VirtualTextureResidency
+{
+	struct Load
+	{
+		uint32_t tile;
+		uint32_t page;
+	};
+
+	struct Stats
+	{
+		uint64_t frames = 0;
+		uint64_t requests = 0;
+		// Requested tiles that were resident.
+		uint64_t hits = 0;
+		uint64_t loads = 0;
+		// Loads left for a later frame by the per-frame limit or a full cache.
+		uint64_t deferred = 0;
+	};
+
+	// Tile loads for the pinned coarsest level are returned in initial_loads.
+	void Init(const VirtualTextureLayout& layout_, uint32_t page_count, uint32_t max_loads_per_frame_, std::vector<Load>& initial_loads)
+	{
+		layout = layout_;
+		max_loads_per_frame = max_loads_per_frame_;
+		cache.Init(page_count);
+
+		if (atlas_pages_x == 0)
+		{
+			atlas_pages_x = 1;
+			while (atlas_pages_x * atlas_pages_x < page_count)
+				atlas_pages_x++;
+		}
+
+		page_table.assign(layout.GetTileCount(), 0);
+		dirty_begin = 0;
+		dirty_end = 0;
+
+		initial_loads.clear();
+		uint32_t top = layout.levels - 1;
+		for (uint32_t y = 0; y < layout.GetTilesY(top); y++)
+		{
+			for (uint32_t x = 0; x < layout.GetTilesX(top); x++)
+			{
+				uint32_t tile = VirtualTile::Pack(top, x, y);
+				uint32_t evicted;
+				uint32_t page = cache.Allocate(tile, evicted);
+				if (page == TileCache::invalid_page)
+				{
+					QM_LOG_ERROR("Virtual texture needs more than %u pages for its coarsest level\n", page_count);
+					break;
+				}
+				cache.Pin(page);
+				initial_loads.push_back({ tile, page });
+				SetResident(tile, page);
+			}
+		}
+	}
+
+	// Takes one frame of feedback. Entries of VirtualTile::none and tiles outside the texture are
+	// skipped. loads receives the tiles to read into their pages before the page table is used.
+	void Update(const uint32_t* feedback, size_t count, std::vector<Load>& loads)
+	{
+		loads.clear();
+		cache.BeginFrame();
+		stats.frames++;
+
+		// Deduplicate, counting how often each tile was seen.
+		requested.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t tile = feedback[i];
+			if (tile == VirtualTile::none || !layout.IsValid(VirtualTile::GetLevel(tile), VirtualTile::GetX(tile), VirtualTile::GetY(tile)))
+				continue;
+			requested[tile]++;
+		}
+
+		// Parents keep the fallback for a requested tile resident, and load before it.
+		needed.clear();
+		for (const auto& request : requested)
+		{
+			stats.requests++;
+			uint32_t tile = request.first;
+			bool first = true;
+			while (VirtualTile::GetLevel(tile) < layout.levels)
+			{
+				auto it = needed.find(tile);
+				if (it != needed.end())
+				{
+					it->second += request.second;
+				}
+				else
+				{
+					needed.emplace(tile, request.second);
+				}
+
+				if (cache.Find(tile) != TileCache::invalid_page)
+				{
+					if (first)
+						stats.hits++;
+				}
+				first = false;
+
+				if (VirtualTile::GetLevel(tile) + 1 >= layout.levels)
+					break;
+				tile = VirtualTile::GetParent(tile);
+			}
+		}
+
+		missing.clear();
+		for (const auto& tile : needed)
+		{
+			if (!cache.Contains(tile.first))
+				missing.push_back({ tile.first, tile.second });
+		}
+
+		// Coarsest first, then most requested.
+		std::sort(missing.begin(), missing.end(), [](const Missing& a, const Missing& b) {
+			uint32_t level_a = VirtualTile::GetLevel(a.tile), level_b = VirtualTile::GetLevel(b.tile);
+			if (level_a != level_b)
+				return level_a > level_b;
+			if (a.count != b.count)
+				return a.count > b.count;
+			return a.tile < b.tile;
+		});
+
+		for (const Missing& tile : missing)
+		{
+			if (loads.size() >= max_loads_per_frame)
+				break;
+
+			uint32_t evicted;
+			uint32_t page = cache.Allocate(tile.tile, evicted);
+			if (page == TileCache::invalid_page)
+				break;
+
+			if (evicted != VirtualTile::none)
+				SetEvicted(evicted);
+			SetResident(tile.tile, page);
+			loads.push_back({ tile.tile, page });
+		}
+
+		stats.loads += loads.size();
+		stats.deferred += missing.size() - loads.size();
+	}
+
+	// Page table entry as glsl/virtual.frag decodes it: the page's x and y in the atlas, the level
+	// of the tile actually resident, and a valid byte.
+	static uint32_t PackEntry(uint32_t page_x, uint32_t page_y, uint32_t level)
+	{
+		return page_x | (page_y << 8) | (level << 16) | (255u << 24);
+	}
+
+	static uint32_t GetEntryLevel(uint32_t entry)
+	{
+		return (entry >> 24) ? (entry >> 16) & 0xff : ~0u;
+	}
+
+	// Level the entry for (level, x, y) resolves to, for checking fallbacks.
+	uint32_t GetResidentLevel(uint32_t level, uint32_t x, uint32_t y) const
+	{
+		return GetEntryLevel(page_table[layout.GetTileIndex(level, x, y)]);
+	}
+
+	bool IsPageTableDirty() const
+	{
+		return dirty_begin != dirty_end;
+	}
+
+	// Entries changed since the last call, as [begin, end) in page_table.
+	void TakeDirtyRange(uint32_t& begin, uint32_t& end)
+	{
+		begin = dirty_begin;
+		end = dirty_end;
+		dirty_begin = dirty_end = 0;
+	}
+
+	// Atlas layout, pages per row. Defaults to a square atlas if 0 when Init() is called.
+	uint32_t atlas_pages_x = 0;
+
+	VirtualTextureLayout layout;
+	TileCache cache;
+	// One entry per tile, in VirtualTextureLayout::GetTileIndex() order.
+	std::vector<uint32_t> page_table;
+	Stats stats;
+
+private:
+
+	struct Missing
+	{
+		uint32_t tile;
+		uint32_t count;
+	};
+
+	// A tile's entry points at its own page while it is resident, and otherwise repeats its
+	// parent's. Only the tile and the descendants resolving through it change when it is loaded or
+	// evicted, so updates cost the size of that subtree, not of the whole table.
+	void SetResident(uint32_t tile, uint32_t page)
+	{
+		uint32_t level = VirtualTile::GetLevel(tile);
+		SetSubtree(level, VirtualTile::GetX(tile), VirtualTile::GetY(tile), PackEntry(page % atlas_pages_x, page / atlas_pages_x, level));
+	}
+
+	void SetEvicted(uint32_t tile)
+	{
+		uint32_t level = VirtualTile::GetLevel(tile);
+		uint32_t x = VirtualTile::GetX(tile);
+		uint32_t y = VirtualTile::GetY(tile);
+		uint32_t parent_entry = level + 1 < layout.levels ? page_table[layout.GetTileIndex(level + 1, x / 2, y / 2)] : 0;
+		SetSubtree(level, x, y, parent_entry);
+	}
+
+	// Sets the entry of (level, x, y) and of every descendant that isn't resident itself.
+	void SetSubtree(uint32_t level, uint32_t x, uint32_t y, uint32_t entry)
+	{
+		uint32_t index = layout.GetTileIndex(level, x, y);
+		page_table[index] = entry;
+		MarkDirty(index);
+
+		if (level == 0)
+			return;
+
+		for (uint32_t child = 0; child < 4; child++)
+		{
+			uint32_t child_x = x * 2 + (child & 1);
+			uint32_t child_y = y * 2 + (child >> 1);
+			if (!layout.IsValid(level - 1, child_x, child_y))
+				continue;
+
+			if (GetEntryLevel(page_table[layout.GetTileIndex(level - 1, child_x, child_y)]) != level - 1)
+				SetSubtree(level - 1, child_x, child_y, entry);
+		}
+	}
+
+	void MarkDirty(uint32_t index)
+	{
+		if (dirty_begin == dirty_end)
+		{
+			dirty_begin = index;
+			dirty_end = index + 1;
+		}
+		else
+		{
+			dirty_begin = std::min(dirty_begin, index);
+			dirty_end = std::max(dirty_end, index + 1);
+		}
+	}
+
+	uint32_t max_loads_per_frame = 16;
+	uint32_t dirty_begin = 0;
+	uint32_t dirty_end = 0;
+
+	std::unordered_map<uint32_t, uint32_t> requested;
+	std::unordered_map<uint32_t, uint32_t> needed;
+	std::vector<Missing> missing;
+};
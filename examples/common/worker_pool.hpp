@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads available for parallel work such as command recording, not counting the main thread.
+static inline uint32_t GetWorkerThreadCount()
+{
+	return std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+}
+
+// Non-owning reference to a callable taking a worker index. Unlike std::function it never
+// allocates, however much the callable captures, so handing a lambda to WorkerPool::Run() every
+// frame stays off the heap. The callable must outlive the reference.
+struct WorkerJob
+{
+	template<typename Func>
+	WorkerJob(const Func& func)
+		: callable(&func), call([](const void* callable_, uint32_t worker) { (*static_cast<const Func*>(callable_))(worker); })
+	{
+	}
+
+	void operator()(uint32_t worker) const
+	{
+		call(callable, worker);
+	}
+
+private:
+
+	const void* callable;
+	void (*call)(const void*, uint32_t);
+};
+
+// A fixed set of persistent threads. Run() hands one job index to each active worker and blocks
+// until all of them return, so per-frame work doesn't pay for thread creation.
+struct WorkerPool
+{
+	explicit WorkerPool(uint32_t thread_count)
+	{
+		for (uint32_t i = 0; i < thread_count; i++)
+			threads.emplace_back(&WorkerPool::WorkerLoop, this, i);
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			shutdown = true;
+		}
+		start_cond.notify_all();
+
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	uint32_t GetThreadCount() const
+	{
+		return static_cast<uint32_t>(threads.size());
+	}
+
+	// Calls job(worker_index) on workers [0, active_count). Must only be called from one thread.
+	void Run(uint32_t active_count, WorkerJob job_)
+	{
+		active_count = std::min(active_count, GetThreadCount());
+		if (active_count == 0)
+			return;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		job = &job_;
+		active = active_count;
+		pending = active_count;
+		generation++;
+		start_cond.notify_all();
+
+		done_cond.wait(lock, [this]() { return pending == 0; });
+		job = nullptr;
+	}
+
+private:
+
+	void WorkerLoop(uint32_t index)
+	{
+		uint64_t seen_generation = 0;
+
+		for (;;)
+		{
+			const WorkerJob* current_job;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				start_cond.wait(lock, [&]() { return shutdown || (generation != seen_generation && index < active); });
+
+				if (shutdown)
+					return;
+
+				seen_generation = generation;
+				current_job = job;
+			}
+
+			(*current_job)(index);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--pending == 0)
+					done_cond.notify_one();
+			}
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable start_cond;
+	std::condition_variable done_cond;
+	const WorkerJob* job = nullptr;
+	uint64_t generation = 0;
+	uint32_t active = 0;
+	uint32_t pending = 0;
+	bool shutdown = false;
+};
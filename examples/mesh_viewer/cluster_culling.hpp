@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "../common/frustum.hpp"
+
+// Splits one large mesh into clusters of up to max_triangles triangles that can be culled
+// individually. Each cluster has a bounding sphere for frustum culling and a normal cone: if the
+// camera sees every triangle of a cluster from behind, the whole cluster is skipped.
+
+struct MeshCluster
+{
+	glm::vec3 center;
+	float radius;
+	glm::vec3 cone_axis;
+	// Sine of the cone's half angle. 1 for clusters whose normals spread too far to ever be
+	// culled as a whole.
+	float cone_cutoff;
+	// Range in ClusteredMesh::indices.
+	uint32_t first_index;
+	uint32_t index_count;
+};
+
+struct ClusteredMesh
+{
+	std::vector<MeshCluster> clusters;
+	// The mesh's indices reordered so each cluster is contiguous.
+	std::vector<uint32_t> indices;
+};
+
+namespace ClusterDetail
+{
+	// Interleaves the low 10 bits of v with two zero bits.
+	static inline uint32_t SpreadBits(uint32_t v)
+	{
+		v &= 0x3ff;
+		v = (v | (v << 16)) & 0x030000ff;
+		v = (v | (v << 8)) & 0x0300f00f;
+		v = (v | (v << 4)) & 0x030c30c3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+
+	// Octahedral mapping of a unit normal onto a grid x grid cell index.
+	static inline uint32_t GetNormalBucket(const glm::vec3& n, uint32_t grid)
+	{
+		float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		if (l1 == 0.0f)
+			return 0;
+
+		float u = n.x / l1;
+		float v = n.y / l1;
+		if (n.z < 0.0f)
+		{
+			float folded_u = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+			float folded_v = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+			u = folded_u;
+			v = folded_v;
+		}
+
+		uint32_t x = std::min(grid - 1, static_cast<uint32_t>((u * 0.5f + 0.5f) * float(grid)));
+		uint32_t y = std::min(grid - 1, static_cast<uint32_t>((v * 0.5f + 0.5f) * float(grid)));
+		return y * grid + x;
+	}
+}
+
+// Triangles are grouped by normal direction on a normal_grid x normal_grid octahedral grid, which
+// keeps cones narrow, then ordered along a Morton curve through the mesh bounds, which keeps
+// spheres small. Finer grids cull more triangles at the cost of more, partly filled clusters.
+template<typename VertexType>
+static ClusteredMesh BuildClusters(const std::vector<VertexType>& vertices, const std::vector<uint32_t>& indices, uint32_t max_triangles = 64, uint32_t normal_grid = 16)
+{
+	uint32_t triangle_count = static_cast<uint32_t>(indices.size() / 3);
+
+	glm::vec3 bounds_min(0.0f), bounds_max(0.0f);
+	if (!vertices.empty())
+		bounds_min = bounds_max = vertices[0].position;
+	for (const VertexType& vertex : vertices)
+	{
+		bounds_min = glm::min(bounds_min, vertex.position);
+		bounds_max = glm::max(bounds_max, vertex.position);
+	}
+	glm::vec3 bounds_scale = 1023.0f / glm::max(bounds_max - bounds_min, glm::vec3(1e-6f));
+
+	std::vector<glm::vec3> normals(triangle_count);
+	std::vector<uint64_t> keys(triangle_count);
+
+	for (uint32_t t = 0; t < triangle_count; t++)
+	{
+		const glm::vec3& a = vertices[indices[t * 3 + 0]].position;
+		const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+		const glm::vec3& c = vertices[indices[t * 3 + 2]].position;
+
+		glm::vec3 ab = b - a;
+		glm::vec3 ac = c - a;
+		glm::vec3 normal(ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x);
+		float length = glm::length(normal);
+		// Degenerate triangles are never visible and don't constrain the cone.
+		normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+
+		uint64_t bucket = ClusterDetail::GetNormalBucket(normals[t], normal_grid);
+
+		glm::vec3 cell = ((a + b + c) * (1.0f / 3.0f) - bounds_min) * bounds_scale;
+		uint32_t morton = ClusterDetail::SpreadBits(uint32_t(cell.x)) | (ClusterDetail::SpreadBits(uint32_t(cell.y)) << 1) | (ClusterDetail::SpreadBits(uint32_t(cell.z)) << 2);
+
+		keys[t] = (bucket << 32) | morton;
+	}
+
+	std::vector<uint32_t> order(triangle_count);
+	for (uint32_t t = 0; t < triangle_count; t++)
+		order[t] = t;
+	std::sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+	ClusteredMesh mesh;
+	mesh.indices.reserve(triangle_count * 3);
+
+	uint32_t begin = 0;
+	while (begin < triangle_count)
+	{
+		uint32_t end = begin + 1;
+		while (end < triangle_count && end - begin < max_triangles && (keys[order[end]] >> 32) == (keys[order[begin]] >> 32))
+			end++;
+
+		MeshCluster cluster{};
+		cluster.first_index = static_cast<uint32_t>(mesh.indices.size());
+		cluster.index_count = (end - begin) * 3;
+
+		glm::vec3 cluster_min = vertices[indices[order[begin] * 3]].position;
+		glm::vec3 cluster_max = cluster_min;
+		glm::vec3 normal_sum(0.0f);
+
+		for (uint32_t i = begin; i < end; i++)
+		{
+			uint32_t t = order[i];
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t index = indices[t * 3 + k];
+				mesh.indices.push_back(index);
+				cluster_min = glm::min(cluster_min, vertices[index].position);
+				cluster_max = glm::max(cluster_max, vertices[index].position);
+			}
+			normal_sum += normals[t];
+		}
+
+		cluster.center = (cluster_min + cluster_max) * 0.5f;
+		for (uint32_t i = cluster.first_index; i < cluster.first_index + cluster.index_count; i++)
+			cluster.radius = std::max(cluster.radius, glm::length(vertices[mesh.indices[i]].position - cluster.center));
+
+		float sum_length = glm::length(normal_sum);
+		cluster.cone_axis = sum_length > 0.0f ? normal_sum / sum_length : glm::vec3(0.0f, 0.0f, 1.0f);
+
+		float min_dot = sum_length > 0.0f ? 1.0f : -1.0f;
+		for (uint32_t i = begin; i < end; i++)
+		{
+			if (normals[order[i]] != glm::vec3(0.0f))
+				min_dot = std::min(min_dot, glm::dot(cluster.cone_axis, normals[order[i]]));
+		}
+
+		cluster.cone_cutoff = min_dot > 0.0f ? std::sqrt(1.0f - min_dot * min_dot) : 1.0f;
+
+		mesh.clusters.push_back(cluster);
+		begin = end;
+	}
+
+	return mesh;
+}
+
+// True when every triangle in the cluster faces away from camera_position (counter-clockwise
+// triangles are front facing). Conservative for every point inside the bounding sphere.
+static inline bool IsClusterBackfacing(const MeshCluster& cluster, const glm::vec3& camera_position)
+{
+	if (cluster.cone_cutoff >= 1.0f)
+		return false;
+
+	glm::vec3 to_center = cluster.center - camera_position;
+	return glm::dot(to_center, cluster.cone_axis) >= cluster.cone_cutoff * glm::length(to_center) + cluster.radius * (1.0f + cluster.cone_cutoff);
+}
+
+// Range of ClusteredMesh::indices.
+struct ClusterRange
+{
+	uint32_t first_index;
+	uint32_t index_count;
+};
+
+struct ClusterCullStats
+{
+	uint64_t triangles = 0;
+	uint64_t frustum_culled = 0;
+	uint64_t backface_culled = 0;
+
+	void Add(const ClusterCullStats& other)
+	{
+		triangles += other.triangles;
+		frustum_culled += other.frustum_culled;
+		backface_culled += other.backface_culled;
+	}
+
+	double GetCulledFraction() const
+	{
+		return triangles != 0 ? double(frustum_culled + backface_culled) / double(triangles) : 0.0;
+	}
+};
+
+// Frustum and camera position are in the mesh's model space. Appends the visible clusters to
+// visible, adjacent clusters merged into one range.
+static inline ClusterCullStats CullClusters(const ClusteredMesh& mesh, const Frustum& frustum, const glm::vec3& camera_position, std::vector<ClusterRange>& visible)
+{
+	ClusterCullStats stats;
+
+	for (const MeshCluster& cluster : mesh.clusters)
+	{
+		uint32_t triangles = cluster.index_count / 3;
+		stats.triangles += triangles;
+
+		if (!SphereInFrustum(frustum, cluster.center, cluster.radius))
+		{
+			stats.frustum_culled += triangles;
+		}
+		else if (IsClusterBackfacing(cluster, camera_position))
+		{
+			stats.backface_culled += triangles;
+		}
+		else if (!visible.empty() && visible.back().first_index + visible.back().index_count == cluster.first_index)
+		{
+			visible.back().index_count += cluster.index_count;
+		}
+		else
+		{
+			visible.push_back({ cluster.first_index, cluster.index_count });
+		}
+	}
+
+	return stats;
+}
+
+// Total index count of ranges returned by CullClusters().
+static inline uint32_t GetIndexCount(const std::vector<ClusterRange>& ranges)
+{
+	uint32_t count = 0;
+	for (const ClusterRange& range : ranges)
+		count += range.index_count;
+	return count;
+}
+
+// Copies the indices of the visible ranges into one compacted list.
+static inline void CompactClusterIndices(const ClusteredMesh& mesh, const std::vector<ClusterRange>& ranges, uint32_t* out)
+{
+	for (const ClusterRange& range : ranges)
+	{
+		std::copy(mesh.indices.begin() + range.first_index, mesh.indices.begin() + range.first_index + range.index_count, out);
+		out += range.index_count;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../common/file_loader.hpp"
+
+#include "cluster_culling.hpp"
+#include "orbit_camera.hpp"
+
+// Orbits the viewer's default camera around the model at several elevations and prints the
+// fraction of triangles removed by cluster culling. Needs no window or GPU.
+static void RunClusterOrbit(const char* obj_file)
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	LoadObjModel(obj_file, vertices, indices);
+
+	ClusteredMesh mesh = BuildClusters(vertices, indices);
+	std::printf("%zu triangles in %zu clusters\n", indices.size() / 3, mesh.clusters.size());
+
+	// Same projection and orbit as the interactive camera.
+	const float radius = 0.6f;
+	const glm::vec3 target(0.0f, 0.25f, 0.0f);
+	glm::mat4 proj = OrbitCamera::GetProjectionMatrix(16.0f / 9.0f);
+
+	std::vector<ClusterRange> visible;
+	ClusterCullStats total;
+
+	std::printf("elevation  frustum  backface  total culled\n");
+
+	for (float phi : { -60.0f, -30.0f, 0.0f, 30.0f, 60.0f })
+	{
+		ClusterCullStats elevation;
+
+		for (float theta = 0.0f; theta < 360.0f; theta += 5.0f)
+		{
+			glm::vec3 camera_position(glm::cos(glm::radians(theta)) * radius * glm::cos(glm::radians(phi)),
+				glm::sin(glm::radians(theta)) * radius * glm::cos(glm::radians(phi)), glm::sin(glm::radians(phi)) * radius);
+			glm::mat4 view = glm::lookAt(camera_position, target, glm::vec3(0.0f, 0.0f, 1.0f));
+
+			visible.clear();
+			elevation.Add(CullClusters(mesh, ExtractFrustum(proj * view), camera_position, visible));
+		}
+
+		std::printf("%-10.0f %-8.1f %-9.1f %.1f%%\n", phi, 100.0 * elevation.frustum_culled / elevation.triangles,
+			100.0 * elevation.backface_culled / elevation.triangles, 100.0 * elevation.GetCulledFraction());
+		total.Add(elevation);
+	}
+
+	std::printf("orbit average: %.1f%% of triangles culled\n", 100.0 * total.GetCulledFraction());
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../common/simd_culling.hpp"
+
+// Random boxes spread over a cube sized so that density stays constant with count. Instances are
+// numbered cell by cell, like a scene streamed in tiles, so neighbouring ids are close in space.
+// With a fully random id order BVH refits are dominated by cache misses gathering the bounds.
+struct CullingBenchmarkScene
+{
+	CullingBenchmarkScene(uint32_t count, uint32_t seed)
+	{
+		std::mt19937 rng(seed);
+		float half_extent = 2.0f * std::cbrt(static_cast<float>(count));
+		std::uniform_real_distribution<float> position(-half_extent, half_extent);
+		std::uniform_real_distribution<float> size(0.1f, 1.0f);
+
+		bounds_min.resize(count);
+		bounds_max.resize(count);
+		moved_min.resize(count);
+		moved_max.resize(count);
+
+		boxes.Resize(count);
+		spheres.Resize(count);
+
+		std::vector<glm::vec3> centers(count);
+		for (glm::vec3& center : centers)
+			center = glm::vec3(position(rng), position(rng), position(rng));
+
+		const float cell_size = 16.0f;
+		auto cell_of = [&](const glm::vec3& p) {
+			auto cell = [&](float v) { return static_cast<int>(std::floor((v + half_extent) / cell_size)); };
+			return std::make_tuple(cell(p.z), cell(p.y), cell(p.x));
+		};
+		std::sort(centers.begin(), centers.end(), [&](const glm::vec3& a, const glm::vec3& b) { return cell_of(a) < cell_of(b); });
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const glm::vec3& center = centers[i];
+			glm::vec3 half(size(rng), size(rng), size(rng));
+
+			bounds_min[i] = center - half;
+			bounds_max[i] = center + half;
+			boxes.Set(i, bounds_min[i], bounds_max[i]);
+			spheres.Set(i, center, glm::length(half));
+
+			// Second set of bounds, every instance nudged a little, to measure refits.
+			glm::vec3 offset(0.1f * std::sin(center.y), 0.1f * std::sin(center.z), 0.1f * std::sin(center.x));
+			moved_min[i] = bounds_min[i] + offset;
+			moved_max[i] = bounds_max[i] + offset;
+		}
+
+		glm::mat4 proj = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.1f, half_extent * 2.0f);
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.3f, 0.2f), glm::vec3(0.0f, 0.0f, 1.0f));
+		frustum = ExtractFrustum(proj * view);
+	}
+
+	std::vector<glm::vec3> bounds_min, bounds_max;
+	std::vector<glm::vec3> moved_min, moved_max;
+	AabbSoA boxes;
+	SphereSoA spheres;
+	Frustum frustum;
+};
+
+// Times every culling path against 10k to 1M instances and prints instances tested per ms.
+// Each path's visible count is checked against the scalar test of the same bounding volume.
+static void RunCullingBenchmark()
+{
+	constexpr uint32_t iterations = 20;
+	static_assert(iterations % 2 == 0, "Refit benchmark must end on the original bounds");
+
+	std::vector<CullingPath> paths;
+	for (CullingPath path : { CullingPath::Scalar, CullingPath::SSE, CullingPath::AVX })
+	{
+		if (IsCullingPathSupported(path))
+			paths.push_back(path);
+	}
+
+	std::printf("instances  test             path    visible   ms/frame  instances/ms  mismatch\n");
+
+	for (uint32_t count : { 10000u, 100000u, 1000000u })
+	{
+		CullingBenchmarkScene scene(count, count);
+		std::vector<uint32_t> visible;
+		visible.reserve(count);
+
+		auto report = [&](const char* test, CullingPath path, double seconds, size_t expected) {
+			double ms = seconds * 1000.0 / iterations;
+			std::printf("%-10u %-16s %-7s %-9zu %-9.3f %-13.0f %s\n", count, test, GetCullingPathName(path), visible.size(), ms, count / ms,
+				visible.size() == expected ? "no" : "YES");
+		};
+
+		auto time = [&](auto&& body) {
+			Util::Timer timer;
+			timer.start();
+			for (uint32_t i = 0; i < iterations; i++)
+			{
+				visible.clear();
+				body(i);
+			}
+			return timer.end();
+		};
+
+		visible.clear();
+		CullAabbs(scene.frustum, scene.boxes, 0, count, nullptr, visible, CullingPath::Scalar);
+		size_t reference = visible.size();
+
+		for (CullingPath path : paths)
+		{
+			double seconds = time([&](uint32_t) { CullAabbs(scene.frustum, scene.boxes, 0, count, nullptr, visible, path); });
+			report("aabb", path, seconds, reference);
+		}
+
+		visible.clear();
+		CullSpheres(scene.frustum, scene.spheres, 0, count, nullptr, visible, CullingPath::Scalar);
+		size_t sphere_reference = visible.size();
+
+		for (CullingPath path : paths)
+		{
+			double seconds = time([&](uint32_t) { CullSpheres(scene.frustum, scene.spheres, 0, count, nullptr, visible, path); });
+			report("sphere", path, seconds, sphere_reference);
+		}
+
+		CullingPath best = GetBestCullingPath();
+
+		Util::Timer build_timer;
+		build_timer.start();
+		CullingBvh bvh;
+		bvh.Build(scene.bounds_min, scene.bounds_max);
+		double build_ms = build_timer.end() * 1000.0;
+
+		double seconds = time([&](uint32_t) { bvh.Cull(scene.frustum, visible, best); });
+		report("bvh", best, seconds, reference);
+
+		// Alternate between the two sets of bounds so every refit has real work to do. The iteration
+		// count is even, so the last refit restores the original bounds and the reference still holds.
+		seconds = time([&](uint32_t i) {
+			if (i & 1)
+				bvh.Refit(scene.bounds_min, scene.bounds_max);
+			else
+				bvh.Refit(scene.moved_min, scene.moved_max);
+			bvh.Cull(scene.frustum, visible, best);
+		});
+
+		report("bvh+refit", best, seconds, reference);
+
+		std::printf("%-10u bvh build        %.3f ms, %zu nodes\n", count, build_ms, bvh.nodes.size());
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+// Render pass of the viewer's frames, described once. Each frame only points it at the swapchain
+// image being rendered to. The depth buffer is an image of its own, recreated by Resize() when
+// the swapchain size changes, rather than looked up in the device's attachment cache every frame.
+struct FrameRenderContext
+{
+	FrameRenderContext() = default;
+	FrameRenderContext(const FrameRenderContext&) = delete;
+	FrameRenderContext& operator=(const FrameRenderContext&) = delete;
+
+	void Init(Vulkan::Device& device_)
+	{
+		device = &device_;
+
+		rp.num_color_attachments = 1;
+		rp.color_attachments[0].clear_color.float32[0] = 0.1f;
+		rp.color_attachments[0].clear_color.float32[1] = 0.2f;
+		rp.color_attachments[0].clear_color.float32[2] = 0.3f;
+
+		rp.clear_attachments = ~0u;
+		rp.store_attachments = 1u << 0;
+
+		rp.depth_stencil.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		rp.op_flags |= Vulkan::RENDER_PASS_OP_CLEAR_DEPTH_STENCIL_BIT;
+
+		subpass.num_color_attachments = 1;
+		subpass.color_attachments[0] = 0;
+		subpass.depth_stencil_mode = Vulkan::RenderPassInfo::DepthStencil::ReadWrite;
+
+		rp.num_subpasses = 1;
+		rp.subpasses = &subpass;
+	}
+
+	// Call before the first frame and whenever the swapchain changes size, see SwapchainSize.
+	void Resize(uint32_t width, uint32_t height)
+	{
+		if (!depth || width != depth_width || height != depth_height)
+			CreateDepth(width, height);
+	}
+
+	// Call after WSI::BeginFrame(). Returns the render pass of this frame's swapchain image.
+	const Vulkan::RenderPassInfo& BeginFrame()
+	{
+		rp.color_attachments[0].view = &device->GetSwapchainView();
+		return rp;
+	}
+
+	// Returns a render pass compatible with the frames' for PipelineWarmup::Compile(). Call after
+	// Resize(), before the first frame. The swapchain image can only be rendered to within a frame,
+	// so the color attachment is a 1x1 stand-in with the swapchain's format and layout.
+	const Vulkan::RenderPassInfo& GetWarmupRenderPass()
+	{
+		if (!warmup_color)
+		{
+			const Vulkan::ImageView& swapchain_view = device->GetSwapchainView();
+
+			Vulkan::ImageCreateInfo info = Vulkan::ImageCreateInfo::RenderTarget(1, 1, swapchain_view.GetFormat());
+			info.sharing_mode = Vulkan::ImageSharingMode::Exclusive;
+			info.exclusive_owner = Vulkan::IMAGE_COMMAND_QUEUE_GENERIC;
+
+			warmup_color = device->CreateImage(info);
+			warmup_color->SetSwapchainLayout(swapchain_view.GetImage().GetSwapchainLayout());
+		}
+
+		rp.color_attachments[0].view = &warmup_color->GetView();
+		return rp;
+	}
+
+	// Call once warmup is done.
+	void ReleaseWarmup()
+	{
+		rp.color_attachments[0].view = nullptr;
+		warmup_color.Reset();
+	}
+
+	void Reset()
+	{
+		rp.color_attachments[0].view = nullptr;
+		rp.depth_stencil.view = nullptr;
+		depth.Reset();
+		warmup_color.Reset();
+	}
+
+private:
+
+	void CreateDepth(uint32_t width, uint32_t height)
+	{
+		// Frames still in flight keep the old image alive until they complete.
+		Vulkan::ImageCreateInfo info = Vulkan::ImageCreateInfo::RenderTarget(width, height, device->GetDefaultDepthFormat());
+		info.sharing_mode = Vulkan::ImageSharingMode::Exclusive;
+		info.exclusive_owner = Vulkan::IMAGE_COMMAND_QUEUE_GENERIC;
+
+		depth = device->CreateImage(info);
+		depth_width = width;
+		depth_height = height;
+
+		rp.depth_stencil.view = &depth->GetView();
+	}
+
+	Vulkan::Device* device = nullptr;
+	Vulkan::RenderPassInfo rp{};
+	Vulkan::RenderPassInfo::Subpass subpass{};
+	Vulkan::ImageHandle depth;
+	Vulkan::ImageHandle warmup_color;
+	uint32_t depth_width = 0;
+	uint32_t depth_height = 0;
+};
@@ -0,0 +1,57 @@
+#version 450
+
+layout(location = 0) in vec3 in_pos;
+layout(location = 1) in vec2 in_tex_coords;
+layout(location = 2) in vec3 in_normal;
+
+layout(location = 0) out vec2 frag_tex_coords;
+layout(location = 1) out vec3 frag_normal;
+layout(location = 2) out vec3 to_light_vector;
+layout(location = 3) out vec3 to_camera_vector;
+// Only read by glsl/bindless.frag
+layout(location = 4) flat out uint frag_material;
+
+layout(set = 0, binding = 0) uniform VERT_UNIFORM_BUFFER 
+{
+	mat4 proj;
+	mat4 view;
+	vec4 light_pos;
+} ubo;
+
+struct INSTANCE
+{
+	mat4 model;
+	uint mesh;
+	uint material;
+	uint pad1;
+	uint pad2;
+};
+
+// Indirect draws set first_instance to the instance index, see glsl/cull.comp. Devices without
+// drawIndirectFirstInstance draw each instance on its own with the index in instance_offset.
+layout(std430, set = 2, binding = 0) readonly buffer INSTANCES
+{
+	INSTANCE instances[];
+};
+
+layout(push_constant) uniform DRAW_PUSH
+{
+	uint instance_offset;
+} push;
+
+void main()
+{
+	uint instance = uint(gl_InstanceIndex) + push.instance_offset;
+	mat4 model = instances[instance].model;
+	frag_material = instances[instance].material;
+
+	vec4 world_position = model * vec4(in_pos, 1.0);
+	
+	gl_Position = ubo.proj*ubo.view*world_position;
+	
+	frag_tex_coords = in_tex_coords;
+	frag_normal = mat3(model) * in_normal;
+	
+	to_light_vector = ubo.light_pos.xyz - world_position.xyz;
+	to_camera_vector = (inverse(ubo.view) * vec4(0.0,0.0,0.0,1.0)).xyz - world_position.xyz;
+}
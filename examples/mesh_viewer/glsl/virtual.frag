@@ -0,0 +1,112 @@
+#version 450
+
+layout(location = 0) in vec2 frag_tex_coords;
+layout(location = 1) in vec3 frag_normal;
+layout(location = 2) in vec3 to_light_vector;
+layout(location = 3) in vec3 to_camera_vector;
+
+layout(location = 0) out vec4 out_color;
+
+layout(set = 0, binding = 1) uniform FRAG_UNIFORM_BUFFER
+{
+	vec4 light_color;
+	float shine;
+	float reflectivity;
+	float ambient;
+	float word;
+
+} ubo;
+
+// Physical pages of resident tiles, see VirtualTextureRenderer.
+layout(set = 1, binding = 0) uniform sampler2D atlas;
+
+layout(set = 1, binding = 1, std430) readonly buffer VIRTUAL_TEXTURE
+{
+	uint levels;
+	uint atlas_pages;
+	uint feedback_width;
+	uint feedback_height;
+	// x = first page table entry of the level, y = tiles per row, zw = size in texels.
+	uvec4 level_info[16];
+} vt;
+
+// One entry per tile of every level: atlas page x and y, level of the resident tile standing in
+// for it, and a valid byte.
+layout(set = 1, binding = 2, std430) readonly buffer PAGE_TABLE
+{
+	uint entries[];
+} page_table;
+
+// Tile each 8x8 block of the screen wanted, read back by the host.
+layout(set = 1, binding = 3, std430) writeonly buffer FEEDBACK
+{
+	uint tiles[];
+} feedback;
+
+const float tile_size = 128.0;
+const float border = 4.0;
+const float page_size = tile_size + 2.0 * border;
+const uint feedback_scale = 8;
+
+vec2 GetLevelTexel(vec2 uv, uint level)
+{
+	return uv * vec2(vt.level_info[level].zw);
+}
+
+void main()
+{
+	vec3 unit_normal = normalize(frag_normal);
+	vec3 unit_camera_vector = normalize(to_camera_vector);
+	vec3 unit_ligh_vector = normalize(to_light_vector);
+
+	float normal_dot_light = dot(unit_normal, unit_ligh_vector);
+	float brightness = max(normal_dot_light,0.0);
+	vec3 light_direction = -unit_ligh_vector;
+	vec3 reflected_light_direction = reflect(light_direction, unit_normal);
+	float specular_factor = dot(reflected_light_direction , unit_camera_vector);
+	specular_factor = max(specular_factor,0.0);
+	float damped_factor = pow(specular_factor, ubo.shine);
+
+	vec3 diffuse = brightness * ubo.light_color.xyz;
+	vec3 specular = damped_factor * ubo.reflectivity * ubo.light_color.xyz;
+
+	//ambient lighting
+	diffuse = max(diffuse, ubo.ambient);
+
+	// The atlas has no mips, so pick the level from the derivatives of the level 0 texel position,
+	// rounded to the sharper level.
+	vec2 texel = GetLevelTexel(frag_tex_coords, 0);
+	vec2 dx = dFdx(texel);
+	vec2 dy = dFdy(texel);
+	float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1.0));
+	uint level = min(uint(lod), vt.levels - 1);
+
+	// The texture repeats.
+	vec2 uv = fract(frag_tex_coords);
+
+	uvec2 tile = uvec2(GetLevelTexel(uv, level) / tile_size);
+
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	if ((pixel.x % feedback_scale) == 0 && (pixel.y % feedback_scale) == 0)
+	{
+		uvec2 feedback_pixel = uvec2(pixel) / feedback_scale;
+		if (feedback_pixel.x < vt.feedback_width && feedback_pixel.y < vt.feedback_height)
+			feedback.tiles[feedback_pixel.y * vt.feedback_width + feedback_pixel.x] = (level << 28) | (tile.y << 14) | tile.x;
+	}
+
+	uint entry = page_table.entries[vt.level_info[level].x + tile.y * vt.level_info[level].y + tile.x];
+	vec4 texture_color = vec4(1.0, 0.0, 1.0, 1.0);
+	if ((entry >> 24) != 0)
+	{
+		// The entry may stand in for the tile with a coarser one covering it.
+		uint resident_level = (entry >> 16) & 0xff;
+		vec2 resident_texel = GetLevelTexel(uv, resident_level);
+		vec2 in_tile = resident_texel - floor(resident_texel / tile_size) * tile_size;
+
+		vec2 page = vec2(entry & 0xff, (entry >> 8) & 0xff);
+		vec2 atlas_uv = (page * page_size + border + in_tile) / (float(vt.atlas_pages) * page_size);
+		texture_color = textureLod(atlas, atlas_uv, 0.0);
+	}
+
+	out_color = vec4(diffuse, 1.0)*texture_color + vec4(specular, 1.0);
+}
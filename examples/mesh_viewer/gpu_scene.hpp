@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "../common/static_geometry.hpp"
+#include "../common/frame_counters.hpp"
+#include "../common/uniform_ring.hpp"
+#include "../common/std_layout.hpp"
+#include "../common/descriptor_cache.hpp"
+
+#include "indirect_culling.hpp"
+
+// GPU driven scene: all meshes live in one vertex and one index buffer, instance transforms live in
+// a storage buffer, and a compute pass (glsl/cull.comp) writes one indexed indirect command per
+// instance. Culled instances get an instance count of zero. The whole scene is then drawn with
+// a single multi-draw indirect call, or one indirect call per instance without multiDrawIndirect.
+// Without drawIndirectFirstInstance, every command's first instance is 0 and each instance is
+// drawn on its own, with its index in a push constant.
+struct GpuScene
+{
+	// Matches CULL_UNIFORM_BUFFER in glsl/cull.comp (std140).
+	struct CullUniforms
+	{
+		glm::vec4 planes[6];
+		uint32_t instance_count;
+		uint32_t use_first_instance;
+		uint32_t pad[2];
+	};
+
+	static constexpr auto cull_uniforms_layout = StdLayout::Describe<CullUniforms>(QM_EXAMPLES_LAYOUT_MEMBER(CullUniforms, planes), QM_EXAMPLES_LAYOUT_MEMBER(CullUniforms, instance_count),
+		QM_EXAMPLES_LAYOUT_MEMBER(CullUniforms, use_first_instance));
+
+	static_assert(cull_uniforms_layout.IsPacked(StdLayout::Std140), "CullUniforms must follow std140");
+	static_assert(cull_uniforms_layout.Matches<ShaderLayouts::cull_comp::CULL_UNIFORM_BUFFER>(), "CullUniforms must match CULL_UNIFORM_BUFFER");
+
+	// cull_bindings and draw_bindings are the reflected bindings of glsl/cull.comp and of the
+	// program drawing the scene.
+	template<typename VertexType>
+	void Init(Vulkan::Device& device, const MeshLibrary<VertexType>& library, const std::vector<GpuInstance>& instances_, Vulkan::Program& cull_program_,
+		const ShaderBindings& cull_bindings, const ShaderBindings& draw_bindings, DescriptorCache& descriptors)
+	{
+		cull_program = &cull_program_;
+		meshes = library.meshes;
+		instances = instances_;
+		instance_count = static_cast<uint32_t>(instances.size());
+
+		geometry = CreateStaticGeometry(device, library.vertices, library.indices);
+
+		instance_buffer = CreateStaticBuffer(device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(GpuInstance) * instances.size(), instances.data());
+		mesh_buffer = CreateStaticBuffer(device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(GpuMesh) * meshes.size(), meshes.data());
+		draw_buffer = CreateStaticBuffer(device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			sizeof(DrawIndexedIndirectCommand) * instances.size(), nullptr);
+
+		const VkPhysicalDeviceFeatures& features = device.GetGPUFeatures();
+		use_first_instance = features.drawIndirectFirstInstance == VK_TRUE;
+		// A multi-draw can only tell its instances apart by first instance.
+		use_multi_draw = use_first_instance && features.multiDrawIndirect == VK_TRUE && instance_count <= device.GetGPUProperties().limits.maxDrawIndirectCount;
+
+		if (!use_first_instance)
+			QM_LOG_INFO("drawIndirectFirstInstance is not supported, GPU scene instances are drawn one at a time\n");
+
+		cull_uniforms_slot = cull_bindings.Get("CULL_UNIFORM_BUFFER", SpirvDescriptorType::UniformBuffer, sizeof(CullUniforms));
+
+		DescriptorSetContents cull_buffers;
+		cull_buffers.SetStorageBuffer(cull_bindings.Get("INSTANCES", SpirvDescriptorType::StorageBuffer), *instance_buffer);
+		cull_buffers.SetStorageBuffer(cull_bindings.Get("MESHES", SpirvDescriptorType::StorageBuffer), *mesh_buffer);
+		cull_buffers.SetStorageBuffer(cull_bindings.Get("DRAWS", SpirvDescriptorType::StorageBuffer), *draw_buffer);
+		cull_set = descriptors.Register(cull_buffers);
+
+		DescriptorSetContents draw_buffers;
+		draw_buffers.SetStorageBuffer(draw_bindings.Get("INSTANCES", SpirvDescriptorType::StorageBuffer), *instance_buffer);
+		draw_set = descriptors.Register(draw_buffers);
+	}
+
+	// Records the culling dispatch. Must be outside a render pass, before Draw().
+	void Cull(Vulkan::CommandBuffer& cmd, DescriptorCache::Binder& binder, UniformRing& uniforms, FrameCounters& counters, const Frustum& frustum)
+	{
+		// The previous frame's draws may still be reading the commands.
+		cmd.Barrier(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+		cmd.SetProgram(*cull_program);
+
+		CullUniforms cull_uniforms{};
+		std::memcpy(cull_uniforms.planes, frustum.planes, sizeof(frustum.planes));
+		cull_uniforms.instance_count = instance_count;
+		cull_uniforms.use_first_instance = use_first_instance ? 1 : 0;
+		uniforms.Bind(cmd, cull_uniforms_slot, uniforms.Write(cull_uniforms), counters.frame);
+
+		binder.Bind(cmd, cull_set);
+
+		cmd.Dispatch((instance_count + 63) / 64, 1, 1);
+
+		cmd.Barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+	}
+
+	// Draws every instance. Program, state and the shared uniforms must already be set.
+	void Draw(Vulkan::CommandBuffer& cmd, DescriptorCache::Binder& binder) const
+	{
+		geometry.Bind(cmd);
+		binder.Bind(cmd, draw_set);
+
+		const uint32_t stride = sizeof(DrawIndexedIndirectCommand);
+
+		// DRAW_PUSH in glsl/indirect.vert, added to gl_InstanceIndex.
+		uint32_t instance_offset = 0;
+		cmd.PushConstants(&instance_offset, 0, sizeof(instance_offset));
+
+		if (use_multi_draw)
+		{
+			cmd.DrawIndexedIndirect(*draw_buffer, 0, instance_count, stride);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < instance_count; i++)
+			{
+				if (!use_first_instance)
+				{
+					instance_offset = i;
+					cmd.PushConstants(&instance_offset, 0, sizeof(instance_offset));
+				}
+				cmd.DrawIndexedIndirect(*draw_buffer, i * stride, 1, stride);
+			}
+		}
+	}
+
+	// Copies the commands written by the last Cull() back to the CPU. Stalls the device, only meant
+	// for validating the compute pass against CullInstancesReference().
+	void ReadbackDraws(Vulkan::Device& device, std::vector<DrawIndexedIndirectCommand>& draws)
+	{
+		Vulkan::BufferCreateInfo readback_info{};
+		readback_info.domain = Vulkan::BufferDomain::CachedHost;
+		readback_info.size = sizeof(DrawIndexedIndirectCommand) * instance_count;
+		readback_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		readback_info.sharing_mode = Vulkan::BufferSharingMode::Exclusive;
+		readback_info.exclusive_owner = Vulkan::BUFFER_COMMAND_QUEUE_GENERIC;
+
+		Vulkan::BufferHandle readback = device.CreateBuffer(readback_info);
+
+		auto cmd = device.RequestCommandBuffer();
+		cmd->Barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		cmd->CopyBuffer(*readback, 0, *draw_buffer, 0, readback_info.size);
+		device.Submit(cmd);
+		device.WaitIdle();
+
+		draws.resize(instance_count);
+		const void* mapped = device.MapHostBuffer(*readback, Vulkan::MEMORY_ACCESS_READ_BIT);
+		std::memcpy(draws.data(), mapped, readback_info.size);
+		device.UnmapHostBuffer(*readback, Vulkan::MEMORY_ACCESS_READ_BIT);
+	}
+
+	void Reset()
+	{
+		geometry.Reset();
+		instance_buffer.Reset();
+		mesh_buffer.Reset();
+		draw_buffer.Reset();
+	}
+
+	std::vector<GpuMesh> meshes;
+	std::vector<GpuInstance> instances;
+	uint32_t instance_count = 0;
+	bool use_multi_draw = false;
+	bool use_first_instance = true;
+
+private:
+
+	Vulkan::Program* cull_program = nullptr;
+	BindingSlot cull_uniforms_slot;
+	uint32_t cull_set = DescriptorCache::invalid_id;
+	uint32_t draw_set = DescriptorCache::invalid_id;
+
+	StaticGeometry geometry;
+	Vulkan::BufferHandle instance_buffer;
+	Vulkan::BufferHandle mesh_buffer;
+	Vulkan::BufferHandle draw_buffer;
+};
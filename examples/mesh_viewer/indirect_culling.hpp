@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "../common/frustum.hpp"
+#include "../common/std_layout.hpp"
+#include "../common/submesh.hpp"
+
+// Data layouts shared with glsl/cull.comp and glsl/indirect.vert, plus a CPU reference of the
+// culling pass. The reference produces the same draw commands as the compute shader, so
+// visibility can be checked without a GPU.
+
+// One mesh inside the shared vertex/index buffers. Matches MESH in glsl/cull.comp (std430).
+struct GpuMesh
+{
+	// Bounding sphere in model space, xyz = center, w = radius
+	glm::vec4 sphere;
+	uint32_t first_index;
+	uint32_t index_count;
+	int32_t vertex_offset;
+	uint32_t pad;
+};
+
+// Matches INSTANCE in glsl/cull.comp and glsl/indirect.vert (std430).
+struct GpuInstance
+{
+	glm::mat4 model;
+	uint32_t mesh;
+	// Index into the material table, only read by glsl/bindless.frag.
+	uint32_t material;
+	uint32_t pad1;
+	uint32_t pad2;
+};
+
+// Same layout as VkDrawIndexedIndirectCommand.
+struct DrawIndexedIndirectCommand
+{
+	uint32_t index_count;
+	uint32_t instance_count;
+	uint32_t first_index;
+	int32_t vertex_offset;
+	uint32_t first_instance;
+
+	bool operator==(const DrawIndexedIndirectCommand& other) const
+	{
+		return index_count == other.index_count && instance_count == other.instance_count && first_index == other.first_index &&
+			vertex_offset == other.vertex_offset && first_instance == other.first_instance;
+	}
+};
+
+static constexpr auto gpu_mesh_layout = StdLayout::Describe<GpuMesh>(QM_EXAMPLES_LAYOUT_MEMBER(GpuMesh, sphere), QM_EXAMPLES_LAYOUT_MEMBER(GpuMesh, first_index),
+	QM_EXAMPLES_LAYOUT_MEMBER(GpuMesh, index_count), QM_EXAMPLES_LAYOUT_MEMBER(GpuMesh, vertex_offset), QM_EXAMPLES_LAYOUT_MEMBER(GpuMesh, pad));
+
+static constexpr auto gpu_instance_layout = StdLayout::Describe<GpuInstance>(QM_EXAMPLES_LAYOUT_MEMBER(GpuInstance, model), QM_EXAMPLES_LAYOUT_MEMBER(GpuInstance, mesh),
+	QM_EXAMPLES_LAYOUT_MEMBER(GpuInstance, material), QM_EXAMPLES_LAYOUT_MEMBER(GpuInstance, pad1), QM_EXAMPLES_LAYOUT_MEMBER(GpuInstance, pad2));
+
+static constexpr auto draw_command_layout = StdLayout::Describe<DrawIndexedIndirectCommand>(QM_EXAMPLES_LAYOUT_MEMBER(DrawIndexedIndirectCommand, index_count),
+	QM_EXAMPLES_LAYOUT_MEMBER(DrawIndexedIndirectCommand, instance_count), QM_EXAMPLES_LAYOUT_MEMBER(DrawIndexedIndirectCommand, first_index),
+	QM_EXAMPLES_LAYOUT_MEMBER(DrawIndexedIndirectCommand, vertex_offset), QM_EXAMPLES_LAYOUT_MEMBER(DrawIndexedIndirectCommand, first_instance));
+
+// Arrays of these are uploaded as is, so each struct's size must be its std430 array stride.
+static_assert(gpu_mesh_layout.IsPacked(StdLayout::Std430), "GpuMesh must follow std430");
+static_assert(gpu_instance_layout.IsPacked(StdLayout::Std430), "GpuInstance must follow std430");
+static_assert(draw_command_layout.IsPacked(StdLayout::Std430), "DrawIndexedIndirectCommand must follow std430");
+
+static_assert(gpu_mesh_layout.Matches<ShaderLayouts::cull_comp::MESH>(), "GpuMesh must match MESH in glsl/cull.comp");
+static_assert(gpu_instance_layout.Matches<ShaderLayouts::cull_comp::INSTANCE>(), "GpuInstance must match INSTANCE in glsl/cull.comp");
+static_assert(gpu_instance_layout.Matches<ShaderLayouts::indirect_vert::INSTANCE>(), "GpuInstance must match INSTANCE in glsl/indirect.vert");
+static_assert(draw_command_layout.Matches<ShaderLayouts::cull_comp::DRAW_COMMAND>(), "DrawIndexedIndirectCommand must match DRAW_COMMAND in glsl/cull.comp");
+
+// Appends meshes into one vertex and one index list so every instance can be drawn from the same
+// buffers with a single bind.
+template<typename VertexType>
+struct MeshLibrary
+{
+	uint32_t AddMesh(const std::vector<VertexType>& mesh_vertices, const std::vector<uint32_t>& mesh_indices)
+	{
+		Submesh whole;
+		whole.index_count = static_cast<uint32_t>(mesh_indices.size());
+		ComputeSubmeshBounds(mesh_vertices, mesh_indices, whole);
+
+		return AddSubmeshes(mesh_vertices, mesh_indices, { whole });
+	}
+
+	// Appends the vertices and indices once, and one GpuMesh per submesh, so instances can be
+	// culled and drawn per submesh. Returns the index of the first submesh's GpuMesh.
+	uint32_t AddSubmeshes(const std::vector<VertexType>& mesh_vertices, const std::vector<uint32_t>& mesh_indices, const std::vector<Submesh>& submeshes)
+	{
+		uint32_t first_mesh = static_cast<uint32_t>(meshes.size());
+		uint32_t first_index = static_cast<uint32_t>(indices.size());
+		int32_t vertex_offset = static_cast<int32_t>(vertices.size());
+
+		for (const Submesh& submesh : submeshes)
+		{
+			GpuMesh mesh{};
+			mesh.first_index = first_index + submesh.first_index;
+			mesh.index_count = submesh.index_count;
+			mesh.vertex_offset = vertex_offset;
+			// Sphere around the AABB center, tight enough for instance culling.
+			mesh.sphere = submesh.sphere;
+			meshes.push_back(mesh);
+		}
+
+		vertices.insert(vertices.end(), mesh_vertices.begin(), mesh_vertices.end());
+		indices.insert(indices.end(), mesh_indices.begin(), mesh_indices.end());
+
+		return first_mesh;
+	}
+
+	std::vector<VertexType> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<GpuMesh> meshes;
+};
+
+// Culls one instance exactly like glsl/cull.comp.
+static inline DrawIndexedIndirectCommand CullInstance(const Frustum& frustum, const std::vector<GpuMesh>& meshes, const GpuInstance& instance, uint32_t instance_index,
+	bool use_first_instance)
+{
+	const GpuMesh& mesh = meshes[instance.mesh];
+
+	glm::vec3 center = glm::vec3(instance.model * glm::vec4(glm::vec3(mesh.sphere), 1.0f));
+	float scale = std::max(glm::length(glm::vec3(instance.model[0])), std::max(glm::length(glm::vec3(instance.model[1])), glm::length(glm::vec3(instance.model[2]))));
+	float radius = mesh.sphere.w * scale;
+
+	DrawIndexedIndirectCommand draw;
+	draw.index_count = mesh.index_count;
+	draw.instance_count = SphereInFrustum(frustum, center, radius) ? 1 : 0;
+	draw.first_index = mesh.first_index;
+	draw.vertex_offset = mesh.vertex_offset;
+	// glsl/indirect.vert fetches the transform with gl_InstanceIndex, or from a push constant
+	// without drawIndirectFirstInstance.
+	draw.first_instance = use_first_instance ? instance_index : 0;
+
+	return draw;
+}
+
+// CPU reference of glsl/cull.comp: one command per instance, with instance_count 0 when culled.
+static inline void CullInstancesReference(const Frustum& frustum, const std::vector<GpuMesh>& meshes, const std::vector<GpuInstance>& instances, bool use_first_instance,
+	std::vector<DrawIndexedIndirectCommand>& draws)
+{
+	draws.resize(instances.size());
+	for (size_t i = 0; i < instances.size(); i++)
+		draws[i] = CullInstance(frustum, meshes, instances[i], static_cast<uint32_t>(i), use_first_instance);
+}
+
+// Number of commands that differ between two draw lists. Culling results on the GPU can differ
+// from the CPU for spheres lying within float rounding of a plane.
+static inline size_t CountDrawMismatches(const std::vector<DrawIndexedIndirectCommand>& a, const std::vector<DrawIndexedIndirectCommand>& b)
+{
+	size_t mismatches = a.size() > b.size() ? a.size() - b.size() : b.size() - a.size();
+	for (size_t i = 0; i < std::min(a.size(), b.size()); i++)
+		if (!(a[i] == b[i]))
+			mismatches++;
+	return mismatches;
+}
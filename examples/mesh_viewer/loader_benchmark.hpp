@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#include "../common/allocation_tracker.hpp"
+#include "../common/file_loader.hpp"
+#include "../common/loader_arena.hpp"
+#include "../common/process_memory.hpp"
+
+// Writes a grid_size x grid_size quad grid with positions, texture coordinates and normals,
+// shaped like the OBJ files exporters write for dense scans.
+static bool WriteSyntheticObj(const std::string& path, uint32_t grid_size)
+{
+	FILE* file = std::fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+
+	uint32_t row = grid_size + 1;
+	for (uint32_t y = 0; y < row; y++)
+	{
+		for (uint32_t x = 0; x < row; x++)
+		{
+			float u = float(x) / float(grid_size);
+			float v = float(y) / float(grid_size);
+			std::fprintf(file, "v %f %f %f\n", u * 2.0f - 1.0f, 0.05f * float((x * 7 + y * 13) % 17) / 17.0f, v * 2.0f - 1.0f);
+			std::fprintf(file, "vt %f %f\n", u, v);
+			std::fprintf(file, "vn 0 1 0\n");
+		}
+	}
+
+	// One shape of quads, split into triangles by the loader.
+	std::fprintf(file, "o grid\n");
+	for (uint32_t y = 0; y < grid_size; y++)
+	{
+		for (uint32_t x = 0; x < grid_size; x++)
+		{
+			uint32_t a = y * row + x + 1;
+			uint32_t b = a + 1;
+			uint32_t c = a + row + 1;
+			uint32_t d = a + row;
+			std::fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c, d, d, d);
+		}
+	}
+
+	return std::fclose(file) == 0;
+}
+
+// Loads the model and a synthetic 512x512 quad grid twice each, with the loader's temporaries on
+// the heap and in a LoaderArena, and prints load time, how many allocations the temporaries took
+// from the heap, and how far the resident set grew. Built with QM_EXAMPLES_TRACK_ALLOCATIONS it
+// also prints every heap allocation of the load, tinyobj's line buffers included. Needs no window or GPU.
+static void RunLoaderBenchmark(const char* obj_file)
+{
+	const uint32_t grid_size = 512;
+
+	std::string synthetic_path = (std::filesystem::temp_directory_path() / "mesh_viewer_loader_benchmark.obj").string();
+	if (!WriteSyntheticObj(synthetic_path, grid_size))
+	{
+		std::printf("Failed to write %s\n", synthetic_path.c_str());
+		return;
+	}
+
+	std::string model_name = std::filesystem::path(obj_file).filename().string();
+	std::string synthetic_name = "grid " + std::to_string(grid_size) + "x" + std::to_string(grid_size);
+	const char* files[] = { obj_file, synthetic_path.c_str() };
+	const char* names[] = { model_name.c_str(), synthetic_name.c_str() };
+
+	bool peak_resets = ResetPeakResidentBytes();
+
+	std::printf("mesh                 scratch  ms       vertices  indices   heap allocs  scratch MB  peak RSS +MB  all allocs\n");
+
+	for (uint32_t file = 0; file < 2; file++)
+	{
+		for (bool use_arena : { false, true })
+		{
+			AllocationScope allocation_scope(AllocationTag::Loader);
+
+			ObjMesh mesh;
+			uint64_t heap_allocations = 0;
+			uint64_t scratch_bytes = 0;
+
+			ResetPeakResidentBytes();
+			uint64_t resident_before = GetResidentBytes();
+			uint64_t allocations_before = GetTotalAllocationCount();
+
+			Util::Timer timer;
+			timer.start();
+
+			try
+			{
+				if (use_arena)
+				{
+					LoaderArena arena;
+					LoadObjMesh(files[file], mesh, arena.Get());
+					heap_allocations = arena.GetBlockCount();
+					scratch_bytes = arena.GetAllocatedBytes();
+				}
+				else
+				{
+					CountingResource heap;
+					LoadObjMesh(files[file], mesh, &heap);
+					heap_allocations = heap.allocations;
+					scratch_bytes = heap.bytes;
+				}
+			}
+			catch (const std::runtime_error& error)
+			{
+				std::printf("%-20s failed to load: %s\n", names[file], error.what());
+				break;
+			}
+
+			double ms = timer.end() * 1e3;
+			uint64_t all_allocations = GetTotalAllocationCount() - allocations_before;
+			uint64_t peak = GetPeakResidentBytes();
+			double peak_growth = peak > resident_before ? double(peak - resident_before) / (1024.0 * 1024.0) : 0.0;
+
+			std::printf("%-20s %-8s %-8.1f %-9zu %-9zu %-12llu %-11.1f %-13.1f ", names[file], use_arena ? "arena" : "heap", ms,
+				mesh.vertices.size(), mesh.indices.size(), static_cast<unsigned long long>(heap_allocations),
+				double(scratch_bytes) / (1024.0 * 1024.0), peak_growth);
+			if (IsAllocationTrackingEnabled())
+				std::printf("%llu\n", static_cast<unsigned long long>(all_allocations));
+			else
+				std::printf("-\n");
+		}
+	}
+
+	std::filesystem::remove(synthetic_path);
+
+	std::printf("\nheap allocs counts the loader's scratch containers, tinyobj's line buffers and .mtl materials always use the heap\n");
+	if (!IsAllocationTrackingEnabled())
+		std::printf("all allocs needs a build with QM_EXAMPLES_TRACK_ALLOCATIONS\n");
+	if (!peak_resets)
+		std::printf("peak RSS could not be reset on this platform, so it only grows over the rows\n");
+}
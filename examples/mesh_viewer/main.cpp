@@ -1,69 +1,75 @@
 #include <quantumvk/quantumvk.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
-#include <thread>
+#include <vector>
 
 #include <GLFW/glfw3.h>
 
 #define GLM_FORCE_RADIANS
-
 #include <glm/gtc/matrix_transform.hpp>
 
-#include "../common/glfw_platform.hpp"
+#include "../common/descriptor_cache.hpp"
 #include "../common/file_loader.hpp"
-
-static bool is_mouse_pressed = false;
-static double mouse_x = 0, mouse_y = 0;
-
-static inline void SetCameraMouseCallbacks(GLFWwindow* window)
-{
-	glfwSetMouseButtonCallback(window, [](GLFWwindow* window, int button, int action, int mods)
-		{
-			switch (action)
-			{
-			case GLFW_PRESS:
-			{
-				is_mouse_pressed = true;
-				break;
-			}
-			case GLFW_RELEASE:
-			{
-				is_mouse_pressed = false;
-				break;
-			}
-			}
-		});
-
-	/*glfwSetScrollCallback(window, [](GLFWwindow* window, double xOffset, double yOffset)
-		{
-			WindowData& data = *(WindowData*)glfwGetWindowUserPointer(window);
-
-			MouseScrolledEvent event((float)xOffset, (float)yOffset);
-			data.eventCallback(event);
-		})*/;
-
-	glfwSetCursorPosCallback(window, [](GLFWwindow* window, double xPos, double yPos)
-		{
-			mouse_x = xPos; 
-			mouse_y = yPos;
-		});
-}
-
+#include "../common/frame_counters.hpp"
+#include "../common/frame_pacer.hpp"
+#include "../common/glfw_platform.hpp"
+#include "../common/input_thread.hpp"
+#include "../common/loader_arena.hpp"
+#include "../common/pipeline_cache.hpp"
+#include "../common/pipeline_warmup.hpp"
+#include "../common/simd_culling.hpp"
+#include "../common/static_geometry.hpp"
+#include "../common/streaming_uploader.hpp"
+#include "../common/swapchain_size.hpp"
+#include "../common/uniform_ring.hpp"
+#include "../common/worker_pool.hpp"
+
+#include "cluster_culling.hpp"
+#include "frame_context.hpp"
+#include "gpu_scene.hpp"
+#include "material_table.hpp"
+#include "mesh_uniforms.hpp"
+#include "orbit_camera.hpp"
+#include "scene_occlusion.hpp"
+#include "scene_renderer.hpp"
+#include "viewer_options.hpp"
+#include "viewer_programs.hpp"
+#include "viewer_tools.hpp"
+#include "virtual_texture_renderer.hpp"
+
+// Replaces the global allocator with counting hooks when built with QM_EXAMPLES_TRACK_ALLOCATIONS.
+#include "../common/allocation_hooks.hpp"
+
+// mesh_viewer [obj file] [diffuse texture] [options], see --help or viewer_options.hpp for the
+// options and viewer_tools.hpp for the tools that run instead of the viewer.
 int main(int argc, char** argv)
 {
+	ViewerOptions options;
+	if (!ParseViewerOptions(argc, argv, viewer_tools, options))
+		return 1;
+
+	if (options.show_usage)
+	{
+		PrintViewerUsage(viewer_tools);
+		return 0;
+	}
 
-	char* obj_file = "model.obj";
-	char* diffuse_file = "diffuse.png";
+	if (options.tool)
+		return options.tool->run(options, options.tool_values);
 
-	if (argc == 3)
+	if (options.check_allocation_frames != 0 && !IsAllocationTrackingEnabled())
 	{
-		obj_file = argv[1];
-		diffuse_file = argv[2];
+		QM_LOG_ERROR("--check-allocations needs a build with QM_EXAMPLES_TRACK_ALLOCATIONS\n");
+		return 1;
 	}
-	
-	std::cout << "Using obj file " << obj_file << "\n";
-	std::cout << "Using diffuse texture " << diffuse_file << "\n";
 
+	std::cout << "Using obj file " << options.obj_file << "\n";
+	std::cout << "Using diffuse texture " << options.diffuse_file << "\n";
+	std::cout << "Drawing the " << GetDrawModeName(options.draw_mode) << "\n";
+
+	int exit_code = 0;
 
 	glfwInit();
 
@@ -71,65 +77,151 @@ int main(int argc, char** argv)
 		QM_LOG_ERROR("Failed to load vulkan dynamic library");
 
 	{
-		GLFWPlatform platform;
+		GLFWPlatform platform(options.check_allocation_frames == 0);
 
-		SetCameraMouseCallbacks(platform.GetNativeWindow());
+		InputQueue input;
+		platform.SetInputQueue(&input);
 
 		Vulkan::WSI wsi;
 		wsi.SetPlatform(&platform);
 		wsi.SetBackbufferSrgb(true);
-		wsi.Init(1, nullptr, 0);
-
+		// Thread index 0 is the main thread, the rest are used by pipeline warmup and the recording workers.
 		{
-			Vulkan::Device& device = wsi.GetDevice();
-			
-			std::vector<char> vertex_code = ReadFile("spirv/vertex.spv");
-			std::vector<char> frag_code = ReadFile("spirv/fragment.spv");
-			
-			Vulkan::ShaderHandle vert_shader = device.CreateShader(vertex_code.size() / sizeof(uint32_t), reinterpret_cast<const uint32_t*>(vertex_code.data()));
-			Vulkan::ShaderHandle frag_shader = device.CreateShader(frag_code.size() / sizeof(uint32_t), reinterpret_cast<const uint32_t*>(frag_code.data()));
-			
-			Vulkan::GraphicsProgramShaders p_shaders;
-			p_shaders.vertex = vert_shader;
-			p_shaders.fragment = frag_shader;
+			AllocationScope allocation_scope(AllocationTag::WSI);
+			wsi.Init(1 + std::max(GetWarmupThreadCount(), GetWorkerThreadCount()), nullptr, 0);
+		}
 
-			Vulkan::ProgramHandle program = device.CreateGraphicsProgram(p_shaders);
+		FramePacer pacer;
+		pacer.Init(wsi, options.pacing);
 
-			Vulkan::BufferHandle vertex_buffer;
-			Vulkan::BufferHandle index_buffer;
+		// This thread becomes the input thread, handling window events as they arrive, and the
+		// viewer renders on a thread of its own.
+		RunRenderThread(platform, [&]() {
+			Vulkan::Device& device = wsi.GetDevice();
 
-			uint32_t index_count;
+			LoadPipelineCache(device);
+			
+			ViewerPrograms programs;
+			programs.Init(device, options);
+
+			bool use_virtual_texture = options.draw_mode == DrawMode::VirtualTexture;
+			bool use_scene = options.draw_mode == DrawMode::Scene;
+			bool use_gpu_scene = options.draw_mode == DrawMode::GpuScene;
+
+			StaticGeometry model;
+			glm::vec3 model_min(0.0f);
+			glm::vec3 model_max(0.0f);
+
+			MeshLibrary<Vertex> mesh_library;
+			// Material of each mesh in the library, and the first library mesh of each model.
+			std::vector<uint32_t> mesh_materials;
+			std::vector<uint32_t> model_first_meshes;
+			// Decoded textures shared by every loader, see --texture-ram and --texture-vram.
+			TextureCache texture_cache;
+			texture_cache.Init(&device, uint64_t(options.texture_ram_mb) * 1024 * 1024, uint64_t(options.texture_vram_mb) * 1024 * 1024);
+			MaterialTable material_table;
+			OccluderMesh occluder_mesh;
+			ClusteredMesh clustered_model;
+
+			// Streaming only covers the single model, whose draw is skipped until it is resident.
+			StreamingUploader uploader;
+			uint64_t model_ticket = 0;
+			uint64_t diffuse_ticket = 0;
+			if (options.use_streaming)
+				uploader.Init(device, VkDeviceSize(options.stream_budget_mb) * 1024 * 1024);
 
 			std::cout << "Loading model\n";
 			
 			// Create vertex and index buffers
 			{
-				std::vector<Vertex> vertices;
-				std::vector<uint32_t> indices;
+				AllocationScope allocation_scope(AllocationTag::Loader);
+
+				// Holds the loaders' temporaries, freed together at the end of the block.
+				LoaderArena loader_arena;
+
+				ObjMesh obj_mesh;
+				LoadObjMesh(options.obj_file, obj_mesh, loader_arena.Get());
 
-				LoadObjModel(obj_file, vertices, indices);
+				const std::vector<Vertex>& vertices = obj_mesh.vertices;
+				const std::vector<uint32_t>& indices = obj_mesh.indices;
 
 				std::cout << "Model has " << vertices.size() << " vertices, and " << indices.size() << " indices\n";
+				std::cout << "Model has " << obj_mesh.submeshes.size() << " submeshes from " << obj_mesh.shapes.size() << " shapes and "
+					<< obj_mesh.materials.size() << " materials, " << CountMaterialChanges(obj_mesh.submeshes) << " material changes in draw order\n";
 
-				index_count = indices.size();
+				if (options.use_streaming)
+					model = CreateStreamedGeometry(uploader, vertices, indices, model_ticket);
+				else
+					model = CreateStaticGeometry(device, vertices, indices);
 
-				Vulkan::BufferCreateInfo vert_create_info{};
-				vert_create_info.domain = Vulkan::BufferDomain::Device;
-				vert_create_info.size = sizeof(Vertex) * vertices.size();
-				vert_create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-				vert_create_info.sharing_mode = Vulkan::BufferSharingMode::Exclusive;
-				vert_create_info.exclusive_owner = Vulkan::BUFFER_COMMAND_QUEUE_GENERIC;
+				if (!vertices.empty())
+				{
+					model_min = vertices[0].position;
+					model_max = vertices[0].position;
+				}
 
-				vertex_buffer = device.CreateBuffer(vert_create_info, vertices.data());
+				for (const Vertex& vertex : vertices)
+				{
+					model_min = glm::min(model_min, vertex.position);
+					model_max = glm::max(model_max, vertex.position);
+				}
 
-				Vulkan::BufferCreateInfo index_create_info{};
-				index_create_info.domain = Vulkan::BufferDomain::Device;
-				index_create_info.size = sizeof(uint32_t) * indices.size();
-				index_create_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-				index_create_info.sharing_mode = Vulkan::BufferSharingMode::Exclusive;
-				index_create_info.exclusive_owner = Vulkan::BUFFER_COMMAND_QUEUE_GENERIC;
+				if (options.use_clusters)
+				{
+					clustered_model = BuildClusters(vertices, indices);
+					std::cout << "Model has " << clustered_model.clusters.size() << " clusters\n";
+				}
 
-				index_buffer = device.CreateBuffer(index_create_info,  indices.data());
+				if (options.use_occlusion)
+				{
+					if (options.occluder_file)
+					{
+						std::vector<Vertex> occluder_vertices;
+						std::vector<uint32_t> occluder_indices;
+						LoadObjModel(options.occluder_file, occluder_vertices, occluder_indices, loader_arena.Get());
+						occluder_mesh = CreateOccluderMesh(occluder_vertices, occluder_indices);
+					}
+					else
+					{
+						occluder_mesh = CreateOccluderMesh(vertices, indices);
+					}
+
+					std::cout << "Occluder has " << occluder_mesh.GetTriangleCount() << " triangles\n";
+				}
+
+				if (use_gpu_scene)
+				{
+					// Bindless draws cull and draw each submesh as its own instance, with its material.
+					auto add_model = [&]() {
+						model_first_meshes.push_back(static_cast<uint32_t>(mesh_library.meshes.size()));
+
+						if (options.use_bindless)
+						{
+							uint32_t first_material = material_table.AddMaterials(obj_mesh.materials, texture_cache);
+							mesh_library.AddSubmeshes(obj_mesh.vertices, obj_mesh.indices, obj_mesh.submeshes);
+							for (const Submesh& submesh : obj_mesh.submeshes)
+								mesh_materials.push_back(first_material + submesh.material);
+						}
+						else
+						{
+							mesh_library.AddMesh(obj_mesh.vertices, obj_mesh.indices);
+							mesh_materials.push_back(0);
+						}
+					};
+
+					add_model();
+
+					for (const char* mesh_file : options.extra_meshes)
+					{
+						LoadObjMesh(mesh_file, obj_mesh, loader_arena.Get());
+						std::cout << "Mesh " << mesh_file << " has " << obj_mesh.vertices.size() << " vertices, and " << obj_mesh.indices.size() << " indices in "
+							<< obj_mesh.submeshes.size() << " submeshes\n";
+						add_model();
+					}
+
+					if (options.use_bindless)
+						std::cout << "Bindless scene has " << mesh_library.meshes.size() << " meshes over " << model_first_meshes.size() << " models\n";
+				}
 			}
 
 			std::cout << "Loading diffuse texture\n";
@@ -138,8 +230,11 @@ int main(int argc, char** argv)
 			Vulkan::ImageViewHandle diffuse_view;
 
 			{
-				int width, height;
-				std::vector<unsigned char> pixels = LoadTexture(diffuse_file, width, height);
+				uint32_t width = 0, height = 0;
+				const std::vector<uint8_t>* cached_pixels = texture_cache.LoadPixels(options.diffuse_file, width, height);
+				if (!cached_pixels)
+					throw std::runtime_error("failed to load texture image!");
+				const std::vector<uint8_t>& pixels = *cached_pixels;
 
 				std::cout << "Texture has width: " << width << " and height " << height << "\n";
 
@@ -157,7 +252,17 @@ int main(int argc, char** argv)
 				copy.base_array_layer = 0;
 				copy.num_layers = 1;
 
-				diffuse = device.CreateImage(diffuse_create_info,  pixels.size(), pixels.data(), 1, &copy);
+				// A streamed image has a single level, filled in over the next frames.
+				if (options.use_streaming)
+				{
+					diffuse = uploader.CreateImage(width, height);
+					if (diffuse)
+						diffuse_ticket = uploader.UploadImage(*diffuse, width, height, pixels.data());
+				}
+				else
+				{
+					diffuse = device.CreateImage(diffuse_create_info,  pixels.size(), pixels.data(), 1, &copy);
+				}
 
 				if (!diffuse)
 					std::cout << "Failed to create image\n";
@@ -165,7 +270,7 @@ int main(int argc, char** argv)
 				Vulkan::ImageViewCreateInfo view_info{};
 				view_info.image = diffuse;
 				view_info.base_layer = 0;
-				view_info.base_level = 1;
+				view_info.base_level = options.use_streaming ? 0 : 1;
 				view_info.view_type = VK_IMAGE_VIEW_TYPE_2D;
 				
 				diffuse_view = device.CreateImageView(view_info);
@@ -174,8 +279,38 @@ int main(int argc, char** argv)
 
 			std::cout << "Diffuse texture loaded\n";
 
+			// The programs share glsl/shader.frag, so their texture sets register as one.
+			DescriptorCache descriptors;
+			FrameResources program_resources = CreateFrameResources(programs.program_bindings, *diffuse_view, descriptors);
+			FrameResources scene_resources;
+			FrameResources indirect_resources;
+			if (use_scene)
+				scene_resources = CreateFrameResources(programs.scene_bindings, *diffuse_view, descriptors);
+			if (options.use_bindless)
+			{
+				material_table.Create(device, texture_cache, *diffuse_view, programs.indirect_bindings, descriptors);
+				indirect_resources = CreateFrameResources(programs.indirect_bindings, material_table.texture_set);
+			}
+			else if (use_gpu_scene)
+			{
+				indirect_resources = CreateFrameResources(programs.indirect_bindings, *diffuse_view, descriptors);
+			}
+
+			// Its texture set changes with the frame context, see VirtualTextureRenderer::GetTextureSet().
+			VirtualTextureRenderer virtual_texture;
+			FrameResources virtual_resources;
+			if (use_virtual_texture)
+			{
+				use_virtual_texture = virtual_texture.Init(device, options.virtual_texture_file, device.GetSwapchainWidth(), device.GetSwapchainHeight(), programs.virtual_bindings, descriptors);
+				if (!use_virtual_texture)
+					QM_LOG_ERROR("Failed to load virtual texture %s, drawing %s instead\n", options.virtual_texture_file, options.diffuse_file);
+				virtual_resources = CreateFrameResources(programs.virtual_bindings, DescriptorCache::invalid_id);
+			}
+
 			glm::mat4 proj_matrix;
 			glm::mat4 view_matrix;
+			// View projection the GPU culled the last frame with, before any late latch moved the camera.
+			glm::mat4 cull_view_proj;
 
 			glm::vec4 light_position;
 			glm::vec4 light_color;
@@ -184,42 +319,355 @@ int main(int argc, char** argv)
 			float reflectivity;
 			float ambient;
 
-			float theta = 0;
-			float phi = 0;
+			OrbitCamera camera;
+
+			// Set for the interactive frames, render_frame() then updates the camera right before submitting.
+			bool latch_camera = false;
+
+			FrameCounters counters;
+
+			UniformRing uniforms;
+			uniforms.Init(device, 4096);
+
+			FrameRenderContext frame_context;
+			frame_context.Init(device);
+			SwapchainSize swapchain_size;
+			UniformRing::Allocation vertex_uniforms;
+			UniformRing::Allocation fragment_uniforms;
+
+			// At most one range per cluster, so culling never grows it.
+			std::vector<ClusterRange> cluster_ranges;
+			cluster_ranges.reserve(clustered_model.clusters.size());
+			ClusterCullStats cluster_stats;
+			uint32_t cluster_frames = 0;
+
+			PipelineStateDesc opaque_state;
+			opaque_state.program = "mesh";
+			opaque_state.color_formats = { device.GetSwapchainView().GetFormat() };
+			opaque_state.depth_format = device.GetDefaultDepthFormat();
+			opaque_state.bindings = { { 0, sizeof(float) * 8 } };
+			opaque_state.attribs = {
+				{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+				{ 1, 0, VK_FORMAT_R32G32_SFLOAT, sizeof(float) * 3 },
+				{ 2, 0, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3 + sizeof(float) * 2 },
+			};
+			opaque_state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+			opaque_state.cull_mode = VK_CULL_MODE_NONE;
+			opaque_state.depth_test = true;
+			opaque_state.depth_write = true;
+			opaque_state.depth_compare = VK_COMPARE_OP_LESS;
+
+			PipelineStateDesc scene_state = opaque_state;
+			scene_state.program = "scene";
+
+			PipelineStateDesc indirect_state = opaque_state;
+			indirect_state.program = options.use_bindless ? "bindless" : "indirect";
+
+			PipelineStateDesc virtual_state = opaque_state;
+			virtual_state.program = "virtual";
+
+			// Compile every pipeline this run or a previous one used before the first frame.
+			PipelineWarmup warmup;
+			warmup.RegisterProgram(opaque_state.program, *programs.program, programs.program_bindings);
+			if (use_scene)
+				warmup.RegisterProgram(scene_state.program, *programs.scene_program, programs.scene_bindings);
+			if (use_gpu_scene)
+				warmup.RegisterProgram(indirect_state.program, *programs.indirect_program, programs.indirect_bindings);
+			if (use_virtual_texture)
+				warmup.RegisterProgram(virtual_state.program, *programs.virtual_program, programs.virtual_bindings);
+			warmup.LoadList("pipeline_states.txt");
+			warmup.Add(opaque_state);
+			if (use_scene)
+				warmup.Add(scene_state);
+			if (use_gpu_scene)
+				warmup.Add(indirect_state);
+			if (use_virtual_texture)
+				warmup.Add(virtual_state);
+			// Warmup renders into the frames' own depth buffer, created here at the swapchain's size.
+			frame_context.Resize(device.GetSwapchainWidth(), device.GetSwapchainHeight());
+			warmup.Compile(device, frame_context.GetWarmupRenderPass(), 1, GetWarmupThreadCount());
+			frame_context.ReleaseWarmup();
+
+			WorkerPool pool(GetWorkerThreadCount());
+			SceneRenderer scene(pool);
+
+			if (options.bench_record)
+				scene.instances = CreateInstanceGrid(100000, model_min, model_max);
+			else if (options.scene_count != 0)
+				scene.instances = CreateInstanceGrid(options.scene_count, model_min, model_max);
+
+			// The scene is static, so the hierarchy is built once and never refit.
+			CullingBvh scene_bvh;
+			CullingPath cull_path = GetBestCullingPath();
+			std::vector<uint32_t> scene_draw_list;
+			SceneOcclusion scene_occlusion;
+
+			if (options.scene_count != 0 && !options.bench_record)
+			{
+				std::vector<glm::vec3> instance_min(scene.instances.size());
+				std::vector<glm::vec3> instance_max(scene.instances.size());
+				for (size_t i = 0; i < scene.instances.size(); i++)
+					TransformAabb(scene.instances[i], model_min, model_max, instance_min[i], instance_max[i]);
 
-			float radius = 0.6f;
+				scene_bvh.Build(instance_min, instance_max);
+				scene_draw_list.reserve(scene.instances.size());
 
-			double last_time = 0;
-			double current_delta = 0;
+				if (options.use_occlusion)
+					scene_occlusion.Init(std::move(occluder_mesh), std::move(instance_min), std::move(instance_max));
 
-			double last_mouse_x = 0, last_mouse_y = 0;
-			double mouse_dx = 0, mouse_dy = 0;
-			
-			while (platform.Alive(wsi))
+				std::cout << "Scene culling uses a " << scene_bvh.nodes.size() << " node hierarchy with the " << GetCullingPathName(cull_path) << " path\n";
+			}
+
+			GpuScene gpu_scene;
+
+			if (use_gpu_scene)
+			{
+				// Space the grid for the largest mesh, and cycle through the models. Every mesh of a
+				// model is its own instance.
+				float max_radius = 0.0f;
+				for (const GpuMesh& mesh : mesh_library.meshes)
+					max_radius = std::max(max_radius, glm::length(glm::vec3(mesh.sphere)) + mesh.sphere.w);
+
+				std::vector<glm::mat4> transforms = CreateInstanceGrid(options.gpu_scene_count, glm::vec3(-max_radius), glm::vec3(max_radius));
+
+				model_first_meshes.push_back(static_cast<uint32_t>(mesh_library.meshes.size()));
+				uint32_t model_count = static_cast<uint32_t>(model_first_meshes.size() - 1);
+
+				std::vector<GpuInstance> instances;
+				for (size_t i = 0; i < transforms.size(); i++)
+				{
+					uint32_t model_index = static_cast<uint32_t>(i % model_count);
+					for (uint32_t mesh = model_first_meshes[model_index]; mesh < model_first_meshes[model_index + 1]; mesh++)
+					{
+						GpuInstance instance{};
+						instance.model = transforms[i];
+						instance.mesh = mesh;
+						instance.material = mesh_materials[mesh];
+						instances.push_back(instance);
+					}
+				}
+
+				gpu_scene.Init(device, mesh_library, instances, *programs.cull_program, programs.cull_bindings, programs.indirect_bindings, descriptors);
+				mesh_library = {};
+
+				std::cout << "GPU scene has " << instances.size() << " instances of " << gpu_scene.meshes.size() << " meshes, "
+					<< (gpu_scene.use_multi_draw ? "using" : "without") << " multi-draw indirect\n";
+			}
+
+			uint32_t grid_count = use_gpu_scene ? options.gpu_scene_count : options.scene_count;
+			if (grid_count != 0)
 			{
-				if (is_mouse_pressed)
+				// Back off far enough to see the whole grid.
+				const glm::mat4& corner = use_gpu_scene ? gpu_scene.instances.back().model : scene.instances.back();
+				float scene_extent = glm::length(glm::vec3(corner[3]));
+				camera.radius = std::max(camera.radius, scene_extent * 1.5f);
+			}
+
+			// Binds per-frame uniforms and textures shared by the single mesh and scene programs. The
+			// uniforms are written once per frame in render_frame; every command buffer, including
+			// each worker's secondary, only binds them.
+			auto set_frame_resources = [&](Vulkan::CommandBuffer& cmd, DescriptorCache::Binder& binder, const FrameResources& resources, TransientAllocationCounters& frame_counters) {
+				uniforms.Bind(cmd, resources.vertex_uniforms, vertex_uniforms, frame_counters);
+				uniforms.Bind(cmd, resources.fragment_uniforms, fragment_uniforms, frame_counters);
+
+				binder.Bind(cmd, resources.texture_set);
+			};
+
+			// Call after WSI::BeginFrame(). Resizes the depth buffer on the first frame and after the
+			// swapchain changed size, and returns true then, otherwise only compares the size.
+			auto update_swapchain_size = [&]() -> bool {
+				if (!swapchain_size.Update(device))
+					return false;
+
+				frame_context.Resize(swapchain_size.width, swapchain_size.height);
+				return true;
+			};
+
+			// Records and submits one frame. Without a draw list the single model is drawn directly,
+			// otherwise the listed scene instances are recorded on thread_count workers.
+			// Returns the CPU time spent recording, in seconds.
+			auto render_frame = [&](const std::vector<uint32_t>* draw_list, uint32_t thread_count) -> double {
+				Util::Timer record_timer;
+				record_timer.start();
+
+				uniforms.BeginFrame();
+				descriptors.BeginFrame();
+				if (options.use_streaming)
+					uploader.Flush();
+				vertex_uniforms = uniforms.Write(VertexUniforms{ proj_matrix, view_matrix, light_position });
+				fragment_uniforms = uniforms.Write(FragmentUniforms{ light_color, shine, reflectivity, ambient, 0.0f });
+
+				auto cmd = device.RequestCommandBuffer(Vulkan::CommandBuffer::Type::Generic);
+				DescriptorCache::Binder binder(descriptors);
+
+				const Vulkan::RenderPassInfo& rp = frame_context.BeginFrame();
+
+				if (use_gpu_scene)
+				{
+					cull_view_proj = proj_matrix * view_matrix;
+					gpu_scene.Cull(*cmd, binder, uniforms, counters, ExtractFrustum(cull_view_proj));
+
+					cmd->BeginRenderPass(rp);
+
+					indirect_state.Apply(*cmd, *programs.indirect_program);
+
+					set_frame_resources(*cmd, binder, indirect_resources, counters.frame);
+
+					gpu_scene.Draw(*cmd, binder);
+				}
+				else if (!draw_list && use_virtual_texture)
+				{
+					virtual_texture.Update(*cmd);
+					virtual_resources.texture_set = virtual_texture.GetTextureSet();
+
+					cmd->BeginRenderPass(rp);
+
+					virtual_state.Apply(*cmd, *programs.virtual_program);
+
+					model.Bind(*cmd);
+
+					set_frame_resources(*cmd, binder, virtual_resources, counters.frame);
+
+					if (!options.use_streaming || uploader.IsComplete(model_ticket))
+						model.Draw(*cmd);
+				}
+				else if (!draw_list)
 				{
-					theta += mouse_dx * current_delta * 4.0f;
-					phi += mouse_dy * current_delta * 4.0f;
+					cmd->BeginRenderPass(rp);
+
+					opaque_state.Apply(*cmd, *programs.program);
+
+					model.Bind(*cmd);
 
-					if (phi > 80.0f)
+					set_frame_resources(*cmd, binder, program_resources, counters.frame);
+
+					if (options.use_streaming && !(uploader.IsComplete(model_ticket) && uploader.IsComplete(diffuse_ticket)))
+					{
+						// Still streaming in, the frame only clears.
+					}
+					else if (options.use_clusters)
 					{
-						phi = 80.0f;
+						// Replaces the static index buffer with the visible clusters' indices.
+						uint32_t index_count = GetIndexCount(cluster_ranges);
+						if (index_count != 0)
+						{
+							uint32_t* cluster_indices = static_cast<uint32_t*>(AllocateIndexData(*cmd, counters, index_count * sizeof(uint32_t), VK_INDEX_TYPE_UINT32));
+							CompactClusterIndices(clustered_model, cluster_ranges, cluster_indices);
+							cmd->DrawIndexed(index_count);
+						}
 					}
-					else if (phi < -80.0f)
+					else
+					{
+						model.Draw(*cmd);
+					}
+				}
+				else
+				{
+					cmd->BeginRenderPass(rp, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+					scene.Record(*cmd, thread_count, *draw_list, model, [&](Vulkan::CommandBuffer& secondary, TransientAllocationCounters& worker_counters) {
+						scene_state.Apply(secondary, *programs.scene_program);
+						DescriptorCache::Binder secondary_binder(descriptors);
+						set_frame_resources(secondary, secondary_binder, scene_resources, worker_counters);
+					}, counters.frame);
+				}
+
+				cmd->EndRenderPass();
+
+				if (use_virtual_texture && !draw_list)
+					virtual_texture.EndFrame(*cmd);
+
+				double record_time = record_timer.end();
+
+				// Late latch: the camera follows the cursor up to now, and the view matrix is patched
+				// straight into the mapped uniforms every command buffer of the frame reads. Culling
+				// used the camera from the start of the frame, which differs by at most a frame's motion.
+				if (latch_camera && vertex_uniforms.in_ring)
+				{
+					InputEvent event;
+					while (input.Pop(event, glfwGetTime()))
+						camera.Apply(event);
+
+					view_matrix = camera.GetViewMatrix();
+					std::memcpy(static_cast<uint8_t*>(vertex_uniforms.data) + offsetof(VertexUniforms, view), &view_matrix, sizeof(view_matrix));
+					pacer.MarkInputSampled();
+				}
+
+				pacer.Submit(cmd);
+
+				return record_time;
+			};
+
+			if (options.bench_record)
+			{
+				proj_matrix = OrbitCamera::GetProjectionMatrix((float)device.GetSwapchainWidth() / (float)device.GetSwapchainHeight());
+				view_matrix = glm::lookAt(glm::vec3(camera.radius, 0.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+
+				const uint32_t warmup_frames = 5;
+				const uint32_t measured_frames = 20;
+
+				std::cout << "draws    threads  record ms/frame\n";
+
+				for (uint32_t draws : { 1000u, 10000u, 100000u })
+				{
+					std::vector<uint32_t> draw_list(draws);
+					for (uint32_t i = 0; i < draws; i++)
+						draw_list[i] = i;
+
+					for (uint32_t threads = 1; threads <= pool.GetThreadCount(); threads *= 2)
 					{
-						phi = -80.0f;
+						double total = 0.0;
+
+						for (uint32_t frame = 0; frame < warmup_frames + measured_frames; frame++)
+						{
+							wsi.BeginFrame();
+							update_swapchain_size();
+							double record_time = render_frame(&draw_list, threads);
+							wsi.EndFrame();
+
+							if (frame >= warmup_frames)
+								total += record_time;
+						}
+
+						std::printf("%-8u %-8u %.3f\n", draws, threads, total / measured_frames * 1000.0);
 					}
 				}
+			}
 
-				float camera_x = glm::cos(glm::radians(theta)) * radius * glm::cos(glm::radians(phi));
-				float camera_y = glm::sin(glm::radians(theta)) * radius * glm::cos(glm::radians(phi));
-				float camera_z = glm::sin(glm::radians(phi)) * radius;
+			bool first_frame = true;
 
-				proj_matrix = glm::perspective(glm::radians(70.0f), (float)device.GetSwapchainWidth() / (float)device.GetSwapchainHeight(), .01f, 1000.0f);
-				proj_matrix[1][1] *= -1;
+			FrameAllocationCounter frame_allocations;
+			frame_allocations.BeginFrame();
 
-				view_matrix = glm::lookAt(glm::vec3(camera_x, camera_y, camera_z), glm::vec3(0.0f, 0.25f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+			latch_camera = options.late_latch;
+			
+			while (!options.bench_record && platform.Alive(wsi))
+			{
+				AllocationScope frame_allocation_scope(AllocationTag::Frame);
+
+				// Input is read after any wait for the GPU, rather than at the end of the last frame.
+				// Events are handled on the input thread, this only applies pending resizes.
+				pacer.BeginFrame();
+				platform.PollInput();
+
+				InputEvent event;
+				while (input.Pop(event, glfwGetTime()))
+					camera.Apply(event);
+
+				if (options.check_allocation_frames != 0)
+				{
+					if (frame_allocations.steady_frames >= options.check_allocation_frames)
+						break;
+
+					// Orbit, so culling sees a changing view.
+					camera.theta += 0.5f;
+				}
+
+				glm::vec3 camera_position = camera.GetPosition();
+
+				view_matrix = camera.GetViewMatrix();
+
+				pacer.MarkInputSampled();
 
 				light_position = { 0.0f, 10.0f, 10.0f, 0.0f };
 				light_color = { 1.0f, 1.0f, 1.0f, 0.0f };
@@ -231,106 +679,145 @@ int main(int argc, char** argv)
 				Util::Timer timer;
 				timer.start();
 
-				wsi.BeginFrame();
+				{
+					AllocationScope allocation_scope(AllocationTag::WSI);
+					wsi.BeginFrame();
+				}
+
+				// The projection only changes with the swapchain's size.
+				if (update_swapchain_size())
+				{
+					proj_matrix = OrbitCamera::GetProjectionMatrix(swapchain_size.GetAspect());
+				}
+
 				{	
 					// Rendering process
-					
-					auto cmd = device.RequestCommandBuffer(Vulkan::CommandBuffer::Type::Generic);
 
-					Vulkan::RenderPassInfo rp{};
-					rp.num_color_attachments = 1;
-					rp.color_attachments[0].view = &device.GetSwapchainView();
-					rp.color_attachments[0].clear_color.float32[0] = 0.1f;
-					rp.color_attachments[0].clear_color.float32[1] = 0.2f;
-					rp.color_attachments[0].clear_color.float32[2] = 0.3f;
+					if (options.scene_count != 0)
+					{
+						scene_draw_list.clear();
+						scene_bvh.Cull(ExtractFrustum(proj_matrix * view_matrix), scene_draw_list, cull_path);
+						if (options.use_occlusion)
+							scene_occlusion.Cull(proj_matrix * view_matrix, camera_position, scene.instances, scene_draw_list, &pool);
+						render_frame(&scene_draw_list, options.record_threads);
+					}
+					else
+					{
+						if (options.use_clusters)
+						{
+							// The model is drawn with an identity transform, so world space is model space.
+							cluster_ranges.clear();
+							cluster_stats.Add(CullClusters(clustered_model, ExtractFrustum(proj_matrix * view_matrix), camera_position, cluster_ranges));
+							cluster_frames++;
+						}
+
+						render_frame(nullptr, options.record_threads);
+					}
+					
+					// -----------------
+				}
 
-					rp.clear_attachments = ~0u;
-					rp.store_attachments = 1u << 0;
+				{
+					AllocationScope allocation_scope(AllocationTag::WSI);
+					wsi.EndFrame();
+				}
 
-					rp.depth_stencil.view = &device.GetPhysicalAttachment(device.GetSwapchainWidth(), device.GetSwapchainHeight(), device.GetDefaultDepthFormat());
-					rp.depth_stencil.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+				pacer.EndFrame();
+				counters.EndFrame();
 
-					rp.op_flags |= Vulkan::RENDER_PASS_OP_CLEAR_DEPTH_STENCIL_BIT;
+				if (first_frame)
+				{
+					QM_LOG_INFO("First frame took %f ms\n", timer.end() * 1000.0);
+					first_frame = false;
 
-					Vulkan::RenderPassInfo::Subpass subpass{};
-					subpass.num_color_attachments = 1;
-					subpass.color_attachments[0] = 0;
-					subpass.depth_stencil_mode = Vulkan::RenderPassInfo::DepthStencil::ReadWrite;
+					if (options.scene_count != 0)
+						QM_LOG_INFO("%zu of %u scene instances visible\n", scene_draw_list.size(), options.scene_count);
 
-					rp.num_subpasses = 1;
-					rp.subpasses = &subpass;
+					if (options.use_occlusion)
+					{
+						const OcclusionStats& stats = scene_occlusion.buffer.stats;
+						QM_LOG_INFO("Occlusion culled %u instances behind %u occluders (%u triangles) rendered in %f ms\n",
+							scene_occlusion.culled, stats.occluders, stats.rasterized_triangles, stats.render_ms);
 
-					cmd->BeginRenderPass(rp);
+						if (options.dump_depth && scene_occlusion.buffer.WriteDepthDump("occlusion_depth.pgm", false) && scene_occlusion.buffer.WriteDepthDump("occlusion_hiz.pgm", true))
+							QM_LOG_INFO("Wrote occlusion_depth.pgm and occlusion_hiz.pgm\n");
+					}
 
-					cmd->SetProgram(*program);
+					if (use_gpu_scene && options.verify_cull)
+					{
+						std::vector<DrawIndexedIndirectCommand> gpu_draws;
+						gpu_scene.ReadbackDraws(device, gpu_draws);
 
-					cmd->SetOpaqueState();
-					cmd->SetDepthTest(true, true);
-					cmd->SetDepthCompare(VK_COMPARE_OP_LESS);
+						std::vector<DrawIndexedIndirectCommand> cpu_draws;
+						// Against the frustum the GPU used, view_matrix may have been latched since.
+						CullInstancesReference(ExtractFrustum(cull_view_proj), gpu_scene.meshes, gpu_scene.instances, gpu_scene.use_first_instance, cpu_draws);
 
-					cmd->SetVertexAttrib(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0);
-					cmd->SetVertexAttrib(1, 0, VK_FORMAT_R32G32_SFLOAT, sizeof(float) * 3);
-					cmd->SetVertexAttrib(2, 0, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3 + sizeof(float) * 2);
+						size_t visible = std::count_if(cpu_draws.begin(), cpu_draws.end(), [](const DrawIndexedIndirectCommand& draw) { return draw.instance_count != 0; });
 
-					cmd->SetVertexBinding(0, sizeof(float) * 8);
-					
-					cmd->SetPrimitiveTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-					cmd->SetCullMode(VK_CULL_MODE_NONE);
-
-					cmd->BindVertexBuffer(0, *vertex_buffer, 0);
-					cmd->BindIndexBuffer(*index_buffer, 0, VK_INDEX_TYPE_UINT32);
-
-					uint8_t* vert_ubo = static_cast<uint8_t*>(cmd->AllocateConstantData(0, 0, 0, 144));
-					*(glm::mat4*)vert_ubo = proj_matrix;
-					vert_ubo += sizeof(glm::mat4);
-					*(glm::mat4*)vert_ubo = view_matrix;
-					vert_ubo += sizeof(glm::mat4);
-					*(glm::vec4*)vert_ubo = light_position;
-					vert_ubo += sizeof(glm::vec4);
-
-					uint8_t* frag_ubo = static_cast<uint8_t*>(cmd->AllocateConstantData(0, 1, 0, 32));
-					*(glm::vec4*)frag_ubo = light_color;
-					frag_ubo += sizeof(glm::vec4);
-					*(float*)frag_ubo = shine;
-					frag_ubo += sizeof(float);
-					*(float*)frag_ubo = reflectivity;
-					frag_ubo += sizeof(float);
-					*(float*)frag_ubo = ambient;
-					frag_ubo += sizeof(float);
-					*(float*)frag_ubo = 0.0f;
-					frag_ubo += sizeof(float);
-
-					cmd->SetSampledTexture(1, 0, 0, *diffuse_view, Vulkan::StockSampler::LinearWrap);
-
-					cmd->DrawIndexed(index_count);
-
-					cmd->EndRenderPass();
-					device.Submit(cmd);
-					
-					// -----------------
+						std::cout << "CPU reference: " << visible << " of " << cpu_draws.size() << " instances visible, "
+							<< CountDrawMismatches(gpu_draws, cpu_draws) << " commands differ from the GPU\n";
+						break;
+					}
 				}
 
-				wsi.EndFrame();
-
-				double time = glfwGetTime();
-				current_delta = time - last_time;
-				last_time = time;
-
-				mouse_dx = mouse_x - last_mouse_x;
-				mouse_dy = mouse_y - last_mouse_y;
+				// Counts everything since the last frame's on every thread, so the input thread's event
+				// handling is included as well as this thread's rendering.
+				frame_allocations.EndFrame();
+			}
 
-				last_mouse_x = mouse_x;
-				last_mouse_y = mouse_y;
+			if (options.use_clusters && cluster_stats.triangles != 0)
+			{
+				QM_LOG_INFO("Cluster culling removed %.1f%% of triangles over %u frames (%.1f%% off screen, %.1f%% backfacing)\n",
+					100.0 * cluster_stats.GetCulledFraction(), cluster_frames, 100.0 * cluster_stats.frustum_culled / cluster_stats.triangles,
+					100.0 * cluster_stats.backface_culled / cluster_stats.triangles);
+			}
 
+			descriptors.LogStats();
+			if (options.use_streaming)
+				uploader.LogStats();
+			if (use_virtual_texture)
+				virtual_texture.LogStats();
+			texture_cache.LogStats();
+			pacer.LogStats();
+			frame_allocations.LogStats();
+			LogAllocationStats();
+
+			if (options.check_allocation_frames != 0)
+			{
+				if (frame_allocations.steady_frames < options.check_allocation_frames)
+				{
+					QM_LOG_ERROR("Allocation check ended after %llu of %u frames\n", static_cast<unsigned long long>(frame_allocations.steady_frames), options.check_allocation_frames);
+					exit_code = 1;
+				}
+				else if (frame_allocations.allocating_frames != 0)
+				{
+					QM_LOG_ERROR("Allocation check failed, the steady state allocates\n");
+					exit_code = 1;
+				}
 			}
 
-			program.Reset();
+			uniforms.Reset();
+			frame_context.Reset();
+			uploader.Reset();
+			virtual_texture.Reset();
+			model.Reset();
+			gpu_scene.Reset();
+			material_table.Reset();
+			texture_cache.ResetImages();
+			programs.Reset();
 			device.WaitIdle();
-		}
+			SavePipelineCache(device);
+			warmup.SaveList("pipeline_states.txt");
+		});
+
+		platform.SetInputQueue(nullptr);
+		input.LogStats();
 
 
 		QM_LOG_TRACE("Detroying WSI\n");
 	}
 
 	glfwTerminate();
+
+	return exit_code;
 }
\ No newline at end of file
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../common/file_loader.hpp"
+#include "../common/static_geometry.hpp"
+#include "../common/std_layout.hpp"
+#include "../common/descriptor_cache.hpp"
+#include "../common/texture_cache.hpp"
+
+#include "indirect_culling.hpp"
+
+// Matches MATERIAL in glsl/bindless.frag (std430).
+struct GpuMaterial
+{
+	glm::vec4 diffuse_color;
+	// Element of the material_textures array.
+	uint32_t texture;
+	uint32_t pad0;
+	uint32_t pad1;
+	uint32_t pad2;
+};
+
+static constexpr auto gpu_material_layout = StdLayout::Describe<GpuMaterial>(QM_EXAMPLES_LAYOUT_MEMBER(GpuMaterial, diffuse_color),
+	QM_EXAMPLES_LAYOUT_MEMBER(GpuMaterial, texture), QM_EXAMPLES_LAYOUT_MEMBER(GpuMaterial, pad0), QM_EXAMPLES_LAYOUT_MEMBER(GpuMaterial, pad1),
+	QM_EXAMPLES_LAYOUT_MEMBER(GpuMaterial, pad2));
+
+static_assert(gpu_material_layout.IsPacked(StdLayout::Std430), "GpuMaterial must follow std430");
+static_assert(gpu_material_layout.Matches<ShaderLayouts::bindless_frag::MATERIAL>(), "GpuMaterial must match MATERIAL in glsl/bindless.frag");
+
+// Every material of a GPU scene, for drawing it bindlessly: the textures of all materials live in
+// one descriptor array (material_textures in glsl/bindless.frag), material parameters in a storage
+// buffer next to it, and each instance, one per submesh (see LoadObjMesh()), carries its material index. The whole scene then shares a
+// single texture set, bound once, so models with many materials still draw with one multi-draw
+// indirect call.
+struct MaterialTable
+{
+	// Size of the material_textures array in glsl/bindless.frag.
+	static constexpr uint32_t max_textures = 64;
+
+	// Element 0 is plain white, for materials without a diffuse map.
+	static constexpr uint32_t white_texture = 0;
+	// Element 1 is the default texture given to Create(), for triangles without a material.
+	static constexpr uint32_t default_texture = 1;
+
+	// Queues the materials of one model and returns the index of its first one. Material i of the
+	// model is then first + i, and its triangles without a material use first + materials.size().
+	// Their textures start decoding in the background.
+	uint32_t AddMaterials(const std::vector<ObjMaterial>& materials, TextureCache& textures)
+	{
+		uint32_t first = static_cast<uint32_t>(obj_materials.size());
+		obj_materials.insert(obj_materials.end(), materials.begin(), materials.end());
+
+		for (const ObjMaterial& material : materials)
+		{
+			if (!material.diffuse_texture.empty())
+				textures.Prefetch(material.diffuse_texture);
+		}
+
+		// Stands for "no material", drawn with the default texture.
+		ObjMaterial none;
+		none.name = "default";
+		obj_materials.push_back(none);
+		default_materials.push_back(static_cast<uint32_t>(obj_materials.size() - 1));
+
+		return first;
+	}
+
+	// Loads every queued material's texture through textures, uploads the material buffer and
+	// registers the set holding both with descriptors. bindings are the bindings of the program
+	// using glsl/bindless.frag. The textures stay acquired until Reset().
+	void Create(Vulkan::Device& device, TextureCache& textures_, const Vulkan::ImageView& default_view, const ShaderBindings& bindings, DescriptorCache& descriptors)
+	{
+		textures = &textures_;
+
+		if (device.GetGPUFeatures().shaderSampledImageArrayDynamicIndexing != VK_TRUE)
+			QM_LOG_ERROR("shaderSampledImageArrayDynamicIndexing is not supported, bindless materials may sample the wrong texture\n");
+
+		const uint8_t white[4] = { 255, 255, 255, 255 };
+		white_view = CreateTextureView(device, 1, 1, white, white_image);
+
+		texture_views.clear();
+		texture_views.push_back(&*white_view);
+		texture_views.push_back(&default_view);
+
+		// Materials often share maps, give each cached texture one element.
+		std::unordered_map<uint32_t, uint32_t> texture_indices;
+
+		materials.resize(obj_materials.size());
+		for (size_t i = 0; i < obj_materials.size(); i++)
+		{
+			const ObjMaterial& obj_material = obj_materials[i];
+			GpuMaterial& material = materials[i];
+			material = {};
+			material.diffuse_color = glm::vec4(obj_material.diffuse_color, 1.0f);
+			material.texture = white_texture;
+
+			if (std::find(default_materials.begin(), default_materials.end(), static_cast<uint32_t>(i)) != default_materials.end())
+			{
+				material.diffuse_color = glm::vec4(1.0f);
+				material.texture = default_texture;
+				continue;
+			}
+
+			if (obj_material.diffuse_texture.empty())
+				continue;
+
+			uint32_t texture = textures->Acquire(obj_material.diffuse_texture);
+			if (texture == TextureCache::invalid_id)
+			{
+				QM_LOG_ERROR("Material %s: failed to load %s\n", obj_material.name.c_str(), obj_material.diffuse_texture.c_str());
+				continue;
+			}
+
+			auto it = texture_indices.find(texture);
+			if (it != texture_indices.end())
+			{
+				material.texture = it->second;
+				textures->Release(texture);
+				continue;
+			}
+
+			if (texture_views.size() >= max_textures)
+			{
+				QM_LOG_ERROR("Material %s: more than %u textures, %s is not loaded\n", obj_material.name.c_str(), max_textures, obj_material.diffuse_texture.c_str());
+				textures->Release(texture);
+				continue;
+			}
+
+			material.texture = static_cast<uint32_t>(texture_views.size());
+			texture_views.push_back(textures->GetView(texture));
+			texture_indices[texture] = material.texture;
+			acquired.push_back(texture);
+		}
+
+		QM_LOG_INFO("Material table has %zu materials and %zu textures\n", materials.size(), texture_views.size());
+
+		material_buffer = CreateStaticBuffer(device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(GpuMaterial) * materials.size(), materials.data());
+
+		BindingSlot textures_slot = bindings.Get("material_textures", SpirvDescriptorType::SampledTexture);
+		const ShaderBindings::Binding* textures_binding = bindings.Find("material_textures");
+		if (textures_binding && textures_binding->array_size != max_textures)
+			QM_LOG_ERROR("material_textures has %u elements in the shaders, MaterialTable expects %u\n", textures_binding->array_size, max_textures);
+
+		// Every element must hold a valid texture, unused ones repeat the white texture.
+		DescriptorSetContents contents;
+		for (uint32_t i = 0; i < max_textures; i++)
+			contents.SetSampledTexture(textures_slot, i, i < texture_views.size() ? *texture_views[i] : *white_view, Vulkan::StockSampler::TrilinearWrap);
+		contents.SetStorageBuffer(bindings.Get("MATERIALS", SpirvDescriptorType::StorageBuffer), *material_buffer);
+		texture_set = descriptors.Register(contents);
+	}
+
+	void Reset()
+	{
+		for (uint32_t texture : acquired)
+			textures->Release(texture);
+		acquired.clear();
+		texture_views.clear();
+		white_view.Reset();
+		white_image.Reset();
+		material_buffer.Reset();
+	}
+
+	std::vector<GpuMaterial> materials;
+	uint32_t texture_set = DescriptorCache::invalid_id;
+
+private:
+
+	std::vector<ObjMaterial> obj_materials;
+	// Indices of the "no material" entries AddMaterials() appends.
+	std::vector<uint32_t> default_materials;
+
+	// Element i of material_textures.
+	std::vector<const Vulkan::ImageView*> texture_views;
+	TextureCache* textures = nullptr;
+	// Cache ids held for texture_views.
+	std::vector<uint32_t> acquired;
+	Vulkan::ImageHandle white_image;
+	Vulkan::ImageViewHandle white_view;
+	Vulkan::BufferHandle material_buffer;
+};
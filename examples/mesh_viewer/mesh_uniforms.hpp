@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+
+#include "../common/std_layout.hpp"
+#include "../common/descriptor_cache.hpp"
+
+// Host side copies of the mesh shaders' uniform blocks. Layouts are checked against std140 at
+// compile time, and against the compiled shaders when the build reflected them, so a mismatch
+// with the GLSL fails the build instead of corrupting constants.
+
+// Matches VERT_UNIFORM_BUFFER in glsl/shader.vert, glsl/scene.vert and glsl/indirect.vert.
+struct VertexUniforms
+{
+	glm::mat4 proj;
+	glm::mat4 view;
+	glm::vec4 light_position;
+};
+
+static constexpr auto vertex_uniforms_layout = StdLayout::Describe<VertexUniforms>(QM_EXAMPLES_LAYOUT_MEMBER(VertexUniforms, proj),
+	QM_EXAMPLES_LAYOUT_MEMBER(VertexUniforms, view), QM_EXAMPLES_LAYOUT_MEMBER(VertexUniforms, light_position));
+
+static_assert(vertex_uniforms_layout.IsPacked(StdLayout::Std140), "VertexUniforms must follow std140");
+
+// Matches FRAG_UNIFORM_BUFFER in glsl/shader.frag and glsl/bindless.frag.
+struct FragmentUniforms
+{
+	glm::vec4 light_color;
+	float shine;
+	float reflectivity;
+	float ambient;
+	float pad;
+};
+
+static constexpr auto fragment_uniforms_layout = StdLayout::Describe<FragmentUniforms>(QM_EXAMPLES_LAYOUT_MEMBER(FragmentUniforms, light_color),
+	QM_EXAMPLES_LAYOUT_MEMBER(FragmentUniforms, shine), QM_EXAMPLES_LAYOUT_MEMBER(FragmentUniforms, reflectivity),
+	QM_EXAMPLES_LAYOUT_MEMBER(FragmentUniforms, ambient), QM_EXAMPLES_LAYOUT_MEMBER(FragmentUniforms, pad));
+
+static_assert(fragment_uniforms_layout.IsPacked(StdLayout::Std140), "FragmentUniforms must follow std140");
+
+static_assert(vertex_uniforms_layout.Matches<ShaderLayouts::shader_vert::VERT_UNIFORM_BUFFER>(), "VertexUniforms must match glsl/shader.vert");
+static_assert(vertex_uniforms_layout.Matches<ShaderLayouts::scene_vert::VERT_UNIFORM_BUFFER>(), "VertexUniforms must match glsl/scene.vert");
+static_assert(vertex_uniforms_layout.Matches<ShaderLayouts::indirect_vert::VERT_UNIFORM_BUFFER>(), "VertexUniforms must match glsl/indirect.vert");
+static_assert(fragment_uniforms_layout.Matches<ShaderLayouts::shader_frag::FRAG_UNIFORM_BUFFER>(), "FragmentUniforms must match glsl/shader.frag");
+static_assert(fragment_uniforms_layout.Matches<ShaderLayouts::bindless_frag::FRAG_UNIFORM_BUFFER>(), "FragmentUniforms must match glsl/bindless.frag");
+
+// Where a program built on glsl/shader.frag reads its per-frame resources, looked up by name in
+// its reflected bindings.
+struct FrameResources
+{
+	BindingSlot vertex_uniforms;
+	BindingSlot fragment_uniforms;
+	// Set holding the textures, registered with the program's DescriptorCache.
+	uint32_t texture_set = DescriptorCache::invalid_id;
+};
+
+// For programs whose textures are registered elsewhere, such as MaterialTable's set.
+static inline FrameResources CreateFrameResources(const ShaderBindings& bindings, uint32_t texture_set)
+{
+	FrameResources resources;
+	resources.vertex_uniforms = bindings.Get("VERT_UNIFORM_BUFFER", SpirvDescriptorType::UniformBuffer, sizeof(VertexUniforms));
+	resources.fragment_uniforms = bindings.Get("FRAG_UNIFORM_BUFFER", SpirvDescriptorType::UniformBuffer, sizeof(FragmentUniforms));
+	resources.texture_set = texture_set;
+
+	return resources;
+}
+
+static inline FrameResources CreateFrameResources(const ShaderBindings& bindings, const Vulkan::ImageView& diffuse_view, DescriptorCache& descriptors)
+{
+	DescriptorSetContents textures;
+	textures.SetSampledTexture(bindings.Get("diffuse_texture", SpirvDescriptorType::SampledTexture), diffuse_view, Vulkan::StockSampler::LinearWrap);
+
+	return CreateFrameResources(bindings, descriptors.Register(textures));
+}
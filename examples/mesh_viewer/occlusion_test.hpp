@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../common/file_loader.hpp"
+#include "../common/simd_culling.hpp"
+#include "../common/worker_pool.hpp"
+
+#include "scene_renderer.hpp"
+#include "scene_occlusion.hpp"
+
+// Runs frustum and occlusion culling for a grid of count instances of the model, stood up (the
+// models are Y up, the grid is in XY) and seen from eye level, so nearer rows hide farther ones.
+// Needs no window or GPU. Prints timings and cull counts,
+// and writes the depth buffer to occlusion_depth.pgm and its hierarchy to occlusion_hiz.pgm.
+//
+// Every instance occlusion culling removed is then checked against a brute-force rasterization of
+// the same occluders: each pixel its box covers must be nearer there than the box. Returns false if
+// the model fails to load or any culled instance is visible in the reference.
+static bool RunOcclusionTest(const char* obj_file, const char* occluder_file, uint32_t count)
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	LoadObjModel(obj_file, vertices, indices);
+
+	if (vertices.empty())
+	{
+		QM_LOG_ERROR("Occlusion test needs a model with vertices\n");
+		return false;
+	}
+
+	glm::vec3 model_min = vertices[0].position;
+	glm::vec3 model_max = vertices[0].position;
+	for (const Vertex& vertex : vertices)
+	{
+		model_min = glm::min(model_min, vertex.position);
+		model_max = glm::max(model_max, vertex.position);
+	}
+
+	if (occluder_file)
+		LoadObjModel(occluder_file, vertices, indices);
+
+	std::vector<glm::mat4> instances = CreateInstanceGrid(count, model_min, model_max);
+
+	glm::mat4 stand_up = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	stand_up = glm::rotate(stand_up, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	for (glm::mat4& instance : instances)
+		instance = instance * stand_up;
+
+	std::vector<glm::vec3> instance_min(instances.size());
+	std::vector<glm::vec3> instance_max(instances.size());
+	for (size_t i = 0; i < instances.size(); i++)
+		TransformAabb(instances[i], model_min, model_max, instance_min[i], instance_max[i]);
+
+	CullingBvh bvh;
+	bvh.Build(instance_min, instance_max);
+
+	SceneOcclusion occlusion;
+	occlusion.Init(CreateOccluderMesh(vertices, indices), instance_min, instance_max);
+
+	// Eye level, just outside the grid's edge, looking across it.
+	glm::vec3 target(0.0f, 0.0f, 0.5f * model_max.y);
+	glm::vec3 camera_position = target + glm::vec3(instances.back()[3].x + (model_max.y - model_min.y), 0.0f, 0.0f);
+	glm::mat4 proj = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.01f, 1000.0f);
+	glm::mat4 view = glm::lookAt(camera_position, target, glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::mat4 view_proj = proj * view;
+
+	WorkerPool pool(GetWorkerThreadCount());
+
+	std::vector<uint32_t> frustum_visible;
+	bvh.Cull(ExtractFrustum(view_proj), frustum_visible, GetBestCullingPath());
+
+	const uint32_t iterations = 10;
+	std::vector<uint32_t> draw_list;
+	double total_ms = 0.0;
+	double render_ms = 0.0;
+
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		draw_list = frustum_visible;
+
+		Util::Timer timer;
+		timer.start();
+		occlusion.Cull(view_proj, camera_position, instances, draw_list, &pool);
+		total_ms += timer.end() * 1000.0;
+		render_ms += occlusion.buffer.stats.render_ms;
+	}
+
+	const OcclusionStats& stats = occlusion.buffer.stats;
+	std::printf("instances %zu, frustum visible %zu, occlusion culled %u, drawn %zu\n", instances.size(), frustum_visible.size(), occlusion.culled, draw_list.size());
+	std::printf("occluders %u, %u triangles, %u rasterized into %ux%u on %u threads\n", stats.occluders, stats.input_triangles, stats.rasterized_triangles,
+		occlusion.buffer.width, occlusion.buffer.height, pool.GetThreadCount());
+	std::printf("render %.3f ms, render + test %.3f ms\n", render_ms / iterations, total_ms / iterations);
+
+	if (occlusion.buffer.WriteDepthDump("occlusion_depth.pgm", false) && occlusion.buffer.WriteDepthDump("occlusion_hiz.pgm", true))
+		std::printf("Wrote occlusion_depth.pgm and occlusion_hiz.pgm\n");
+	else
+		QM_LOG_ERROR("Failed to write depth dumps\n");
+
+	// The instances the last iteration culled, neither list is sorted.
+	std::vector<uint32_t> tested = frustum_visible;
+	std::vector<uint32_t> drawn = draw_list;
+	std::sort(tested.begin(), tested.end());
+	std::sort(drawn.begin(), drawn.end());
+	std::vector<uint32_t> culled;
+	std::set_difference(tested.begin(), tested.end(), drawn.begin(), drawn.end(), std::back_inserter(culled));
+
+	std::vector<float> reference;
+	occlusion.buffer.RenderReference(occlusion.GetOccluders(), reference);
+
+	const float depth_tolerance = 1e-5f;
+	uint32_t mismatches = 0;
+	for (uint32_t index : culled)
+	{
+		OcclusionBuffer::ScreenBounds bounds;
+		bool visible = !occlusion.buffer.ProjectBounds(instance_min[index], instance_max[index], bounds);
+
+		for (uint32_t y = bounds.min_y; !visible && y <= bounds.max_y; y++)
+		{
+			for (uint32_t x = bounds.min_x; !visible && x <= bounds.max_x; x++)
+				visible = reference[y * occlusion.buffer.width + x] >= bounds.nearest + depth_tolerance;
+		}
+
+		if (visible)
+		{
+			if (mismatches < 8)
+				QM_LOG_ERROR("Instance %u was occlusion culled but is visible in the reference rasterization\n", index);
+			mismatches++;
+		}
+	}
+
+	std::printf("reference check: %zu culled instances, mismatch %s (%u)\n", culled.size(), mismatches ? "YES" : "no", mismatches);
+	return mismatches == 0;
+}
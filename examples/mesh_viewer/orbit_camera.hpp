@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../common/input_queue.hpp"
+
+// The viewer's camera, orbiting the model at radius. Dragging with any mouse button held turns it.
+struct OrbitCamera
+{
+	// Applies the input thread's events in the order they happened, so only motion while a button
+	// was held turns the camera, however the events fell between frames.
+	void Apply(const InputEvent& event)
+	{
+		switch (event.type)
+		{
+		case InputEventType::CursorMove:
+		{
+			if (buttons_held != 0)
+			{
+				theta += static_cast<float>((event.x - cursor_x) * degrees_per_pixel);
+				phi = std::clamp(phi + static_cast<float>((event.y - cursor_y) * degrees_per_pixel), -80.0f, 80.0f);
+			}
+			break;
+		}
+		case InputEventType::ButtonPress:
+		{
+			buttons_held |= 1u << (event.button & 31);
+			break;
+		}
+		case InputEventType::ButtonRelease:
+		{
+			buttons_held &= ~(1u << (event.button & 31));
+			break;
+		}
+		}
+
+		cursor_x = event.x;
+		cursor_y = event.y;
+	}
+
+	glm::vec3 GetPosition() const
+	{
+		float x = glm::cos(glm::radians(theta)) * radius * glm::cos(glm::radians(phi));
+		float y = glm::sin(glm::radians(theta)) * radius * glm::cos(glm::radians(phi));
+		float z = glm::sin(glm::radians(phi)) * radius;
+		return glm::vec3(x, y, z);
+	}
+
+	glm::mat4 GetViewMatrix() const
+	{
+		return glm::lookAt(GetPosition(), glm::vec3(0.0f, 0.25f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+
+	// The viewer's projection. Y is flipped, as Vulkan's clip space points down.
+	static glm::mat4 GetProjectionMatrix(float aspect)
+	{
+		glm::mat4 proj = glm::perspective(glm::radians(70.0f), aspect, .01f, 1000.0f);
+		proj[1][1] *= -1;
+		return proj;
+	}
+
+	float theta = 0.0f;
+	float phi = 0.0f;
+	float radius = 0.6f;
+
+	// What the viewer used to turn per pixel at 60 fps, when turning was scaled by the frame time.
+	double degrees_per_pixel = 4.0 / 60.0;
+
+private:
+
+	double cursor_x = 0.0;
+	double cursor_y = 0.0;
+	uint32_t buttons_held = 0;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "../common/occlusion_culling.hpp"
+
+// Occlusion culling for SceneRenderer's instances. Every frame the nearest frustum visible
+// instances are rendered as occluders, within an occluder and triangle budget, and the draw list
+// is reduced to the instances whose bounds are not hidden behind them.
+struct SceneOcclusion
+{
+	// Instance bounds are world space boxes, in the same order as the instances.
+	void Init(OccluderMesh occluder_, std::vector<glm::vec3> instance_min_, std::vector<glm::vec3> instance_max_)
+	{
+		occluder = std::move(occluder_);
+		instance_min = std::move(instance_min_);
+		instance_max = std::move(instance_max_);
+		buffer.Init(320, 192);
+
+		// Sized for every instance, so culling never grows them.
+		candidates.reserve(instance_min.size());
+		occluders.reserve(max_occluders);
+	}
+
+	void Cull(const glm::mat4& view_proj, const glm::vec3& camera_position, const std::vector<glm::mat4>& instances, std::vector<uint32_t>& draw_list, WorkerPool* pool)
+	{
+		candidates.clear();
+		for (uint32_t index : draw_list)
+		{
+			glm::vec3 center = (instance_min[index] + instance_max[index]) * 0.5f;
+			candidates.emplace_back(glm::dot(center - camera_position, center - camera_position), index);
+		}
+
+		size_t nearest_count = std::min(candidates.size(), size_t(max_occluders));
+		std::partial_sort(candidates.begin(), candidates.begin() + nearest_count, candidates.end());
+
+		occluders.clear();
+		uint32_t triangles = 0;
+		for (size_t i = 0; i < nearest_count; i++)
+		{
+			triangles += occluder.GetTriangleCount();
+			if (!occluders.empty() && triangles > triangle_budget)
+				break;
+
+			occluders.push_back({ &occluder, instances[candidates[i].second] });
+		}
+
+		buffer.Render(view_proj, occluders, pool, pool ? pool->GetThreadCount() : 1);
+
+		size_t tested = draw_list.size();
+		draw_list.erase(std::remove_if(draw_list.begin(), draw_list.end(), [this](uint32_t index) {
+			return !buffer.IsVisible(instance_min[index], instance_max[index]);
+		}), draw_list.end());
+
+		culled = static_cast<uint32_t>(tested - draw_list.size());
+	}
+
+	OccluderMesh occluder;
+	OcclusionBuffer buffer;
+	uint32_t max_occluders = 64;
+	uint32_t triangle_budget = 200000;
+
+	// Instances removed by the last Cull().
+	uint32_t culled = 0;
+
+	// Occluders rendered by the last Cull().
+	const std::vector<OccluderInstance>& GetOccluders() const
+	{
+		return occluders;
+	}
+
+private:
+
+	std::vector<glm::vec3> instance_min;
+	std::vector<glm::vec3> instance_max;
+	std::vector<std::pair<float, uint32_t>> candidates;
+	std::vector<OccluderInstance> occluders;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../common/static_geometry.hpp"
+#include "../common/frame_counters.hpp"
+#include "../common/worker_pool.hpp"
+
+// Lays out count copies of a mesh with the given bounds on a square grid in the XY plane, centered
+// on the origin.
+static std::vector<glm::mat4> CreateInstanceGrid(uint32_t count, const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+{
+	std::vector<glm::mat4> instances;
+	instances.reserve(count);
+
+	glm::vec3 extent = bounds_max - bounds_min;
+	float spacing = std::max(extent.x, extent.y) * 1.25f;
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+	float half = 0.5f * spacing * static_cast<float>(side - 1);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float x = spacing * static_cast<float>(i % side) - half;
+		float y = spacing * static_cast<float>(i / side) - half;
+		instances.push_back(glm::translate(glm::mat4(1.0f), glm::vec3(x, y, 0.0f)));
+	}
+
+	return instances;
+}
+
+// Draws many instances of one mesh. The draw list (indices into instances, typically the result of
+// frustum culling) is split into contiguous ranges, one per worker,
+// and every worker records its range into its own secondary command buffer. The secondaries are
+// then executed in order from the primary command buffer, inside a single render pass.
+struct SceneRenderer
+{
+	explicit SceneRenderer(WorkerPool& pool_)
+		: pool(pool_)
+	{
+	}
+
+	// cmd must be inside subpass 0 of a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+	// setup(secondary, counters) is called once per secondary to set program, state and resources.
+	// Worker w records with device thread index 1 + w; index 0 is reserved for the main thread.
+	template<typename SetupFunc>
+	void Record(Vulkan::CommandBuffer& cmd, uint32_t thread_count, const std::vector<uint32_t>& draw_list, const StaticGeometry& geometry, const SetupFunc& setup, TransientAllocationCounters& counters)
+	{
+		uint32_t draw_count = static_cast<uint32_t>(draw_list.size());
+		thread_count = std::max(1u, std::min(thread_count, pool.GetThreadCount()));
+
+		secondaries.resize(thread_count);
+		worker_counters.assign(thread_count, {});
+
+		pool.Run(thread_count, [&](uint32_t worker) {
+			uint32_t begin = static_cast<uint32_t>(uint64_t(draw_count) * worker / thread_count);
+			uint32_t end = static_cast<uint32_t>(uint64_t(draw_count) * (worker + 1) / thread_count);
+
+			Vulkan::CommandBufferHandle secondary = cmd.RequestSecondaryCommandBuffer(1 + worker, 0);
+
+			setup(*secondary, worker_counters[worker]);
+			geometry.Bind(*secondary);
+
+			for (uint32_t i = begin; i < end; i++)
+			{
+				secondary->PushConstants(&instances[draw_list[i]], 0, sizeof(glm::mat4));
+				geometry.Draw(*secondary);
+			}
+
+			secondaries[worker] = secondary;
+		});
+
+		for (uint32_t worker = 0; worker < thread_count; worker++)
+		{
+			cmd.SubmitSecondary(secondaries[worker]);
+			secondaries[worker].Reset();
+			counters.Add(worker_counters[worker]);
+		}
+	}
+
+	std::vector<glm::mat4> instances;
+
+private:
+
+	WorkerPool& pool;
+	std::vector<Vulkan::CommandBufferHandle> secondaries;
+	std::vector<TransientAllocationCounters> worker_counters;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "../common/upload_scheduler.hpp"
+
+// Runs UploadScheduler over a synthetic loading workload without a GPU: a model and eight 2K
+// textures queued up front, then four 4K textures streamed in at frame 60, as a level would while
+// the camera moves. Prints, per frame budget, how many frames the uploads take, the most bytes any
+// frame staged and how long requests waited. "unlimited" is the old behaviour of uploading
+// everything at once.
+static void RunStreamingSimulation()
+{
+	struct Upload
+	{
+		uint64_t frame;
+		uint64_t size;
+		uint64_t granularity;
+	};
+
+	const uint64_t mb = 1024 * 1024;
+
+	std::vector<Upload> uploads;
+	uploads.push_back({ 0, 2 * mb, 16 });
+	uploads.push_back({ 0, 1 * mb, 16 });
+	for (uint32_t i = 0; i < 8; i++)
+		uploads.push_back({ 0, 2048 * 2048 * 4, 2048 * 4 });
+	for (uint32_t i = 0; i < 4; i++)
+		uploads.push_back({ 60, 4096 * 4096 * 4, 4096 * 4 });
+
+	uint64_t total = 0;
+	for (const Upload& upload : uploads)
+		total += upload.size;
+
+	const uint32_t frame_count = 2;
+
+	std::printf("%llu uploads, %.1f MB, %u frames in flight\n\n", static_cast<unsigned long long>(uploads.size()), double(total) / mb, frame_count);
+	std::printf("budget      ring MB  frames  peak MB/frame  saturated  avg latency  max latency\n");
+
+	for (uint64_t budget : { 1 * mb, 4 * mb, 16 * mb, 64 * mb, total })
+	{
+		UploadScheduler scheduler;
+		scheduler.Init(budget, frame_count);
+
+		std::vector<UploadScheduler::Chunk> chunks;
+		size_t next = 0;
+		uint64_t frame = 0;
+		uint64_t last_busy_frame = 0;
+
+		while (next < uploads.size() || !scheduler.IsIdle())
+		{
+			for (; next < uploads.size() && uploads[next].frame <= frame; next++)
+				scheduler.Enqueue(uploads[next].size, uploads[next].granularity);
+
+			scheduler.BeginFrame(chunks);
+			if (!chunks.empty())
+				last_busy_frame = frame;
+			frame++;
+		}
+
+		const UploadScheduler::Stats& stats = scheduler.GetStats();
+
+		char budget_name[32];
+		if (budget == total)
+			std::snprintf(budget_name, sizeof(budget_name), "unlimited");
+		else
+			std::snprintf(budget_name, sizeof(budget_name), "%llu MB", static_cast<unsigned long long>(budget / mb));
+
+		std::printf("%-11s %-8.0f %-7llu %-14.2f %-10llu %-12.1f %llu\n", budget_name, double(scheduler.GetRingSize()) / mb,
+			static_cast<unsigned long long>(last_busy_frame + 1), double(stats.peak_frame_bytes) / mb,
+			static_cast<unsigned long long>(stats.saturated_frames), stats.completed ? double(stats.latency_frames) / stats.completed : 0.0,
+			static_cast<unsigned long long>(stats.peak_latency_frames));
+	}
+}
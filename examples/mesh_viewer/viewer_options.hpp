@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "../common/frame_pacer.hpp"
+#include "../common/worker_pool.hpp"
+
+// What the viewer draws. Exactly one applies to a run, see ResolveDrawMode().
+enum class DrawMode
+{
+	// The single model, optionally streamed in or cluster culled.
+	Model,
+	// The single model with a virtual texture in place of its diffuse texture.
+	VirtualTexture,
+	// A grid of model instances, culled on the CPU and recorded on worker threads.
+	Scene,
+	// A grid of instances of the model and extra meshes, culled on the GPU and drawn indirectly.
+	GpuScene
+};
+
+static inline const char* GetDrawModeName(DrawMode mode)
+{
+	switch (mode)
+	{
+	case DrawMode::VirtualTexture:
+		return "virtual texture";
+	case DrawMode::Scene:
+		return "scene";
+	case DrawMode::GpuScene:
+		return "GPU scene";
+	default:
+		return "model";
+	}
+}
+
+struct ViewerOptions;
+
+// A tool runs instead of the viewer and exits, see viewer_tools.hpp.
+struct ViewerTool
+{
+	const char* name;
+	const char* values;
+	uint32_t value_count;
+	const char* description;
+	int (*run)(const ViewerOptions& options, char** values);
+};
+
+struct ViewerOptions
+{
+	const char* obj_file = "model.obj";
+	const char* diffuse_file = "diffuse.png";
+
+	DrawMode draw_mode = DrawMode::Model;
+
+	uint32_t scene_count = 0;
+	uint32_t record_threads = GetWorkerThreadCount();
+	bool bench_record = false;
+	bool use_occlusion = false;
+	const char* occluder_file = nullptr;
+	bool dump_depth = false;
+
+	uint32_t gpu_scene_count = 0;
+	std::vector<const char*> extra_meshes;
+	bool verify_cull = false;
+	bool use_bindless = false;
+
+	bool use_clusters = false;
+	bool use_streaming = false;
+	uint32_t stream_budget_mb = 4;
+	const char* virtual_texture_file = nullptr;
+
+	uint32_t texture_ram_mb = 256;
+	uint32_t texture_vram_mb = 512;
+	uint32_t check_allocation_frames = 0;
+	FramePacingSettings pacing;
+	bool late_latch = true;
+
+	// Set by a tool's option, run with tool_values once every option is parsed.
+	const ViewerTool* tool = nullptr;
+	char** tool_values = nullptr;
+	bool show_usage = false;
+};
+
+// An option of the viewer itself. Frame pacing options are parsed by ParseFramePacingArgument().
+struct ViewerOption
+{
+	const char* name;
+	const char* values;
+	uint32_t value_count;
+	const char* description;
+	void (*apply)(ViewerOptions& options, char** values);
+};
+
+static inline uint32_t ParseCount(const char* value, int min)
+{
+	return static_cast<uint32_t>(std::max(min, std::atoi(value)));
+}
+
+static const ViewerOption viewer_options[] = {
+	{ "--scene", "count", 1, "draw count instances of the model, frustum culled on the CPU and recorded in parallel",
+		[](ViewerOptions& options, char** values) { options.scene_count = ParseCount(values[0], 0); } },
+	{ "--threads", "count", 1, "record the --scene on count worker threads (default: all)",
+		[](ViewerOptions& options, char** values) { options.record_threads = std::min(ParseCount(values[0], 1), GetWorkerThreadCount()); } },
+	{ "--occlusion", "", 0, "also cull --scene instances hidden behind the nearest ones",
+		[](ViewerOptions& options, char**) { options.use_occlusion = true; } },
+	{ "--occluder", "obj file", 1, "simplified occluder for --occlusion (default: the model)",
+		[](ViewerOptions& options, char** values) { options.occluder_file = values[0]; } },
+	{ "--dump-depth", "", 0, "write the first frame's occlusion depth to occlusion_depth.pgm and occlusion_hiz.pgm",
+		[](ViewerOptions& options, char**) { options.dump_depth = true; } },
+	{ "--bench-record", "", 0, "print CPU record time against thread count for 1k, 10k and 100k draws, then exit",
+		[](ViewerOptions& options, char**) { options.bench_record = true; } },
+	{ "--gpu-scene", "count", 1, "draw count instances of the model and any --mesh, culled on the GPU and drawn indirectly",
+		[](ViewerOptions& options, char** values) { options.gpu_scene_count = ParseCount(values[0], 0); } },
+	{ "--mesh", "obj file", 1, "add a mesh to the --gpu-scene, may be repeated",
+		[](ViewerOptions& options, char** values) { options.extra_meshes.push_back(values[0]); } },
+	{ "--verify-cull", "", 0, "compare the first frame's GPU culling against the CPU reference, then exit",
+		[](ViewerOptions& options, char**) { options.verify_cull = true; } },
+	{ "--bindless", "", 0, "draw the --gpu-scene (default 1 instance) with every material's texture in one array",
+		[](ViewerOptions& options, char**) { options.use_bindless = true; } },
+	{ "--cluster-cull", "", 0, "split the model into clusters and skip those off screen or facing away",
+		[](ViewerOptions& options, char**) { options.use_clusters = true; } },
+	{ "--stream", "", 0, "upload the model and its texture on the transfer queue over the first frames",
+		[](ViewerOptions& options, char**) { options.use_streaming = true; } },
+	{ "--stream-budget", "MB", 1, "most --stream uploads a frame (default 4)",
+		[](ViewerOptions& options, char** values) { options.stream_budget_mb = ParseCount(values[0], 1); } },
+	{ "--virtual-texture", "file", 1, "draw the model with a tiled texture file, streaming in only the tiles on screen",
+		[](ViewerOptions& options, char** values) { options.virtual_texture_file = values[0]; } },
+	{ "--texture-ram", "MB", 1, "budget of decoded textures in memory (default 256)",
+		[](ViewerOptions& options, char** values) { options.texture_ram_mb = ParseCount(values[0], 0); } },
+	{ "--texture-vram", "MB", 1, "budget of texture images on the GPU (default 512)",
+		[](ViewerOptions& options, char** values) { options.texture_vram_mb = ParseCount(values[0], 0); } },
+	{ "--check-allocations", "frames", 1, "render that many frames after warmup in a hidden window, fail if any allocated",
+		[](ViewerOptions& options, char** values) { options.check_allocation_frames = ParseCount(values[0], 1); } },
+	{ "--no-late-latch", "", 0, "build the camera once at the start of the frame, not again right before submitting",
+		[](ViewerOptions& options, char**) { options.late_latch = false; } },
+};
+
+template<size_t tool_count>
+static void PrintViewerUsage(const ViewerTool (&tools)[tool_count])
+{
+	auto print = [](const char* name, const char* values, const char* description) {
+		char option[48];
+		std::snprintf(option, sizeof(option), "%s%s%s", name, values[0] ? " " : "", values);
+		std::printf("  %-34s %s\n", option, description);
+	};
+
+	std::printf("mesh_viewer [obj file] [diffuse texture] [options]\n\nOptions:\n");
+	for (const ViewerOption& option : viewer_options)
+		print(option.name, option.values, option.description);
+	print("--frames-in-flight", "n", "frames the CPU records ahead of the GPU (default 2)");
+	print("--wait-gpu", "[frames]", "wait until at most frames (default 1) are queued before reading input");
+	print("--present-mode", "mode", "fifo (default), relaxed, immediate or mailbox");
+	print("--log-latency", "", "log every frame's input to GPU done latency");
+	print("--help", "", "print this list, then exit");
+
+	std::printf("\nTools, which run without the viewer and exit:\n");
+	for (const ViewerTool& tool : tools)
+		print(tool.name, tool.values, tool.description);
+}
+
+// Settles which options apply together: the draw mode follows from the options given, and
+// options of other modes are dropped with a warning.
+static void ResolveDrawMode(ViewerOptions& options)
+{
+	if (options.use_bindless && options.gpu_scene_count == 0)
+		options.gpu_scene_count = 1;
+
+	// --bench-record measures the scene's recording, whatever else was asked for.
+	if (options.bench_record)
+		options.draw_mode = DrawMode::Scene;
+	else if (options.gpu_scene_count != 0)
+		options.draw_mode = DrawMode::GpuScene;
+	else if (options.scene_count != 0)
+		options.draw_mode = DrawMode::Scene;
+	else if (options.virtual_texture_file)
+		options.draw_mode = DrawMode::VirtualTexture;
+	else
+		options.draw_mode = DrawMode::Model;
+
+	auto drop = [&](bool& option, bool applies, const char* name) {
+		if (option && !applies)
+		{
+			QM_LOG_ERROR("%s does not apply to the %s, ignored\n", name, GetDrawModeName(options.draw_mode));
+			option = false;
+		}
+	};
+
+	DrawMode mode = options.draw_mode;
+	drop(options.use_occlusion, mode == DrawMode::Scene && !options.bench_record, "--occlusion");
+	drop(options.verify_cull, mode == DrawMode::GpuScene, "--verify-cull");
+	drop(options.use_clusters, mode == DrawMode::Model, "--cluster-cull");
+	drop(options.use_streaming, mode == DrawMode::Model || mode == DrawMode::VirtualTexture, "--stream");
+
+	drop(options.use_bindless, mode == DrawMode::GpuScene, "--bindless");
+
+	if (options.scene_count != 0 && mode != DrawMode::Scene)
+	{
+		QM_LOG_ERROR("--scene does not apply to the %s, ignored\n", GetDrawModeName(mode));
+		options.scene_count = 0;
+	}
+
+	if (options.gpu_scene_count != 0 && mode != DrawMode::GpuScene)
+	{
+		QM_LOG_ERROR("--gpu-scene does not apply to the %s, ignored\n", GetDrawModeName(mode));
+		options.gpu_scene_count = 0;
+	}
+
+	if (options.virtual_texture_file && mode != DrawMode::VirtualTexture)
+	{
+		QM_LOG_ERROR("--virtual-texture does not apply to the %s, ignored\n", GetDrawModeName(mode));
+		options.virtual_texture_file = nullptr;
+	}
+}
+
+// Returns false if an option is unknown or lacks its values.
+template<size_t tool_count>
+static bool ParseViewerOptions(int argc, char** argv, const ViewerTool (&tools)[tool_count], ViewerOptions& options)
+{
+	uint32_t positional = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		auto take_values = [&](const char* name, uint32_t value_count) -> char** {
+			if (i + static_cast<int>(value_count) >= argc)
+			{
+				QM_LOG_ERROR("%s needs %u value(s)\n", name, value_count);
+				return nullptr;
+			}
+			char** values = argv + i + 1;
+			i += value_count;
+			return values;
+		};
+
+		const ViewerOption* option = std::find_if(std::begin(viewer_options), std::end(viewer_options),
+			[&](const ViewerOption& candidate) { return std::strcmp(argv[i], candidate.name) == 0; });
+		const ViewerTool* tool = std::find_if(std::begin(tools), std::end(tools),
+			[&](const ViewerTool& candidate) { return std::strcmp(argv[i], candidate.name) == 0; });
+
+		if (option != std::end(viewer_options))
+		{
+			char** values = take_values(option->name, option->value_count);
+			if (!values)
+				return false;
+			option->apply(options, values);
+		}
+		else if (tool != std::end(tools))
+		{
+			char** values = take_values(tool->name, tool->value_count);
+			if (!values)
+				return false;
+			options.tool = tool;
+			options.tool_values = values;
+		}
+		else if (ParseFramePacingArgument(argc, argv, i, options.pacing))
+		{
+			continue;
+		}
+		else if (std::strcmp(argv[i], "--help") == 0)
+		{
+			options.show_usage = true;
+		}
+		else if (argv[i][0] == '-' && argv[i][1] == '-')
+		{
+			QM_LOG_ERROR("Unknown option %s, see --help\n", argv[i]);
+			return false;
+		}
+		else if (positional == 0)
+		{
+			options.obj_file = argv[i];
+			positional++;
+		}
+		else if (positional == 1)
+		{
+			options.diffuse_file = argv[i];
+			positional++;
+		}
+	}
+
+	ResolveDrawMode(options);
+	return true;
+}
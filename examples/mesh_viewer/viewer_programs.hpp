@@ -0,0 +1,100 @@
+#pragma once
+
+#include "../common/shader_bindings.hpp"
+#include "../common/shader_loader.hpp"
+
+#include "viewer_options.hpp"
+
+// The viewer's programs and the bindings reflected from their shaders, merged per program. The
+// single model program is always created, as it is what pipeline warmup falls back to, the others
+// only for the draw mode that uses them.
+struct ViewerPrograms
+{
+	void Init(Vulkan::Device& device, const ViewerOptions& options)
+	{
+		ShaderBindings vert_bindings;
+		ShaderBindings frag_bindings;
+		Vulkan::ShaderHandle vert_shader = LoadShader(device, "shader.vert", vert_bindings, VK_SHADER_STAGE_VERTEX_BIT);
+		Vulkan::ShaderHandle frag_shader = LoadShader(device, "shader.frag", frag_bindings, VK_SHADER_STAGE_FRAGMENT_BIT);
+		program_bindings = vert_bindings;
+		program_bindings.Add(frag_bindings);
+
+		Vulkan::GraphicsProgramShaders p_shaders;
+		p_shaders.vertex = vert_shader;
+		p_shaders.fragment = frag_shader;
+
+		program = device.CreateGraphicsProgram(p_shaders);
+
+		if (options.draw_mode == DrawMode::VirtualTexture)
+		{
+			// The virtual texture replaces the diffuse texture of the single model.
+			ShaderBindings virtual_frag_bindings;
+			Vulkan::GraphicsProgramShaders virtual_shaders;
+			virtual_shaders.vertex = vert_shader;
+			virtual_shaders.fragment = LoadShader(device, "virtual.frag", virtual_frag_bindings, VK_SHADER_STAGE_FRAGMENT_BIT);
+			virtual_bindings = vert_bindings;
+			virtual_bindings.Add(virtual_frag_bindings);
+
+			virtual_program = device.CreateGraphicsProgram(virtual_shaders);
+		}
+
+		if (options.draw_mode == DrawMode::Scene)
+		{
+			Vulkan::GraphicsProgramShaders scene_shaders;
+			scene_shaders.vertex = LoadShader(device, "scene.vert", scene_bindings, VK_SHADER_STAGE_VERTEX_BIT);
+			scene_shaders.fragment = frag_shader;
+			scene_bindings.Add(frag_bindings);
+
+			scene_program = device.CreateGraphicsProgram(scene_shaders);
+		}
+
+		if (options.draw_mode == DrawMode::GpuScene)
+		{
+			Vulkan::GraphicsProgramShaders indirect_shaders;
+			indirect_shaders.vertex = LoadShader(device, "indirect.vert", indirect_bindings, VK_SHADER_STAGE_VERTEX_BIT);
+
+			if (options.use_bindless)
+			{
+				ShaderBindings bindless_bindings;
+				indirect_shaders.fragment = LoadShader(device, "bindless.frag", bindless_bindings, VK_SHADER_STAGE_FRAGMENT_BIT);
+				indirect_bindings.Add(bindless_bindings);
+			}
+			else
+			{
+				indirect_shaders.fragment = frag_shader;
+				indirect_bindings.Add(frag_bindings);
+			}
+
+			indirect_program = device.CreateGraphicsProgram(indirect_shaders);
+
+			Vulkan::ComputeProgramShaders cull_shaders;
+			cull_shaders.compute = LoadShader(device, "cull.comp", cull_bindings, VK_SHADER_STAGE_COMPUTE_BIT);
+
+			cull_program = device.CreateComputeProgram(cull_shaders);
+		}
+	}
+
+	void Reset()
+	{
+		cull_program.Reset();
+		indirect_program.Reset();
+		scene_program.Reset();
+		program.Reset();
+		virtual_program.Reset();
+	}
+
+	Vulkan::ProgramHandle program;
+	ShaderBindings program_bindings;
+
+	Vulkan::ProgramHandle virtual_program;
+	ShaderBindings virtual_bindings;
+
+	Vulkan::ProgramHandle scene_program;
+	ShaderBindings scene_bindings;
+
+	Vulkan::ProgramHandle indirect_program;
+	ShaderBindings indirect_bindings;
+
+	Vulkan::ProgramHandle cull_program;
+	ShaderBindings cull_bindings;
+};
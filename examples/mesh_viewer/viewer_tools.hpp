@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "../common/file_loader.hpp"
+#include "../common/virtual_texture.hpp"
+
+#include "cluster_orbit.hpp"
+#include "cull_benchmark.hpp"
+#include "loader_benchmark.hpp"
+#include "occlusion_test.hpp"
+#include "reflection_benchmark.hpp"
+#include "streaming_simulation.hpp"
+#include "viewer_options.hpp"
+#include "virtual_texture_simulation.hpp"
+
+// Benchmarks, simulations and converters that run in place of the viewer. None of them needs a
+// window or a GPU. The model they load is the viewer's [obj file].
+static const ViewerTool viewer_tools[] = {
+	{ "--bench-cull", "", 0, "CPU frustum culling throughput for 10k, 100k and 1M instances",
+		[](const ViewerOptions&, char**) { RunCullingBenchmark(); return 0; } },
+	{ "--bench-reflect", "", 0, "SPIR-V reflection and descriptor cache throughput and hit rates",
+		[](const ViewerOptions&, char**) { RunReflectionBenchmark(); return 0; } },
+	{ "--bench-load", "", 0, "load time, heap allocations and peak RSS of the model and a large synthetic mesh",
+		[](const ViewerOptions& options, char**) { RunLoaderBenchmark(options.obj_file); return 0; } },
+	{ "--occlusion-test", "", 0, "occlusion culling of a --scene grid (default 4096) seen from eye level",
+		[](const ViewerOptions& options, char**) {
+			return RunOcclusionTest(options.obj_file, options.occluder_file, options.scene_count != 0 ? options.scene_count : 4096) ? 0 : 1;
+		} },
+	{ "--cluster-orbit", "", 0, "fraction of triangles cluster culling removes around an orbit",
+		[](const ViewerOptions& options, char**) { RunClusterOrbit(options.obj_file); return 0; } },
+	{ "--simulate-stream", "", 0, "how the streaming budget schedules a synthetic workload",
+		[](const ViewerOptions&, char**) { RunStreamingSimulation(); return 0; } },
+	{ "--simulate-vt", "", 0, "virtual texture cache behaviour for a synthetic panning view",
+		[](const ViewerOptions&, char**) { RunVirtualTextureSimulation(); return 0; } },
+	{ "--make-virtual-texture", "image file", 2, "cut an image into a file for --virtual-texture",
+		[](const ViewerOptions&, char** values) {
+			int width, height;
+			std::vector<unsigned char> pixels = LoadTexture(values[0], width, height);
+			std::printf("Writing %s from %dx%d %s\n", values[1], width, height, values[0]);
+			return WriteVirtualTexture(values[1], pixels.data(), width, height) ? 0 : 1;
+		} },
+};
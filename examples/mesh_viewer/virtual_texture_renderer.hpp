@@ -0,0 +1,286 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include "../common/virtual_texture.hpp"
+#include "../common/static_geometry.hpp"
+#include "../common/std_layout.hpp"
+#include "../common/descriptor_cache.hpp"
+
+// Matches VIRTUAL_TEXTURE in glsl/virtual.frag (std430).
+struct GpuVirtualTexture
+{
+	uint32_t levels;
+	uint32_t atlas_pages;
+	uint32_t feedback_width;
+	uint32_t feedback_height;
+	// x = first page table entry of the level, y = tiles per row, zw = size in texels.
+	glm::uvec4 level_info[16];
+};
+
+static constexpr auto gpu_virtual_texture_layout = StdLayout::Describe<GpuVirtualTexture>(QM_EXAMPLES_LAYOUT_MEMBER(GpuVirtualTexture, levels),
+	QM_EXAMPLES_LAYOUT_MEMBER(GpuVirtualTexture, atlas_pages), QM_EXAMPLES_LAYOUT_MEMBER(GpuVirtualTexture, feedback_width),
+	QM_EXAMPLES_LAYOUT_MEMBER(GpuVirtualTexture, feedback_height), QM_EXAMPLES_LAYOUT_MEMBER(GpuVirtualTexture, level_info));
+
+static_assert(gpu_virtual_texture_layout.IsPacked(StdLayout::Std430), "GpuVirtualTexture must follow std430");
+static_assert(gpu_virtual_texture_layout.Matches<ShaderLayouts::virtual_frag::VIRTUAL_TEXTURE>(), "GpuVirtualTexture must match glsl/virtual.frag");
+
+// Draws a diffuse texture far larger than would fit in memory through glsl/virtual.frag. Only the
+// tiles the screen shows are read from the file (see WriteVirtualTexture()) and kept in an atlas
+// of atlas_pages x atlas_pages physical pages; a page table buffer maps every tile of every level
+// to the page holding it, or to the page of the nearest coarser tile that is resident.
+//
+// The fragment shader writes the tile each 8x8 block of pixels wanted into a feedback buffer, one
+// per frame context. When a context comes around again its frame has completed, so Update() reads
+// that feedback, lets VirtualTextureResidency pick the loads and evictions, and records the tile
+// copies and the page table upload into the frame's own command buffer, ahead of the draw.
+struct VirtualTextureRenderer
+{
+	static constexpr uint32_t atlas_pages = 16;
+	static constexpr uint32_t max_loads_per_frame = 16;
+	// Must match feedback_scale in glsl/virtual.frag.
+	static constexpr uint32_t feedback_scale = 8;
+
+	// Opens the file and creates every resource for feedback at width x height pixels. bindings are
+	// those of the program using glsl/virtual.frag. Returns false if the file can't be used.
+	bool Init(Vulkan::Device& device_, const char* filepath, uint32_t width, uint32_t height, const ShaderBindings& bindings, DescriptorCache& descriptors)
+	{
+		device = &device_;
+
+		if (!file.Open(filepath))
+			return false;
+
+		const VirtualTextureLayout& layout = file.layout;
+		if (layout.levels > 16)
+		{
+			QM_LOG_ERROR("%s has %u levels, glsl/virtual.frag supports 16\n", filepath, layout.levels);
+			return false;
+		}
+
+		if (device->GetGPUFeatures().fragmentStoresAndAtomics != VK_TRUE)
+			QM_LOG_ERROR("fragmentStoresAndAtomics is not supported, virtual texture feedback will stay empty\n");
+
+		residency.atlas_pages_x = atlas_pages;
+		std::vector<VirtualTextureResidency::Load> initial_loads;
+		residency.Init(layout, atlas_pages * atlas_pages, max_loads_per_frame, initial_loads);
+		loads = initial_loads;
+
+		feedback_width = (width + feedback_scale - 1) / feedback_scale;
+		feedback_height = (height + feedback_scale - 1) / feedback_scale;
+
+		GpuVirtualTexture params{};
+		params.levels = layout.levels;
+		params.atlas_pages = atlas_pages;
+		params.feedback_width = feedback_width;
+		params.feedback_height = feedback_height;
+		for (uint32_t level = 0; level < layout.levels; level++)
+			params.level_info[level] = glm::uvec4(layout.level_first_tiles[level], layout.GetTilesX(level), layout.GetLevelWidth(level), layout.GetLevelHeight(level));
+		params_buffer = CreateStaticBuffer(*device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(params), &params);
+
+		page_table_size = VkDeviceSize(layout.GetTileCount()) * sizeof(uint32_t);
+		page_table_buffer = CreateStaticBuffer(*device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, page_table_size, nullptr);
+
+		Vulkan::ImageCreateInfo atlas_info = Vulkan::ImageCreateInfo::Immutable2dImage(atlas_pages * VirtualTextureLayout::page_size,
+			atlas_pages * VirtualTextureLayout::page_size, VK_FORMAT_R8G8B8A8_SRGB, false);
+		atlas_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		atlas_info.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		atlas_info.sharing_mode = Vulkan::ImageSharingMode::Exclusive;
+		atlas_info.exclusive_owner = Vulkan::IMAGE_COMMAND_QUEUE_GENERIC;
+		atlas = device->CreateImage(atlas_info);
+		if (!atlas)
+		{
+			QM_LOG_ERROR("Failed to create the virtual texture atlas\n");
+			return false;
+		}
+
+		Vulkan::ImageViewCreateInfo view_info{};
+		view_info.image = atlas;
+		view_info.view_type = VK_IMAGE_VIEW_TYPE_2D;
+		atlas_view = device->CreateImageView(view_info);
+
+		frame_count = std::max(1u, device->GetNumFrameContexts());
+
+		// Each frame context stages its tiles and page table in its own region.
+		region_size = VkDeviceSize(max_loads_per_frame) * VirtualTextureLayout::page_bytes + page_table_size;
+
+		Vulkan::BufferCreateInfo staging_info{};
+		staging_info.domain = Vulkan::BufferDomain::Host;
+		staging_info.size = region_size * frame_count;
+		staging_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		staging_info.sharing_mode = Vulkan::BufferSharingMode::Exclusive;
+		staging_info.exclusive_owner = Vulkan::BUFFER_COMMAND_QUEUE_GENERIC;
+		staging = device->CreateBuffer(staging_info);
+		staging_mapped = static_cast<uint8_t*>(device->MapHostBuffer(*staging, Vulkan::MEMORY_ACCESS_WRITE_BIT));
+
+		// Feedback starts out empty, every entry VirtualTile::none.
+		std::vector<uint32_t> empty_feedback(size_t(feedback_width) * feedback_height, VirtualTile::none);
+
+		Vulkan::BufferCreateInfo feedback_info{};
+		feedback_info.domain = Vulkan::BufferDomain::CachedHost;
+		feedback_info.size = empty_feedback.size() * sizeof(uint32_t);
+		feedback_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		feedback_info.sharing_mode = Vulkan::BufferSharingMode::Exclusive;
+		feedback_info.exclusive_owner = Vulkan::BUFFER_COMMAND_QUEUE_GENERIC;
+
+		BindingSlot atlas_slot = bindings.Get("atlas", SpirvDescriptorType::SampledTexture);
+		BindingSlot params_slot = bindings.Get("VIRTUAL_TEXTURE", SpirvDescriptorType::StorageBuffer, sizeof(GpuVirtualTexture));
+		BindingSlot page_table_slot = bindings.Get("PAGE_TABLE", SpirvDescriptorType::StorageBuffer);
+		BindingSlot feedback_slot = bindings.Get("FEEDBACK", SpirvDescriptorType::StorageBuffer);
+
+		feedback_buffers.resize(frame_count);
+		texture_sets.resize(frame_count);
+		for (uint32_t i = 0; i < frame_count; i++)
+		{
+			feedback_buffers[i] = device->CreateBuffer(feedback_info, empty_feedback.data());
+
+			DescriptorSetContents contents;
+			contents.SetSampledTexture(atlas_slot, *atlas_view, Vulkan::StockSampler::LinearClamp);
+			contents.SetStorageBuffer(params_slot, *params_buffer);
+			contents.SetStorageBuffer(page_table_slot, *page_table_buffer);
+			contents.SetStorageBuffer(feedback_slot, *feedback_buffers[i]);
+			texture_sets[i] = descriptors.Register(contents);
+		}
+
+		feedback.resize(empty_feedback.size());
+
+		QM_LOG_INFO("Virtual texture %s: %ux%u texels, %u levels, %u tiles, %u pages of %u texels\n", filepath, layout.width, layout.height,
+			layout.levels, layout.GetTileCount(), atlas_pages * atlas_pages, VirtualTextureLayout::page_size);
+		return true;
+	}
+
+	// Moves to the next frame context, turns its feedback into tile loads and records the copies
+	// into cmd. Call once per frame, after WSI::BeginFrame() and outside a render pass.
+	void Update(Vulkan::CommandBuffer& cmd)
+	{
+		frame_index = (frame_index + 1) % frame_count;
+
+		const Vulkan::Buffer& feedback_buffer = *feedback_buffers[frame_index];
+		const void* mapped = device->MapHostBuffer(feedback_buffer, Vulkan::MEMORY_ACCESS_READ_BIT);
+		std::memcpy(feedback.data(), mapped, feedback.size() * sizeof(uint32_t));
+		device->UnmapHostBuffer(feedback_buffer, Vulkan::MEMORY_ACCESS_READ_BIT);
+
+		// The first frame uploads the coarsest level Init() queued instead.
+		if (loads.empty())
+			residency.Update(feedback.data(), feedback.size(), loads);
+
+		// The draw that read this feedback buffer has completed, clear it for this frame's.
+		cmd.FillBuffer(feedback_buffer, VirtualTile::none);
+		cmd.Barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+		if (loads.empty() && !residency.IsPageTableDirty())
+			return;
+
+		uint8_t* region = staging_mapped + region_size * frame_index;
+		VkDeviceSize region_offset = region_size * frame_index;
+
+		if (!loads.empty())
+		{
+			// Earlier frames may still be sampling the pages, which is ordered before the copies.
+			cmd.ImageBarrier(*atlas, atlas_initialized ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+			atlas_initialized = true;
+
+			for (size_t i = 0; i < loads.size(); i++)
+			{
+				VkDeviceSize offset = VkDeviceSize(i) * VirtualTextureLayout::page_bytes;
+				if (!file.ReadTile(loads[i].tile, region + offset))
+				{
+					QM_LOG_ERROR("Failed to read virtual texture tile %08x\n", loads[i].tile);
+					std::memset(region + offset, 0, VirtualTextureLayout::page_bytes);
+				}
+
+				int32_t page_x = int32_t((loads[i].page % atlas_pages) * VirtualTextureLayout::page_size);
+				int32_t page_y = int32_t((loads[i].page / atlas_pages) * VirtualTextureLayout::page_size);
+				cmd.CopyBufferToImage(*atlas, *staging, region_offset + offset, { page_x, page_y, 0 },
+					{ VirtualTextureLayout::page_size, VirtualTextureLayout::page_size, 1 }, 0, 0, 0, 0, 1);
+			}
+
+			cmd.ImageBarrier(*atlas, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		}
+
+		if (residency.IsPageTableDirty())
+		{
+			uint32_t begin, end;
+			residency.TakeDirtyRange(begin, end);
+
+			VkDeviceSize offset = VkDeviceSize(max_loads_per_frame) * VirtualTextureLayout::page_bytes;
+			VkDeviceSize size = VkDeviceSize(end - begin) * sizeof(uint32_t);
+			std::memcpy(region + offset, residency.page_table.data() + begin, size);
+
+			cmd.Barrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+			cmd.CopyBuffer(*page_table_buffer, VkDeviceSize(begin) * sizeof(uint32_t), *staging, region_offset + offset, size);
+			cmd.Barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		}
+
+		loads.clear();
+	}
+
+	// Makes the frame's feedback writes visible to the host. Call after the render pass drawing
+	// with GetTextureSet().
+	void EndFrame(Vulkan::CommandBuffer& cmd)
+	{
+		cmd.Barrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+	}
+
+	// Set holding the atlas, page table and this frame's feedback buffer.
+	uint32_t GetTextureSet() const
+	{
+		return texture_sets.empty() ? DescriptorCache::invalid_id : texture_sets[frame_index];
+	}
+
+	void LogStats() const
+	{
+		const VirtualTextureResidency::Stats& stats = residency.stats;
+		QM_LOG_INFO("Virtual texture: %llu frames, %llu tile requests, %.1f%% resident, %llu tiles loaded (%.2f a frame), %llu deferred, "
+			"%llu evictions, %.1f MB read of %.1f MB\n", static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.requests),
+			stats.requests ? 100.0 * double(stats.hits) / double(stats.requests) : 0.0, static_cast<unsigned long long>(stats.loads),
+			stats.frames ? double(stats.loads) / double(stats.frames) : 0.0, static_cast<unsigned long long>(stats.deferred),
+			static_cast<unsigned long long>(residency.cache.evictions), double(file.bytes_read) / (1024.0 * 1024.0),
+			double(file.layout.GetTileCount()) * VirtualTextureLayout::page_bytes / (1024.0 * 1024.0));
+	}
+
+	void Reset()
+	{
+		if (staging)
+			device->UnmapHostBuffer(*staging, Vulkan::MEMORY_ACCESS_WRITE_BIT);
+		staging.Reset();
+		staging_mapped = nullptr;
+		feedback_buffers.clear();
+		texture_sets.clear();
+		page_table_buffer.Reset();
+		params_buffer.Reset();
+		atlas_view.Reset();
+		atlas.Reset();
+	}
+
+private:
+
+	Vulkan::Device* device = nullptr;
+
+	VirtualTextureFile file;
+	VirtualTextureResidency residency;
+	std::vector<VirtualTextureResidency::Load> loads;
+
+	Vulkan::ImageHandle atlas;
+	Vulkan::ImageViewHandle atlas_view;
+	bool atlas_initialized = false;
+
+	Vulkan::BufferHandle params_buffer;
+	Vulkan::BufferHandle page_table_buffer;
+	VkDeviceSize page_table_size = 0;
+
+	Vulkan::BufferHandle staging;
+	uint8_t* staging_mapped = nullptr;
+	VkDeviceSize region_size = 0;
+
+	std::vector<Vulkan::BufferHandle> feedback_buffers;
+	std::vector<uint32_t> texture_sets;
+	std::vector<uint32_t> feedback;
+	uint32_t feedback_width = 0;
+	uint32_t feedback_height = 0;
+
+	uint32_t frame_count = 1;
+	uint32_t frame_index = 0;
+};
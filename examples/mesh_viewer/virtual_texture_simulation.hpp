@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "../common/virtual_texture.hpp"
+
+// Drives VirtualTextureResidency with the feedback a 1920x1080 view of a 64K x 64K texture would
+// write, at glsl/virtual.frag's 1/8 resolution, without a GPU or a file. The view pans across
+// the texture while zooming in and out, and every frame checks that the cache stays within its
+// pages and that every requested tile resolves through the page table to itself or a resident
+// coarser tile. Prints, per atlas size, how often requests found their tile resident, how many
+// tiles a frame loads and evicts, and how many requests drew with a coarser stand-in.
+static void RunVirtualTextureSimulation()
+{
+	const uint32_t texture_size = 65536;
+	const uint32_t feedback_width = 1920 / 8;
+	const uint32_t feedback_height = 1080 / 8;
+	const uint32_t frames = 1200;
+	const uint32_t max_loads_per_frame = 16;
+
+	VirtualTextureLayout layout;
+	layout.Init(texture_size, texture_size);
+
+	std::printf("%ux%u texture, %u levels, %u tiles (%.0f MB), %ux%u feedback, %u frames\n\n", texture_size, texture_size, layout.levels,
+		layout.GetTileCount(), double(layout.GetTileCount()) * VirtualTextureLayout::page_bytes / (1024.0 * 1024.0), feedback_width, feedback_height, frames);
+	std::printf("pages  atlas MB  resident  loads/frame  peak loads  evictions  coarser  errors\n");
+
+	std::vector<uint32_t> feedback(feedback_width * feedback_height);
+	std::vector<VirtualTextureResidency::Load> loads;
+
+	for (uint32_t page_count : { 64u, 256u, 1024u, 4096u })
+	{
+		VirtualTextureResidency residency;
+		residency.Init(layout, page_count, max_loads_per_frame, loads);
+
+		uint64_t peak_loads = 0;
+		uint64_t coarser = 0;
+		uint64_t samples = 0;
+		uint64_t errors = 0;
+
+		for (uint32_t frame = 0; frame < frames; frame++)
+		{
+			// Width of the visible part of the texture in uv, between a full screen of level 0
+			// texels and a quarter of the texture, and where its center is.
+			float t = float(frame) / float(frames);
+			float zoom = 0.5f + 0.5f * std::cos(t * 6.2831853f * 3.0f);
+			float extent = (1920.0f / float(texture_size)) * std::pow(2.0f, zoom * 7.0f);
+			float center_x = 0.1f + 0.8f * t;
+			float center_y = 0.5f + 0.3f * std::sin(t * 6.2831853f);
+
+			// A feedback sample covers 8 pixels, so its level comes from the uv extent of one pixel.
+			float texels_per_pixel = extent * float(texture_size) / 1920.0f;
+			uint32_t level = std::min(layout.levels - 1, static_cast<uint32_t>(std::max(0.0f, std::log2(texels_per_pixel))));
+
+			for (uint32_t y = 0; y < feedback_height; y++)
+			{
+				for (uint32_t x = 0; x < feedback_width; x++)
+				{
+					float u = center_x + (float(x) / float(feedback_width) - 0.5f) * extent;
+					float v = center_y + (float(y) / float(feedback_height) - 0.5f) * extent * (1080.0f / 1920.0f);
+					u -= std::floor(u);
+					v -= std::floor(v);
+
+					uint32_t tile_x = static_cast<uint32_t>(u * float(layout.GetLevelWidth(level))) / VirtualTextureLayout::tile_size;
+					uint32_t tile_y = static_cast<uint32_t>(v * float(layout.GetLevelHeight(level))) / VirtualTextureLayout::tile_size;
+					feedback[y * feedback_width + x] = VirtualTile::Pack(level, tile_x, tile_y);
+				}
+			}
+
+			residency.Update(feedback.data(), feedback.size(), loads);
+			peak_loads = std::max<uint64_t>(peak_loads, loads.size());
+
+			if (residency.cache.GetResidentCount() > page_count)
+				errors++;
+
+			for (uint32_t tile : feedback)
+			{
+				uint32_t tile_level = VirtualTile::GetLevel(tile);
+				uint32_t tile_x = VirtualTile::GetX(tile);
+				uint32_t tile_y = VirtualTile::GetY(tile);
+
+				uint32_t resident_level = residency.GetResidentLevel(tile_level, tile_x, tile_y);
+				uint32_t shift = resident_level - tile_level;
+				if (resident_level == ~0u || resident_level < tile_level ||
+					!residency.cache.Contains(VirtualTile::Pack(resident_level, tile_x >> shift, tile_y >> shift)))
+				{
+					errors++;
+					continue;
+				}
+
+				samples++;
+				if (resident_level != tile_level)
+					coarser++;
+			}
+		}
+
+		const VirtualTextureResidency::Stats& stats = residency.stats;
+		std::printf("%-6u %-9.1f %-9.1f %-12.2f %-11llu %-10llu %-8.1f %llu\n", page_count,
+			double(page_count) * VirtualTextureLayout::page_bytes / (1024.0 * 1024.0), stats.requests ? 100.0 * double(stats.hits) / double(stats.requests) : 0.0,
+			double(stats.loads) / double(stats.frames), static_cast<unsigned long long>(peak_loads), static_cast<unsigned long long>(residency.cache.evictions),
+			samples ? 100.0 * double(coarser) / double(samples) : 0.0, static_cast<unsigned long long>(errors));
+	}
+
+	std::printf("\nresident and coarser are %% of requests, coarser ones drew with a stand-in from a lower resolution level\n");
+}
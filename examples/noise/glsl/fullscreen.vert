@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) out vec2 frag_pos;
+
+void main()
+{
+
+	// Vertices (-1, -1), (3, -1), (-1, 3) form one triangle that covers the whole screen.
+	vec2 pos = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2) * 2.0 - 1.0;
+
+	gl_Position = vec4(pos, 0.0, 1.0);
+	frag_pos = pos;
+
+}
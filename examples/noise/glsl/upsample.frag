@@ -0,0 +1,40 @@
+#version 450
+
+// All components are in the range [0…1], including hue.
+vec3 hsv_to_rgb(vec3 c)
+{
+    vec4 K = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
+    vec3 p = abs(fract(c.xxx + K.xyz) * 6.0 - K.www);
+    return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
+}
+
+layout(location = 0) in vec2 frag_pos;
+
+layout(location = 0) out vec4 out_color;
+
+layout(set = 0, binding = 0) uniform UBO 
+{
+	float hue;
+	float variance;
+	float x_offset;
+	float t;
+	
+} ubo;
+
+layout(set = 0, binding = 1) uniform sampler2D noise_field;
+
+void main()
+{
+	float n = texture(noise_field, frag_pos * 0.5 + 0.5).r;
+
+	float act_hue = ubo.hue + n * ubo.variance;
+
+	if(act_hue > 1.0)
+		act_hue -= 1.0;
+	else if(act_hue < 0.0)
+		act_hue += 1.0;
+
+	vec3 color = hsv_to_rgb(vec3(act_hue, 1, .6));
+
+	out_color = vec4(color, 1.0);
+}
\ No newline at end of file
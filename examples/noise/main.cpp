@@ -2,14 +2,186 @@
 
 #include <iostream>
 #include <thread>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <cstdlib>
 
 #include <GLFW/glfw3.h>
 
 #include "../common/glfw_platform.hpp"
+#include "../common/swapchain_size.hpp"
 #include "../common/file_loader.hpp"
+#include "../common/shader_loader.hpp"
+#include "../common/pipeline_cache.hpp"
+#include "../common/static_geometry.hpp"
+#include "../common/frame_counters.hpp"
+#include "../common/uniform_ring.hpp"
+#include "../common/descriptor_cache.hpp"
+#include "../common/fixed_timestep.hpp"
+#include "../common/random.hpp"
+#include "../common/frame_pacer.hpp"
+
+#include "noise_field.hpp"
+
+enum class FullscreenMode
+{
+	// Vertex-less triangle, see glsl/fullscreen.vert
+	Triangle,
+	// Two triangles uploaded once into a static vertex buffer
+	StaticQuad,
+	// Two triangles uploaded every frame through AllocateVertexData
+	TransientQuad
+};
+
+// Hue the noise is tinted with. It eases towards a target that now and then jumps somewhere new,
+// and is stepped at a fixed rate so it evolves the same at any frame rate.
+struct HueSimulation
+{
+	struct State
+	{
+		float hue = 0.1f;
+		float target = 0.1f;
+	};
+
+	void Step(float dt, Random& random)
+	{
+		previous = current;
+
+		if (random.NextFloat() < retarget_rate * dt)
+		{
+			QM_LOG_TRACE("Randomizing color...\n");
+			current.target = random.NextFloat();
+		}
+
+		current.hue += (current.target - current.hue) * dt * 0.5f;
+	}
+
+	// Hue alpha of the way from the previous step to the latest.
+	float GetHue(float alpha) const
+	{
+		return previous.hue + (current.hue - previous.hue) * alpha;
+	}
+
+	// New targets per second, on average. The same as a 0.7% chance every frame at 60 fps.
+	float retarget_rate = 0.42f;
+	State previous;
+	State current;
+};
+
+// Runs the hue simulation for the same 20 seconds at several frame rates, with jittered frame
+// times, and prints where it ends up. The fixed timestep makes every row the same.
+static void PrintHueSimulation(uint64_t seed)
+{
+	const double duration = 20.0;
+
+	std::printf("Hue simulation over %.0f seconds, seed %llu\n", duration, static_cast<unsigned long long>(seed));
+	std::printf("fps   frames  steps  hue       target\n");
+
+	for (double fps : { 30.0, 60.0, 144.0, 240.0 })
+	{
+		FixedTimestep timestep;
+		HueSimulation hue;
+		Random random(seed);
+		Random jitter(static_cast<uint64_t>(fps));
+
+		uint64_t total_steps = static_cast<uint64_t>(duration / timestep.step + 0.5);
+		uint64_t steps_done = 0;
+		uint32_t frames = 0;
+		while (steps_done < total_steps)
+		{
+			frames++;
+			for (uint32_t steps = timestep.Advance((0.75 + 0.5 * jitter.NextFloat()) / fps); steps != 0 && steps_done < total_steps; steps--, steps_done++)
+				hue.Step(static_cast<float>(timestep.step), random);
+		}
+
+		std::printf("%-5.0f %-7u %-6llu %-9.6f %.6f\n", fps, frames, static_cast<unsigned long long>(steps_done), hue.current.hue, hue.current.target);
+	}
+}
+
+static void PrintSimulation()
+{
+	const uint32_t width = 320;
+	const uint32_t height = 180;
+	const uint32_t frames = 60;
+
+	std::printf("Simulating reduced resolution noise field at %ux%u over %u frames\n", width, height, frames);
+	std::printf("scale interval  relative_cost  mean_abs_err  rms_err   max_err   psnr(dB)\n");
+
+	for (uint32_t scale : { 1u, 2u, 4u })
+	{
+		for (uint32_t interval : { 1u, 2u, 4u, 8u })
+		{
+			NoiseField::Settings settings;
+			settings.scale = scale;
+			settings.interval = interval;
+
+			NoiseField::SimulationResult result = NoiseField::Simulate(settings, width, height, frames, 1.0f / 60.0f);
+
+			std::printf("%5u %8u  %13.4f  %12.5f  %8.5f  %8.5f  %8.2f\n", scale, interval, result.relative_cost, result.mean_abs_error, result.rms_error, result.max_error, result.psnr);
+		}
+	}
+}
 
 int main(int argc, char** argv)
 {
+	// --compute [scale] [interval] generates the noise field with a compute shader at reduced resolution
+	// --simulate runs the same scheme on the CPU and prints its error against the full resolution field
+	// --static-quad / --transient-quad draw two triangles from a vertex buffer instead of the vertex-less
+	// full-screen triangle, either uploaded once or re-uploaded every frame as this sample originally did
+	// --seed sets the seed of the hue simulation (default 100), which runs at a fixed 60 Hz
+	// --simulate-hue prints the hue simulation's end state at several frame rates, then exits
+	// --frames-in-flight n, --wait-gpu [frames], --present-mode fifo|relaxed|immediate|mailbox and --log-latency
+	// control and measure frame pacing, see common/frame_pacer.hpp
+	bool use_compute = false;
+	NoiseField::Settings field_settings;
+	FullscreenMode fullscreen_mode = FullscreenMode::Triangle;
+	uint64_t seed = 100;
+	bool simulate_hue = false;
+	FramePacingSettings pacing;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--simulate") == 0)
+		{
+			PrintSimulation();
+			return 0;
+		}
+		else if (std::strcmp(argv[i], "--compute") == 0)
+		{
+			use_compute = true;
+
+			if (i + 1 < argc && std::isdigit(argv[i + 1][0]))
+				field_settings.scale = std::max(1, std::atoi(argv[++i]));
+			if (i + 1 < argc && std::isdigit(argv[i + 1][0]))
+			{
+				// Refresh schedule splits a 4x4 dither matrix, so only powers of two up to 16 are valid.
+				uint32_t interval = std::clamp(std::atoi(argv[++i]), 1, 16);
+				field_settings.interval = 1;
+				while (field_settings.interval * 2 <= interval)
+					field_settings.interval *= 2;
+			}
+
+			std::cout << "Using compute noise field, scale " << field_settings.scale << ", interval " << field_settings.interval << "\n";
+		}
+		else if (std::strcmp(argv[i], "--static-quad") == 0)
+			fullscreen_mode = FullscreenMode::StaticQuad;
+		else if (std::strcmp(argv[i], "--transient-quad") == 0)
+			fullscreen_mode = FullscreenMode::TransientQuad;
+		else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = std::strtoull(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--simulate-hue") == 0)
+			simulate_hue = true;
+		else if (ParseFramePacingArgument(argc, argv, i, pacing))
+			continue;
+	}
+
+	if (simulate_hue)
+	{
+		PrintHueSimulation(seed);
+		return 0;
+	}
+
 	glfwInit();
 
 	if (!Vulkan::Context::InitLoader(nullptr))
@@ -23,50 +195,189 @@ int main(int argc, char** argv)
 		wsi.SetBackbufferSrgb(true);
 		wsi.Init(1, nullptr, 0);
 
+		FramePacer pacer;
+		pacer.Init(wsi, pacing);
+
 		{
 			Vulkan::Device& device = wsi.GetDevice();
+
+			LoadPipelineCache(device);
 			
-			std::vector<char> vertex_code = ReadFile("spirv/vertex.spv");
-			std::vector<char> frag_code = ReadFile("spirv/fragment.spv");
-			
-			Vulkan::ShaderHandle vert_shader = device.CreateShader(vertex_code.size() / sizeof(uint32_t), reinterpret_cast<const uint32_t*>(vertex_code.data()));
-			Vulkan::ShaderHandle frag_shader = device.CreateShader(frag_code.size() / sizeof(uint32_t), reinterpret_cast<const uint32_t*>(frag_code.data()));
+			bool use_quad = fullscreen_mode != FullscreenMode::Triangle;
+
+			// Bindings are reflected from each shader once, and merged per program.
+			ShaderBindings vert_bindings;
+			ShaderBindings program_bindings;
+			Vulkan::ShaderHandle vert_shader = use_quad ? LoadShader(device, "shader.vert", vert_bindings, VK_SHADER_STAGE_VERTEX_BIT)
+				: LoadShader(device, "fullscreen.vert", vert_bindings, VK_SHADER_STAGE_VERTEX_BIT);
+			Vulkan::ShaderHandle frag_shader = LoadShader(device, "shader.frag", program_bindings, VK_SHADER_STAGE_FRAGMENT_BIT);
+			program_bindings.Add(vert_bindings);
 			
 			Vulkan::GraphicsProgramShaders p_shaders;
 			p_shaders.vertex = vert_shader;
 			p_shaders.fragment = frag_shader;
 
 			Vulkan::ProgramHandle program = device.CreateGraphicsProgram(p_shaders);
+
+			Vulkan::ProgramHandle compute_program;
+			Vulkan::ProgramHandle upsample_program;
+			ShaderBindings compute_bindings;
+			ShaderBindings upsample_bindings;
+
+			if (use_compute)
+			{
+				Vulkan::ShaderHandle comp_shader = LoadShader(device, "noise.comp", compute_bindings, VK_SHADER_STAGE_COMPUTE_BIT);
+				Vulkan::ShaderHandle upsample_shader = LoadShader(device, "upsample.frag", upsample_bindings, VK_SHADER_STAGE_FRAGMENT_BIT);
+				upsample_bindings.Add(vert_bindings);
+
+				Vulkan::ComputeProgramShaders c_shaders;
+				c_shaders.compute = comp_shader;
+
+				compute_program = device.CreateComputeProgram(c_shaders);
+
+				Vulkan::GraphicsProgramShaders u_shaders;
+				u_shaders.vertex = vert_shader;
+				u_shaders.fragment = upsample_shader;
+
+				upsample_program = device.CreateGraphicsProgram(u_shaders);
+			}
+
+			StaticGeometry quad;
+
+			if (fullscreen_mode == FullscreenMode::StaticQuad)
+			{
+				std::vector<glm::vec2> quad_vertices = { { -1.0f, -1.0f }, { -1.0f, 1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { 1.0f, -1.0f }, { -1.0f, 1.0f } };
+				quad = CreateStaticGeometry(device, quad_vertices);
+			}
+
+			FrameCounters counters;
+
+			UniformRing uniforms;
+			uniforms.Init(device, 4096);
+
+			BindingSlot color_uniforms = (use_compute ? upsample_bindings : program_bindings).Get("UBO", SpirvDescriptorType::UniformBuffer, sizeof(NoiseField::ColorParams));
+			BindingSlot field_uniforms;
+			BindingSlot history_slot;
+			BindingSlot field_slot;
+			BindingSlot upsample_field_slot;
+
+			if (use_compute)
+			{
+				field_uniforms = compute_bindings.Get("FIELD_UBO", SpirvDescriptorType::UniformBuffer, sizeof(NoiseField::FrameParams));
+				history_slot = compute_bindings.Get("history_field", SpirvDescriptorType::SampledTexture);
+				field_slot = compute_bindings.Get("out_field", SpirvDescriptorType::StorageImage);
+				upsample_field_slot = upsample_bindings.Get("noise_field", SpirvDescriptorType::SampledTexture);
+			}
+
+			// Both sets of each pass, one per ping-pong direction, are registered whenever the
+			// fields are created, so frames only bind them by id.
+			DescriptorCache descriptors;
+			uint32_t compute_sets[2] = { DescriptorCache::invalid_id, DescriptorCache::invalid_id };
+			uint32_t upsample_sets[2] = { DescriptorCache::invalid_id, DescriptorCache::invalid_id };
+
+			// Two fields are ping-ponged, one is written this frame while the other is reprojected from.
+			NoiseField::Scheduler field_scheduler(field_settings);
+			Vulkan::ImageHandle fields[2];
+			uint32_t field_width = 0;
+			uint32_t field_height = 0;
+			uint32_t field_index = 0;
+			SwapchainSize swapchain_size;
 			
-			float current_time = 0;
-			float current_delta = 1.0f/60.0f;
-			float current_hue = 0.1f;
-			float current_target = 0.1f;
-			
-			std::srand(100);
+			// The hue is simulated in fixed steps, and rendered blended between the last two.
+			FixedTimestep timestep;
+			HueSimulation hue;
+			Random random(seed);
+
+			Util::Timer frame_timer;
+			frame_timer.start();
 			
 			while (platform.Alive(wsi))
 			{
+				// The frame's time is sampled after any wait for the GPU.
+				pacer.BeginFrame();
+
+				double frame_delta = frame_timer.end();
+				frame_timer.start();
+
+				for (uint32_t steps = timestep.Advance(frame_delta); steps != 0; steps--)
+					hue.Step(static_cast<float>(timestep.step), random);
 
-				Util::Timer timer;
-				timer.start();
+				float current_hue = hue.GetHue(timestep.GetAlpha());
+				float current_time = static_cast<float>(std::max(0.0, timestep.GetInterpolatedTime()));
+
+				pacer.MarkInputSampled();
 
 				wsi.BeginFrame();
+				uniforms.BeginFrame();
+				descriptors.BeginFrame();
 				{
-					
-					if ((float)std::rand() / (float)RAND_MAX > .993f)
-					{
-						QM_LOG_TRACE("Randomizing color...\n");
-						current_target = (float)std::rand() / (float)RAND_MAX;
-					}
-
-					float dist = current_target - current_hue;
-					
-					current_hue += dist * current_delta * 0.5f;
-					
 					// Rendering process
 					
 					auto cmd = device.RequestCommandBuffer();
+					DescriptorCache::Binder binder(descriptors);
+
+					if (use_compute)
+					{
+						// The fields follow the swapchain's size, which is only looked at after a resize.
+						uint32_t width = field_width;
+						uint32_t height = field_height;
+						if (swapchain_size.Update(device))
+						{
+							width = NoiseField::FieldExtent(swapchain_size.width, field_settings.scale);
+							height = NoiseField::FieldExtent(swapchain_size.height, field_settings.scale);
+						}
+
+						if (width != field_width || height != field_height)
+						{
+							// R32_SFLOAT is one of the storage image formats every device supports.
+							Vulkan::ImageCreateInfo field_info = Vulkan::ImageCreateInfo::RenderTarget(width, height, VK_FORMAT_R32_SFLOAT);
+							field_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+							field_info.initial_layout = VK_IMAGE_LAYOUT_GENERAL;
+							field_info.sharing_mode = Vulkan::ImageSharingMode::Exclusive;
+							field_info.exclusive_owner = Vulkan::IMAGE_COMMAND_QUEUE_GENERIC;
+
+							fields[0] = device.CreateImage(field_info);
+							fields[1] = device.CreateImage(field_info);
+
+							descriptors.Clear();
+							for (uint32_t i = 0; i < 2; i++)
+							{
+								DescriptorSetContents compute_set;
+								compute_set.SetSampledTexture(history_slot, fields[i ^ 1]->GetView(), Vulkan::StockSampler::LinearClamp);
+								compute_set.SetStorageTexture(field_slot, fields[i]->GetView());
+								compute_sets[i] = descriptors.Register(compute_set);
+
+								DescriptorSetContents upsample_set;
+								upsample_set.SetSampledTexture(upsample_field_slot, fields[i]->GetView(), Vulkan::StockSampler::LinearClamp);
+								upsample_sets[i] = descriptors.Register(upsample_set);
+							}
+
+							field_width = width;
+							field_height = height;
+							field_scheduler.Invalidate();
+						}
+
+						field_index ^= 1;
+						Vulkan::Image& field = *fields[field_index];
+
+						// Last time this field was used it was sampled by the upsample pass.
+						cmd->ImageBarrier(field, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+							VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+							VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+						cmd->SetProgram(*compute_program);
+
+						NoiseField::FrameParams field_params = field_scheduler.Advance(current_time / 10.0f, current_time);
+						uniforms.Bind(*cmd, field_uniforms, uniforms.Write(field_params), counters.frame);
+
+						binder.Bind(*cmd, compute_sets[field_index]);
+
+						cmd->Dispatch((field_width + 7) / 8, (field_height + 7) / 8, 1);
+
+						cmd->ImageBarrier(field, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+							VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+							VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+					}
 
 					// Just render a clear color to screen.
 					// There is a lot of stuff going on in these few calls which will need its own sample to explore w.r.t. synchronization.
@@ -79,39 +390,67 @@ int main(int argc, char** argv)
 
 					cmd->SetOpaqueState();
 
-					cmd->SetProgram(*program);
-					cmd->SetVertexAttrib(0, 0, VK_FORMAT_R32G32_SFLOAT, 0);
-					cmd->SetVertexBinding(0, sizeof(float) * 2);
-					cmd->SetPrimitiveTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-					cmd->SetCullMode(VK_CULL_MODE_NONE);
+					cmd->SetProgram(use_compute ? *upsample_program : *program);
+
+					NoiseField::ColorParams color_params = { current_hue, 0.3f, current_time / 10.0f, current_time };
+					uniforms.Bind(*cmd, color_uniforms, uniforms.Write(color_params), counters.frame);
 
-					float cpu_vert_data[] = { -1.0f, -1.0f, -1.0f, 1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 1.0f, -1.0f, -1.0f, 1.0f };
-					void* gpu_vert_data = cmd->AllocateVertexData(0, sizeof(cpu_vert_data));
-					memcpy(gpu_vert_data, cpu_vert_data, sizeof(cpu_vert_data));
+					if (use_compute)
+						binder.Bind(*cmd, upsample_sets[field_index]);
 
-					float cpu_uniform_data[] = { current_hue, 0.3f , current_time / 10.0f, current_time };
-					void* gpu_uniform_data = cmd->AllocateConstantData(0, 0, 0, sizeof(float) * 4);
-					memcpy(gpu_uniform_data, cpu_uniform_data, sizeof(float) * 4);
+					if (use_quad)
+					{
+						cmd->SetVertexAttrib(0, 0, VK_FORMAT_R32G32_SFLOAT, 0);
+						cmd->SetVertexBinding(0, sizeof(float) * 2);
+						cmd->SetPrimitiveTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+						cmd->SetCullMode(VK_CULL_MODE_NONE);
 
-					cmd->Draw(6);
+						if (fullscreen_mode == FullscreenMode::StaticQuad)
+						{
+							quad.Bind(*cmd);
+						}
+						else
+						{
+							float cpu_vert_data[] = { -1.0f, -1.0f, -1.0f, 1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 1.0f, -1.0f, -1.0f, 1.0f };
+							void* gpu_vert_data = AllocateVertexData(*cmd, counters, 0, sizeof(cpu_vert_data));
+							memcpy(gpu_vert_data, cpu_vert_data, sizeof(cpu_vert_data));
+						}
+
+						cmd->Draw(6);
+					}
+					else
+					{
+						DrawFullscreenTriangle(*cmd);
+					}
 
 					cmd->EndRenderPass();
-					device.Submit(cmd);
+					pacer.Submit(cmd);
 					
 					// -----------------
 				}
 
 				wsi.EndFrame();
 
-				current_delta = timer.end();
-				current_time += current_delta;
-
+				pacer.EndFrame();
+				counters.EndFrame();
 
 				//QM_LOG_INFO("Frame time (ms): %f\n", time_milli);
 			}
 
+			descriptors.LogStats();
+			pacer.LogStats();
+			if (timestep.dropped_steps != 0)
+				QM_LOG_INFO("Dropped %llu simulation steps after long frames\n", static_cast<unsigned long long>(timestep.dropped_steps));
+
+			uniforms.Reset();
+			quad.Reset();
+			fields[0].Reset();
+			fields[1].Reset();
+			compute_program.Reset();
+			upsample_program.Reset();
 			program.Reset();
 			device.WaitIdle();
+			SavePipelineCache(device);
 		}
 
 
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "../common/std_layout.hpp"
+
+// CPU mirror of the noise field generated by glsl/shader.frag and glsl/noise.comp.
+//
+// The compute path evaluates the field at a reduced resolution and only refreshes a subset
+// of texels each frame. The remaining texels are reprojected from the previous frame's field,
+// which is valid because the field mostly scrolls along x with ubo.x_offset. Everything in this
+// file is plain C++ so the same scheme can be measured without a GPU (see NoiseField::Simulate()).
+
+namespace NoiseField
+{
+	static inline float Mod289(float x) { return x - std::floor(x / 289.0f) * 289.0f; }
+	static inline float Fract(float x) { return x - std::floor(x); }
+	static inline float PermuteVec(float x) { return Mod289(((x * 34.0f) + 1.0f) * x); }
+	static inline float Permute(float x) { return std::floor(Mod289(((x * 34.0f) + 1.0f) * x)); }
+	static inline float TaylorInvSqrt(float r) { return 1.79284291400159f - 0.85373472095314f * r; }
+	static inline float Dot4(const float* a, const float* b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]; }
+
+	static inline void Grad4(float j, float* p)
+	{
+		const float ip[3] = { 1.0f / 294.0f, 1.0f / 49.0f, 1.0f / 7.0f };
+
+		for (int k = 0; k < 3; k++)
+			p[k] = std::floor(Fract(j * ip[k]) * 7.0f) * ip[2] - 1.0f;
+		p[3] = 1.5f - (std::abs(p[0]) + std::abs(p[1]) + std::abs(p[2]));
+
+		float sw = p[3] < 0.0f ? 1.0f : 0.0f;
+		for (int k = 0; k < 3; k++)
+		{
+			float s = p[k] < 0.0f ? 1.0f : 0.0f;
+			p[k] += (s * 2.0f - 1.0f) * sw;
+		}
+	}
+
+	// Simplex 4D noise, a line-by-line port of snoise() in the shaders.
+	static inline float SimplexNoise(const float v[4])
+	{
+		const float cx = 0.138196601125010504f;
+		const float cy = 0.309016994374947451f;
+
+		// First corner
+		float d = (v[0] + v[1] + v[2] + v[3]) * cy;
+		float i[4], x0[4];
+		for (int k = 0; k < 4; k++)
+			i[k] = std::floor(v[k] + d);
+		float di = (i[0] + i[1] + i[2] + i[3]) * cx;
+		for (int k = 0; k < 4; k++)
+			x0[k] = v[k] - i[k] + di;
+
+		// Rank sorting
+		float is_x[3] = { x0[0] >= x0[1] ? 1.0f : 0.0f, x0[0] >= x0[2] ? 1.0f : 0.0f, x0[0] >= x0[3] ? 1.0f : 0.0f };
+		float is_yz[3] = { x0[1] >= x0[2] ? 1.0f : 0.0f, x0[1] >= x0[3] ? 1.0f : 0.0f, x0[2] >= x0[3] ? 1.0f : 0.0f };
+
+		float i0[4];
+		i0[0] = is_x[0] + is_x[1] + is_x[2];
+		i0[1] = 1.0f - is_x[0] + is_yz[0] + is_yz[1];
+		i0[2] = 1.0f - is_x[1] + 1.0f - is_yz[0] + is_yz[2];
+		i0[3] = 1.0f - is_x[2] + 1.0f - is_yz[1] + 1.0f - is_yz[2];
+
+		float i1[4], i2[4], i3[4];
+		for (int k = 0; k < 4; k++)
+		{
+			i3[k] = std::clamp(i0[k], 0.0f, 1.0f);
+			i2[k] = std::clamp(i0[k] - 1.0f, 0.0f, 1.0f);
+			i1[k] = std::clamp(i0[k] - 2.0f, 0.0f, 1.0f);
+		}
+
+		float x[5][4];
+		for (int k = 0; k < 4; k++)
+		{
+			x[0][k] = x0[k];
+			x[1][k] = x0[k] - i1[k] + 1.0f * cx;
+			x[2][k] = x0[k] - i2[k] + 2.0f * cx;
+			x[3][k] = x0[k] - i3[k] + 3.0f * cx;
+			x[4][k] = x0[k] - 1.0f + 4.0f * cx;
+		}
+
+		// Permutations
+		for (int k = 0; k < 4; k++)
+			i[k] = Mod289(i[k]);
+
+		float j[5];
+		j[0] = Permute(Permute(Permute(Permute(i[3]) + i[2]) + i[1]) + i[0]);
+
+		const float* offsets[3] = { i1, i2, i3 };
+		for (int c = 0; c < 4; c++)
+		{
+			float o[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+			if (c < 3)
+				for (int k = 0; k < 4; k++)
+					o[k] = offsets[c][k];
+
+			j[c + 1] = PermuteVec(PermuteVec(PermuteVec(PermuteVec(i[3] + o[3]) + i[2] + o[2]) + i[1] + o[1]) + i[0] + o[0]);
+		}
+
+		// Gradients, normalised
+		float p[5][4];
+		for (int c = 0; c < 5; c++)
+		{
+			Grad4(j[c], p[c]);
+			float norm = TaylorInvSqrt(Dot4(p[c], p[c]));
+			for (int k = 0; k < 4; k++)
+				p[c][k] *= norm;
+		}
+
+		// Mix contributions from the five corners
+		float total = 0.0f;
+		for (int c = 0; c < 5; c++)
+		{
+			float m = std::max(0.6f - Dot4(x[c], x[c]), 0.0f);
+			m = m * m;
+			total += m * m * Dot4(p[c], x[c]);
+		}
+
+		return 49.0f * total;
+	}
+
+	static inline float FractalNoise(const float position[4], int octaves, float frequency, float persistence)
+	{
+		float total = 0.0f;
+		float max_amplitude = 0.0f;
+		float amplitude = 1.0f;
+		for (int i = 0; i < octaves; i++)
+		{
+			float p[4] = { position[0] * frequency, position[1] * frequency, position[2] * frequency, position[3] * frequency };
+			total += SimplexNoise(p) * amplitude;
+			frequency *= 2.0f;
+			max_amplitude += amplitude;
+			amplitude *= persistence;
+		}
+
+		return total / max_amplitude;
+	}
+
+	// Value of the field at a point in normalized device coordinates. This is the "n" term of the
+	// fragment shader, hue is derived from it as hue + n * variance.
+	static inline float Evaluate(float x, float y, float x_offset, float t)
+	{
+		float warp_x_pos[4] = { x, y, 1.0f, t / 100.0f };
+		float warp_y_pos[4] = { x, y, 10.0f, t / 100.0f };
+
+		float offset_x = FractalNoise(warp_x_pos, 3, 3.0f, 0.8f) / 10.0f + x_offset;
+		float offset_y = FractalNoise(warp_y_pos, 3, 3.0f, 0.8f) / 10.0f;
+
+		float pos[4] = { x + offset_x, y + offset_y, -1.0f, t / 20.0f };
+		return std::abs(FractalNoise(pos, 5, 2.0f, 0.5f));
+	}
+
+	// 4x4 ordered dither matrix used to spread refreshed texels evenly across the field.
+	static inline uint32_t Bayer4(uint32_t x, uint32_t y)
+	{
+		static const uint32_t bayer[16] = { 0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5 };
+		return bayer[(y & 3u) * 4u + (x & 3u)];
+	}
+
+	// Must match the refresh test in glsl/noise.comp.
+	static inline bool ShouldRefresh(uint32_t x, uint32_t y, uint32_t phase, uint32_t interval)
+	{
+		return (Bayer4(x, y) * interval) / 16u == phase;
+	}
+
+	struct Settings
+	{
+		// Field resolution is swapchain resolution divided by this.
+		uint32_t scale = 2;
+		// Every texel is recomputed once every interval frames. Power of two, at most 16.
+		uint32_t interval = 2;
+	};
+
+	// Per-frame parameters consumed by glsl/noise.comp. Laid out to match FIELD_UBO (std140).
+	struct FrameParams
+	{
+		float x_offset;
+		float t;
+		float history_shift;
+		uint32_t phase;
+		uint32_t interval;
+		uint32_t full_refresh;
+		uint32_t pad0;
+		uint32_t pad1;
+	};
+
+	static constexpr auto frame_params_layout = StdLayout::Describe<FrameParams>(QM_EXAMPLES_LAYOUT_MEMBER(FrameParams, x_offset), QM_EXAMPLES_LAYOUT_MEMBER(FrameParams, t),
+		QM_EXAMPLES_LAYOUT_MEMBER(FrameParams, history_shift), QM_EXAMPLES_LAYOUT_MEMBER(FrameParams, phase), QM_EXAMPLES_LAYOUT_MEMBER(FrameParams, interval),
+		QM_EXAMPLES_LAYOUT_MEMBER(FrameParams, full_refresh));
+
+	static_assert(frame_params_layout.IsPacked(StdLayout::Std140), "FrameParams must follow std140");
+	static_assert(frame_params_layout.Matches<ShaderLayouts::noise_comp::FIELD_UBO>(), "FrameParams must match FIELD_UBO in glsl/noise.comp");
+
+	// Matches UBO in glsl/shader.frag and glsl/upsample.frag (std140).
+	struct ColorParams
+	{
+		float hue;
+		float variance;
+		float x_offset;
+		float t;
+	};
+
+	static constexpr auto color_params_layout = StdLayout::Describe<ColorParams>(QM_EXAMPLES_LAYOUT_MEMBER(ColorParams, hue), QM_EXAMPLES_LAYOUT_MEMBER(ColorParams, variance),
+		QM_EXAMPLES_LAYOUT_MEMBER(ColorParams, x_offset), QM_EXAMPLES_LAYOUT_MEMBER(ColorParams, t));
+
+	static_assert(color_params_layout.IsPacked(StdLayout::Std140), "ColorParams must follow std140");
+	static_assert(color_params_layout.Matches<ShaderLayouts::shader_frag::UBO>(), "ColorParams must match UBO in glsl/shader.frag");
+	static_assert(color_params_layout.Matches<ShaderLayouts::upsample_frag::UBO>(), "ColorParams must match UBO in glsl/upsample.frag");
+
+	// Tracks refresh phase and scroll between frames. Shared by the GPU path and the simulation so
+	// both use exactly the same schedule.
+	struct Scheduler
+	{
+		explicit Scheduler(const Settings& settings_)
+			: settings(settings_)
+		{
+		}
+
+		// Forces every texel to be recomputed on the next frame, e.g. after the field was recreated.
+		void Invalidate()
+		{
+			valid = false;
+		}
+
+		FrameParams Advance(float x_offset, float t)
+		{
+			FrameParams params{};
+			params.x_offset = x_offset;
+			params.t = t;
+			params.interval = settings.interval;
+			params.phase = frame % settings.interval;
+			params.full_refresh = valid ? 0u : 1u;
+			// The field scrolls by the change in x_offset in NDC, which spans two units of uv.
+			params.history_shift = valid ? (x_offset - last_x_offset) * 0.5f : 0.0f;
+
+			last_x_offset = x_offset;
+			valid = true;
+			frame++;
+
+			return params;
+		}
+
+		Settings settings;
+		uint32_t frame = 0;
+		float last_x_offset = 0.0f;
+		bool valid = false;
+	};
+
+	static inline uint32_t FieldExtent(uint32_t swapchain_extent, uint32_t scale)
+	{
+		return std::max(1u, (swapchain_extent + scale - 1) / scale);
+	}
+
+	// Bilinear fetch with clamp-to-edge addressing and texel centers at half integers, like a
+	// LinearClamp sampler.
+	static inline float SampleBilinear(const std::vector<float>& field, uint32_t width, uint32_t height, float u, float v)
+	{
+		float fx = std::clamp(u * width - 0.5f, 0.0f, float(width - 1));
+		float fy = std::clamp(v * height - 0.5f, 0.0f, float(height - 1));
+
+		uint32_t x0 = uint32_t(fx);
+		uint32_t y0 = uint32_t(fy);
+		uint32_t x1 = std::min(x0 + 1, width - 1);
+		uint32_t y1 = std::min(y0 + 1, height - 1);
+
+		float tx = fx - float(x0);
+		float ty = fy - float(y0);
+
+		float a = field[y0 * width + x0] * (1.0f - tx) + field[y0 * width + x1] * tx;
+		float b = field[y1 * width + x0] * (1.0f - tx) + field[y1 * width + x1] * tx;
+		return a * (1.0f - ty) + b * ty;
+	}
+
+	// Runs one frame of glsl/noise.comp on the CPU: refreshed texels are evaluated, the rest are
+	// reprojected from history. Texels whose reprojected source falls outside the field are refreshed.
+	static inline void GenerateField(const FrameParams& params, const std::vector<float>& history, std::vector<float>& field, uint32_t width, uint32_t height)
+	{
+		field.resize(width * height);
+
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				float u = (float(x) + 0.5f) / float(width);
+				float v = (float(y) + 0.5f) / float(height);
+				float source_u = u + params.history_shift;
+
+				bool refresh = params.full_refresh || ShouldRefresh(x, y, params.phase, params.interval) || source_u < 0.0f || source_u > 1.0f;
+
+				if (refresh)
+					field[y * width + x] = Evaluate(u * 2.0f - 1.0f, v * 2.0f - 1.0f, params.x_offset, params.t);
+				else
+					field[y * width + x] = SampleBilinear(history, width, height, source_u, v);
+			}
+		}
+	}
+
+	struct SimulationResult
+	{
+		double mean_abs_error = 0.0;
+		double rms_error = 0.0;
+		double max_error = 0.0;
+		// Peak signal to noise ratio of the hue noise term, which spans [0, 1]. Infinite when the
+		// reduced field matches the reference exactly.
+		double psnr = 0.0;
+		// Full-quality noise evaluations per output pixel, relative to the fragment shader path.
+		double relative_cost = 0.0;
+	};
+
+	// Renders frame_count frames of both the reference full resolution field and the reduced,
+	// temporally reused field, and reports the per pixel error of the upsampled result.
+	// The first frame is excluded since it is always a full refresh.
+	static inline SimulationResult Simulate(const Settings& settings, uint32_t width, uint32_t height, uint32_t frame_count, float frame_delta)
+	{
+		uint32_t field_width = FieldExtent(width, settings.scale);
+		uint32_t field_height = FieldExtent(height, settings.scale);
+
+		Scheduler scheduler(settings);
+
+		std::vector<float> history;
+		std::vector<float> field;
+
+		double sum_abs = 0.0;
+		double sum_sq = 0.0;
+		double max_error = 0.0;
+		uint64_t samples = 0;
+
+		float t = 0.0f;
+		for (uint32_t frame = 0; frame < frame_count; frame++)
+		{
+			FrameParams params = scheduler.Advance(t / 10.0f, t);
+			GenerateField(params, history, field, field_width, field_height);
+
+			if (frame != 0)
+			{
+				for (uint32_t y = 0; y < height; y++)
+				{
+					for (uint32_t x = 0; x < width; x++)
+					{
+						float u = (float(x) + 0.5f) / float(width);
+						float v = (float(y) + 0.5f) / float(height);
+
+						float reference = Evaluate(u * 2.0f - 1.0f, v * 2.0f - 1.0f, params.x_offset, params.t);
+						float upsampled = SampleBilinear(field, field_width, field_height, u, v);
+
+						double error = std::abs(double(reference) - double(upsampled));
+						sum_abs += error;
+						sum_sq += error * error;
+						max_error = std::max(max_error, error);
+						samples++;
+					}
+				}
+			}
+
+			std::swap(history, field);
+			t += frame_delta;
+		}
+
+		SimulationResult result;
+		if (samples != 0)
+		{
+			result.mean_abs_error = sum_abs / double(samples);
+			result.rms_error = std::sqrt(sum_sq / double(samples));
+			result.max_error = max_error;
+			result.psnr = result.rms_error > 0.0 ? 20.0 * std::log10(1.0 / result.rms_error) : std::numeric_limits<double>::infinity();
+		}
+		result.relative_cost = double(field_width * field_height) / double(width * height) / double(settings.interval);
+
+		return result;
+	}
+}